@@ -54,7 +54,9 @@ jmp $
 
 ; Data
 BOOT_DRIVE: db 0
-KERNEL_OFFSET EQU 0x1000
+KERNEL_SEGMENT EQU 0x1000		; the kernel is loaded at 0x1000:0000 (0x10000), see kernel.ld
+KERNEL_OFFSET EQU 0x10000
+KERNEL_SECTORS EQU 256			; 128 KB, room for the kernel to grow below the 0x90000 stack
 WELCOME: db "Loading the kernel....", 0
 DISK_ERROR_MSG: db "Disk read Error!", 0
 DISK_SUCC_MSG: db "Disk read success!", 0
@@ -63,7 +65,6 @@ msg_prot_mode db "Switching to 32 bit Protected mode", 0
 VESA_error db "VESA is not supported", 0
 
 %include "boot/vesa.asm"
-%include "boot/gui.asm"
 %include "boot/read_disk.asm"
 %include "boot/print_string.asm"
 %include "boot/gdt.asm"
@@ -76,8 +77,6 @@ load_kernel:
 	call print_string
 
 	mov [BOOT_DRIVE], dl
-	mov bx, KERNEL_OFFSET
-	mov dl, [BOOT_DRIVE]
 	call disk_load
 	ret
 
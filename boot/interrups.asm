@@ -6,6 +6,27 @@ idt_load:
     lidt [idtp]
     ret
 
+; Loads a GDT and reloads the segment registers with its kernel
+; segments. This is declared in C as
+; 'extern void gdt_flush(struct gdt_ptr *gp);'
+; gs and the task register are per-cpu and are loaded by the caller.
+global gdt_flush
+gdt_flush:
+    mov eax, [esp+4]
+    lgdt [eax]
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ss, ax
+    jmp 0x08:gdt_flush_done     ; far jump to reload cs
+gdt_flush_done:
+    ret
+
+; gs always holds the per-cpu segment inside the kernel (GDT_PERCPU
+; in kernel/gdt.h). Every cpu's GDT has it at this selector.
+PERCPU_SEG equ 0x30
+
 ; In just a few pages in this tutorial, we will add our Interrupt
 ; Service Routines (ISRs) right here!
 global isr0
@@ -277,6 +298,7 @@ isr_common_stub:
     mov ds, ax
     mov es, ax
     mov fs, ax
+    mov ax, PERCPU_SEG
     mov gs, ax
     mov eax, esp
     push eax
@@ -308,120 +330,114 @@ global irq13
 global irq14
 global irq15
 
+; The IRQ gates are interrupt gates, the cpu has already cleared IF
+; by the time these run.
 ; 32: IRQ0
 irq0:
-    cli
     push byte 0
     push byte 32
     jmp irq_common_stub
 
 ; 33: IRQ1
 irq1:
-    cli
     push byte 0
     push byte 33
     jmp irq_common_stub
 
 ; 34: IRQ2
 irq2:
-    cli
     push byte 0
     push byte 34
     jmp irq_common_stub
 
 ; 35: IRQ3
 irq3:
-    cli
     push byte 0
     push byte 35
     jmp irq_common_stub
 
 ; 36: IRQ4
 irq4:
-    cli
     push byte 0
     push byte 36
     jmp irq_common_stub
 
 ; 37: IRQ5
 irq5:
-    cli
     push byte 0
     push byte 37
     jmp irq_common_stub
 
 ; 38: IRQ6
 irq6:
-    cli
     push byte 0
     push byte 38
     jmp irq_common_stub
 
 ; 39: IRQ7
 irq7:
-    cli
     push byte 0
     push byte 39
     jmp irq_common_stub
 
 ; 40: IRQ8
 irq8:
-    cli
     push byte 0
     push byte 40
     jmp irq_common_stub
 
 ; 41: IRQ9
 irq9:
-    cli
     push byte 0
     push byte 41
     jmp irq_common_stub
 
 ; 42: IRQ10
 irq10:
-    cli
     push byte 0
     push byte 42
     jmp irq_common_stub
 
 ; 43: IRQ11
 irq11:
-    cli
     push byte 0
     push byte 43
     jmp irq_common_stub
 
 ; 44: IRQ12
 irq12:
-    cli
     push byte 0
     push byte 44
     jmp irq_common_stub
 
 ; 45: IRQ13
 irq13:
-    cli
     push byte 0
     push byte 45
     jmp irq_common_stub
 
 ; 46: IRQ14
 irq14:
-    cli
     push byte 0
     push byte 46
     jmp irq_common_stub
 
 ; 47: IRQ15
 irq15:
-    cli
     push byte 0
     push byte 47
     jmp irq_common_stub
 
 extern irq_handler
 
+; struct regs offsets from esp once the stub has pushed everything
+REGS_CS equ 60                  ; 4 segments, 8 pusha registers, int_no, err_code, eip
+
+; Inside the kernel ds, es and fs always hold the kernel data segment
+; and gs the per-cpu segment, so an interrupt that arrives in ring 0
+; skips loading them on entry and popping them on exit: each of those
+; loads a descriptor. They are still pushed, to keep the frame a
+; complete 'struct regs'. Only an interrupt from ring 3 swaps them.
 irq_common_stub:
     pusha
     push ds
@@ -429,22 +445,31 @@ irq_common_stub:
     push fs
     push gs
 
+    test byte [esp + REGS_CS], 3
+    jz .kernel_entry
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
+    mov ax, PERCPU_SEG
     mov gs, ax
-    mov eax, esp
+.kernel_entry:
 
-    push eax
-    mov eax, irq_handler
-    call eax
-    pop eax
+    push esp
+    call irq_handler
+    add esp, 4
 
+    test byte [esp + REGS_CS], 3
+    jz .kernel_exit
     pop gs
     pop fs
     pop es
     pop ds
     popa
     add esp, 8
-    iret
\ No newline at end of file
+    iret
+.kernel_exit:
+    add esp, 16
+    popa
+    add esp, 8
+    iret
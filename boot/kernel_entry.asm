@@ -3,4 +3,9 @@
 
 call main
 %include "boot/interrups.asm"
+%include "boot/switch_context.asm"
+%include "boot/smp.asm"
+%include "boot/syscall.asm"
+%include "boot/msi.asm"
+%include "boot/profile.asm"
 jmp $
\ No newline at end of file
@@ -0,0 +1,64 @@
+; Message signalled interrupt stubs, one per vector from MSI_VECTOR_BASE
+; (kernel/apic.h). They build the usual 'struct regs' frame and call
+; msi_handler, which runs the device's handler and acknowledges the
+; local APIC instead of the PIC.
+MSI_VECTOR_BASE equ 0x30
+MSI_VECTORS equ 16
+
+extern msi_handler
+
+%assign vector 0
+%rep MSI_VECTORS
+msi %+ vector:
+    push byte 0
+    push dword MSI_VECTOR_BASE + vector
+    jmp msi_common_stub
+%assign vector vector + 1
+%endrep
+
+; addresses of the stubs above, indexed by vector - MSI_VECTOR_BASE
+global msi_stubs
+msi_stubs:
+%assign vector 0
+%rep MSI_VECTORS
+    dd msi %+ vector
+%assign vector vector + 1
+%endrep
+
+msi_common_stub:
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+
+    ; segments only need loading when the interrupt came from ring 3,
+    ; like irq_common_stub
+    test byte [esp + REGS_CS], 3
+    jz .kernel_entry
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ax, PERCPU_SEG
+    mov gs, ax
+.kernel_entry:
+
+    push esp
+    call msi_handler
+    add esp, 4
+
+    test byte [esp + REGS_CS], 3
+    jz .kernel_exit
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8
+    iret
+.kernel_exit:
+    add esp, 16
+    popa
+    add esp, 8
+    iret
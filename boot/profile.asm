@@ -0,0 +1,57 @@
+; Local APIC vectors of the sampling profiler (kernel/profile.c): the
+; per-cpu timer that takes the samples and the IPI that starts or stops
+; the timers of the other cpus. Both build a 'struct regs' frame, the
+; interrupted eip and ebp are what a sample is made of.
+PROFILE_VECTOR equ 0xE0
+PROFILE_IPI_VECTOR equ 0xE1
+
+global profile_timer
+global profile_ipi
+extern profile_interrupt
+
+profile_timer:
+    push byte 0
+    push dword PROFILE_VECTOR
+    jmp profile_common_stub
+
+profile_ipi:
+    push byte 0
+    push dword PROFILE_IPI_VECTOR
+    jmp profile_common_stub
+
+; same fast path for ring 0 as irq_common_stub
+profile_common_stub:
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+
+    test byte [esp + REGS_CS], 3
+    jz .kernel_entry
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ax, PERCPU_SEG
+    mov gs, ax
+.kernel_entry:
+
+    push esp
+    call profile_interrupt
+    add esp, 4
+
+    test byte [esp + REGS_CS], 3
+    jz .kernel_exit
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8
+    iret
+.kernel_exit:
+    add esp, 16
+    popa
+    add esp, 8
+    iret
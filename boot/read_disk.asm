@@ -5,20 +5,40 @@ disk_load:
     mov ah, 0x00
     int 0x13
 
-    ; Now begin to read sectors
-    mov ah, 0x02        ; begin to read sectors
-    mov al, 50
-    mov ch, 0
-    mov dh, 0
-    mov cl, 2
-
+    ; The kernel is bigger than a single int 13h call can safely read
+    ; (track boundaries, 64 KB DMA boundaries), so read it one sector
+    ; at a time, moving ES on by 512 bytes after every sector.
+    push es
+    mov ax, KERNEL_SEGMENT
+    mov es, ax
+    xor bx, bx
+    mov ch, 0           ; cylinder 0
+    mov dh, 0           ; head 0
+    mov cl, 2           ; sector 2, right after the boot sector
+    mov di, KERNEL_SECTORS
+
+read_next_sector:
+    mov ax, 0x0201      ; read one sector
     int 0x13
 
     jc disk_error
 
-    ; check if the read sectors are equal to al value
-    cmp al, 50
-    jne disk_error
+    mov ax, es
+    add ax, 0x20
+    mov es, ax
+
+    ; step through the CHS geometry of a 1.44 MB floppy
+    inc cl
+    cmp cl, 19
+    jne same_track
+    mov cl, 1
+    xor dh, 1
+    jnz same_track
+    inc ch
+
+same_track:
+    dec di
+    jnz read_next_sector
 
     ; if success
     jmp disk_success
@@ -27,11 +47,13 @@ disk_load:
 disk_error:
     mov si, DISK_ERROR_MSG
     call print_string
+    pop es
     popa
     ret
 
 disk_success:
     mov si, DISK_SUCC_MSG
     call print_string
+    pop es
     popa
     ret
@@ -0,0 +1,67 @@
+; Application processor start up code. smp_init copies everything
+; between ap_trampoline_start and ap_trampoline_end down to
+; AP_TRAMPOLINE and points the startup IPI at it, so every AP begins
+; here in real mode at 0x0800:0000. Until the far jump only addresses
+; relative to the copy may be used.
+AP_TRAMPOLINE equ 0x8000
+
+global ap_trampoline_start
+global ap_trampoline_end
+extern ap_main
+extern ap_boot_esp
+
+[bits 16]
+ap_trampoline_start:
+    cli
+    xor ax, ax
+    mov ds, ax
+    lgdt [AP_TRAMPOLINE + (ap_gdt_descriptor - ap_trampoline_start)]
+
+    mov eax, cr0
+    or eax, 0x1
+    mov cr0, eax
+
+    jmp dword 0x08:(AP_TRAMPOLINE + (ap_trampoline_pm - ap_trampoline_start))
+
+[bits 32]
+ap_trampoline_pm:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; the BSP hands out a stack per AP before sending the startup IPI
+    mov esp, [ap_boot_esp]
+    mov eax, ap_main
+    call eax
+    jmp $
+
+; the same flat segments as boot/gdt.asm, ap_main switches to the cpu's own GDT
+align 8
+ap_gdt:
+    dq 0
+    dq 0x00cf9a000000ffff
+    dq 0x00cf92000000ffff
+ap_gdt_descriptor:
+    dw ap_gdt_descriptor - ap_gdt - 1
+    dd AP_TRAMPOLINE + (ap_gdt - ap_trampoline_start)
+ap_trampoline_end:
+
+; Idle APs halt until the BSP queues work and sends this IPI. There
+; is nothing to do besides acknowledging it, the AP's worker loop
+; picks up the work once hlt returns.
+global ipi_wakeup
+extern lapic_base
+ipi_wakeup:
+    push eax
+    mov eax, [lapic_base]
+    mov dword [eax+0xB0], 0     ; LAPIC_EOI
+    pop eax
+    iret
+
+; Spurious local APIC interrupts must not be acknowledged
+global lapic_spurious
+lapic_spurious:
+    iret
@@ -0,0 +1,24 @@
+; Switches kernel stacks between two threads.
+; This is declared in C as
+; 'extern void switch_context(uint32_t *old_esp, uint32_t new_esp);'
+; Only the callee saved registers need to be kept, the C caller has
+; already spilled everything else. A new thread's stack is prepared by
+; thread_create so that the final 'ret' lands in thread_start.
+global switch_context
+switch_context:
+    mov eax, [esp+4]            ; where to store the old stack pointer
+    mov edx, [esp+8]            ; the stack to resume
+
+    push ebp
+    push ebx
+    push esi
+    push edi
+
+    mov [eax], esp
+    mov esp, edx
+
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
@@ -0,0 +1,118 @@
+; System call entry points. Both build the same 'struct regs' frame
+; as the interrupt stubs, with int_no 0x80, and call syscall_handler,
+; which reads the call number from eax and the arguments from ebx,
+; esi and edi and leaves the result in the saved eax.
+;
+; Selectors, see kernel/gdt.h
+USER_CODE_SEG equ 0x1B          ; GDT_USER_CODE | RPL_USER
+USER_DATA_SEG equ 0x23          ; GDT_USER_DATA | RPL_USER
+
+extern syscall_handler
+
+; 'int 0x80', the fallback for cpus without sysenter. The gate has
+; DPL 3 so ring 3 may use it, the cpu switches to the TSS's esp0.
+global isr128
+isr128:
+    push byte 0
+    push dword 0x80
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ax, PERCPU_SEG
+    mov gs, ax
+    sti                         ; syscalls may block, let IRQs in
+
+    push esp
+    call syscall_handler
+    add esp, 4
+
+    ; no IRQs while user segments are loaded in ring 0, the IRQ stubs
+    ; would take them for the kernel's
+    cli
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8
+    iret
+
+; 'sysenter'. User code puts its return address in edx and its stack
+; pointer in ecx, the cpu loads cs, ss, eip and esp from the MSRs and
+; clears IF. IA32_SYSENTER_ESP holds the address of this cpu's
+; tss.esp0, so one load gives us the running thread's kernel stack.
+global sysenter_entry
+sysenter_entry:
+    mov esp, [esp]
+
+    ; the interrupt frame 'int 0x80' would have pushed
+    push dword USER_DATA_SEG    ; ss
+    push ecx                    ; user esp
+    pushfd
+    or dword [esp], 0x200       ; user eflags had IF set
+    push dword USER_CODE_SEG    ; cs
+    push edx                    ; user eip
+    push byte 0
+    push dword 0x80
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov ax, PERCPU_SEG
+    mov gs, ax
+    sti
+
+    push esp
+    call syscall_handler
+    add esp, 4
+
+    cli                         ; see isr128
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8
+
+    ; sysexit resumes at edx with esp = ecx, both were restored by
+    ; popa from the values user code passed in
+    add esp, 8                  ; eip and cs
+    and dword [esp], ~0x200     ; user flags, but IF only comes on
+    popfd                       ; with sti, whose one instruction
+    sti                         ; delay covers sysexit
+    sysexit
+
+; Drops the current thread into ring 3. This is declared in C as
+; 'extern void enter_user_mode(uint32_t eip, uint32_t esp);'
+global enter_user_mode
+enter_user_mode:
+    cli                         ; iret turns them back on, see isr128
+    mov ecx, [esp+4]            ; entry point
+    mov edx, [esp+8]            ; user stack
+
+    mov ax, USER_DATA_SEG
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    push dword USER_DATA_SEG    ; ss
+    push edx                    ; esp
+    pushfd
+    or dword [esp], 0x200       ; interrupts on in user mode
+    push dword USER_CODE_SEG    ; cs
+    push ecx                    ; eip
+    iret
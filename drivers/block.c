@@ -0,0 +1,182 @@
+#include "block.h"
+#include "timer.h"
+#include "screen.h"
+#include "../kernel/sched.h"
+#include "../kernel/memory.h"
+#include "../kernel/low_level.h"
+#include "../include/conversion.h"
+
+/* Block devices. Drivers register a struct block_device and take
+*  requests asynchronously: submit queues a request, kick tells the device
+*  about everything queued since the last kick and the request's done
+*  callback runs when it finishes. Submitting a batch and kicking once
+*  keeps several requests in flight for the price of one notification.
+*  block_transfer wraps all of this for callers that just want to wait. */
+static struct block_device *devices[MAX_BLOCK_DEVICES];
+static int device_count;
+
+int block_register(struct block_device *dev) {
+    unsigned int flags = interrupts_save();
+
+    if(device_count == MAX_BLOCK_DEVICES) {
+        interrupts_restore(flags);
+        return -1;
+    }
+    devices[device_count++] = dev;
+    interrupts_restore(flags);
+    return 0;
+}
+
+// the device called name, or the first one when name is 0
+struct block_device *block_get(char *name) {
+    for(int i = 0; i < device_count; i++) {
+        int n;
+        if(name == 0)
+            return devices[i];
+        for(n = 0; name[n] && name[n] == devices[i]->name[n]; n++);
+        if(name[n] == 0 && devices[i]->name[n] == 0)
+            return devices[i];
+    }
+    return 0;
+}
+
+static void transfer_done(struct block_request *req) {
+    wait_queue_wake_one((struct wait_queue*)req->arg);
+}
+
+// synchronous read, write or flush. returns BLOCK_OK or BLOCK_ERROR
+int block_transfer(struct block_device *dev, int op, uint32_t sector, uint32_t count, void *buffer) {
+    struct wait_queue waiters = { 0, 0 };
+    struct block_request req;
+    unsigned int flags;
+
+    req.op = op;
+    req.sector = sector;
+    req.count = count;
+    req.buffer = buffer;
+    req.segment_count = 0;
+    req.status = BLOCK_PENDING;
+    req.done = transfer_done;
+    req.arg = &waiters;
+
+    flags = interrupts_save();
+    if(dev->submit(dev, &req) < 0) {
+        interrupts_restore(flags);
+        return BLOCK_ERROR;
+    }
+    dev->kick(dev);
+    while(req.status == BLOCK_PENDING)
+        wait_queue_sleep(&waiters);
+    interrupts_restore(flags);
+    return req.status;
+}
+
+/* sequential reads from the start of the first device, each request
+*  resubmitted from its own completion so the queue never runs dry */
+#define BENCH_BYTES     (8 * 1024 * 1024)
+#define BENCH_MAX_DEPTH 32
+#define BENCH_BUFFER    (128 * 1024)    // 32 requests of 4 KB or 8 of 64 KB
+
+struct block_bench {
+    struct block_device *dev;
+    uint32_t next_sector;
+    uint32_t end_sector;
+    int outstanding;
+    int errors;
+    struct wait_queue waiters;
+};
+
+static struct block_request bench_requests[BENCH_MAX_DEPTH];
+
+static void bench_done(struct block_request *req) {
+    struct block_bench *b = req->arg;
+
+    if(req->status != BLOCK_OK)
+        b->errors++;
+    if(b->next_sector < b->end_sector && b->errors == 0) {
+        req->sector = b->next_sector;
+        b->next_sector += req->count;
+        req->status = BLOCK_PENDING;
+        b->dev->submit(b->dev, req);
+        b->dev->kick(b->dev);
+    } else if(--b->outstanding == 0) {
+        wait_queue_wake_one(&b->waiters);
+    }
+}
+
+static void bench_run(struct block_device *dev, int depth, uint32_t request_bytes, uint8_t *buffer) {
+    struct block_bench b;
+    uint32_t total = BENCH_BYTES, elapsed, start;
+    unsigned int flags;
+    int i;
+
+    // small disks are read once, rounded down to whole requests
+    if((total >> SECTOR_SHIFT) > dev->sectors)
+        total = (dev->sectors << SECTOR_SHIFT) & ~(request_bytes - 1);
+    if(depth > total / request_bytes)
+        depth = total / request_bytes;
+    if(depth == 0)
+        return;
+    b.dev = dev;
+    b.next_sector = 0;
+    b.end_sector = total >> SECTOR_SHIFT;
+    b.outstanding = depth;
+    b.errors = 0;
+    b.waiters.head = b.waiters.tail = 0;
+
+    flags = interrupts_save();
+    start = sched_ticks();
+    for(i = 0; i < depth; i++) {
+        struct block_request *req = &bench_requests[i];
+        req->op = BLOCK_READ;
+        req->sector = b.next_sector;
+        req->count = request_bytes >> SECTOR_SHIFT;
+        req->buffer = buffer + i * request_bytes;
+        req->segment_count = 0;
+        req->status = BLOCK_PENDING;
+        req->done = bench_done;
+        req->arg = &b;
+        b.next_sector += req->count;
+        dev->submit(dev, req);
+    }
+    dev->kick(dev);
+    while(b.outstanding > 0)
+        wait_queue_sleep(&b.waiters);
+    interrupts_restore(flags);
+    elapsed = sched_ticks() - start;
+    if(elapsed == 0)
+        elapsed = 1;
+
+    printf("depth ", -1, -1);
+    printf(itoa(depth), -1, -1);
+    printf(", ", -1, -1);
+    printf(itoa(request_bytes / 1024), -1, -1);
+    printf(" KB requests: ", -1, -1);
+    printf(itoa(total / request_bytes * TIMER_HZ / elapsed), -1, -1);
+    printf(" IOPS, ", -1, -1);
+    printf(itoa(total / 1024 * TIMER_HZ / elapsed), -1, -1);
+    printf(" KB/s", -1, -1);
+    printf(b.errors ? ", errors\n" : "\n", -1, -1);
+}
+
+void block_benchmark() {
+    struct block_device *dev = block_get(0);
+    uint32_t pages = BENCH_BUFFER / PAGE_SIZE;
+    uint32_t buffer;
+
+    if(dev == 0) {
+        printf("no block device\n", -1, -1);
+        return;
+    }
+    buffer = frame_alloc_contiguous(pages);
+    if(buffer == 0) {
+        printf("not enough memory for the buffers\n", -1, -1);
+        return;
+    }
+    bench_run(dev, 1, 4096, (uint8_t*)buffer);
+    bench_run(dev, BENCH_MAX_DEPTH, 4096, (uint8_t*)buffer);
+    bench_run(dev, 1, 65536, (uint8_t*)buffer);
+    bench_run(dev, 2, 65536, (uint8_t*)buffer);
+    bench_run(dev, 8, 65536, (uint8_t*)buffer);
+    frame_free_contiguous(buffer, pages);
+}
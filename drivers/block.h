@@ -0,0 +1,60 @@
+#ifndef _BLOCK_H_
+#define _BLOCK_H_
+
+#include "../include/types.h"
+
+#define SECTOR_SIZE         512
+#define SECTOR_SHIFT        9
+#define MAX_BLOCK_DEVICES   4
+#define BLOCK_MAX_SEGMENTS  16
+
+#define BLOCK_READ          0
+#define BLOCK_WRITE         1
+#define BLOCK_FLUSH         2           // everything written so far reaches the medium
+
+#define BLOCK_OK            0
+#define BLOCK_ERROR         -1
+#define BLOCK_PENDING       1
+
+// a piece of a scattered transfer, a whole number of sectors
+typedef struct block_segment {
+    void *addr;
+    uint32_t length;
+} block_segment;
+
+/* One transfer of count sectors. The buffer has to be physically
+*  contiguous, which any kernel buffer is: the kernel is identity mapped.
+*  With segment_count set the data is scattered over the segments
+*  instead, so one request can fill several separate buffers.
+*  done runs from the driver's IRQ handler once status is set, so it must
+*  not sleep, but it may submit the next request. */
+typedef struct block_request {
+    int op;
+    uint32_t sector;
+    uint32_t count;
+    void *buffer;
+    int segment_count;
+    struct block_segment segments[BLOCK_MAX_SEGMENTS];
+    volatile int status;
+    void (*done)(struct block_request *req);
+    void *arg;
+    struct block_request *next; // owned by the driver while the request is queued
+} block_request;
+
+typedef struct block_device {
+    char name[8];
+    uint32_t sectors;
+    // queues req and returns at once, -1 if the request is malformed. the
+    // device may not hear about it before the next kick
+    int (*submit)(struct block_device *dev, struct block_request *req);
+    // one notification for everything submitted since the last kick
+    void (*kick)(struct block_device *dev);
+    void *driver;
+} block_device;
+
+int block_register(struct block_device *dev);
+struct block_device *block_get(char *name);
+int block_transfer(struct block_device *dev, int op, uint32_t sector, uint32_t count, void *buffer);
+void block_benchmark();
+
+#endif
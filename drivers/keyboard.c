@@ -5,6 +5,9 @@
 *  Notes: No warranty expressed or implied. Use at own risk. */
 #include "../include/system.h"
 #include "../include/types.h"
+#include "../kernel/low_level.h"
+#include "../kernel/sched.h"
+#include "keyboard.h"
 
 /* KBDUS means US Keyboard Layout. This is a scancode table
 *  used to layout a standard US keyboard. I have left some
@@ -15,9 +18,16 @@
 uint8_t isLeftShirtPressed = FALSE;
 uint8_t isRightShiftPressed = FALSE;
 
-/* Handles the keyboard interrupt */
+/* Scancodes travel from the IRQ to the keyboard thread through
+*  this ring, so decoding and the terminal never run with
+*  interrupts off and a slow command can't stall other IRQs */
+volatile unsigned char key_buffer[KEY_BUFFER_SIZE];
+volatile unsigned int key_head = 0, key_tail = 0;
+struct wait_queue key_waiters;
 
-void keyboard_handler(struct regs *r) {
+/* Turns one scancode into shift state changes or a character for the terminal */
+
+void keyboard_decode(unsigned char scancode) {
     unsigned char kbdus[128] =
     {
         0,  27, '1', '2', '3', '4', '5', '6', '7', '8',	/* 9 */
@@ -57,12 +67,7 @@ void keyboard_handler(struct regs *r) {
         0,	/* F12 Key */
         0,	/* All other keys are undefined */
     };
-    unsigned char scancode;
     unsigned char chr;
-    /* Read from the keyboard's data buffer */
-    scancode = port_byte_in(0x60);
-
-    // printf("> ", -1, -1, 0);
     /* If the top bit of the byte we read from the keyboard is
     *  set, that means that a key has just been released */
     if (scancode & 0x80)
@@ -117,8 +122,36 @@ void keyboard_handler(struct regs *r) {
     }
 }
 
+/* Handles the keyboard interrupt */
+void keyboard_handler(struct regs *r) {
+    /* Read from the keyboard's data buffer */
+    unsigned char scancode = port_byte_in(KEY_PORT);
+    /* Drop the key if the thread has fallen a whole buffer behind */
+    if(key_head - key_tail < KEY_BUFFER_SIZE) {
+      key_buffer[key_head % KEY_BUFFER_SIZE] = scancode;
+      key_head++;
+    }
+    wait_queue_wake_one(&key_waiters);
+}
+
+/* Decodes the buffered scancodes, sleeping while there are none */
+void keyboard_thread(void *arg) {
+    unsigned int flags;
+    unsigned char scancode;
+    while(1) {
+      flags = interrupts_save();
+      while(key_head == key_tail)
+        wait_queue_sleep(&key_waiters);
+      scancode = key_buffer[key_tail % KEY_BUFFER_SIZE];
+      key_tail++;
+      interrupts_restore(flags);
+      keyboard_decode(scancode);
+    }
+}
+
 /* Installs the keyboard handler into IRQ1 */
 void keyboard_install()
 {
+    thread_create("keyboard", keyboard_thread, 0, PRIORITY_HIGH);
     irq_install_handler(1, keyboard_handler);
 }
\ No newline at end of file
@@ -2,5 +2,7 @@
 #define KEYOBARD_HEADER
 
 #define KEY_PORT 0x60
-unsigned char keyboard_handler();
+#define KEY_BUFFER_SIZE 64
+void keyboard_decode(unsigned char scancode);
+void keyboard_install();
 #endif
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "../include/system.h"
+#include "../include/types.h"
+#include "../kernel/low_level.h"
+#include "../kernel/sched.h"
+#include "../gui/cursor.h"
+#include "vesa_vbe/vbe.h"
+#include "mouse.h"
+
+/* PS/2 mouse on IRQ12. The IRQ handler assembles packets and adds their
+*  motion to a pending delta. The mouse thread applies the delta and moves
+*  the cursor at most once per timer tick, so a burst of packets between
+*  two frames costs one cursor update instead of one per packet. */
+static volatile uint8_t packet[4];
+static volatile int packet_index;
+static int packet_size = 3;             // 4 with a wheel (IntelliMouse)
+
+static volatile int pending_dx, pending_dy, pending_wheel;
+static volatile int pending_buttons;
+static volatile int pending;
+static struct wait_queue mouse_waiters;
+
+static int mouse_x, mouse_y, mouse_buttons, mouse_wheel;
+
+static void ps2_wait_write() {
+    for(int i = 0; i < 100000 && (port_byte_in(MOUSE_STATUS_PORT) & PS2_INPUT_FULL); i++);
+}
+
+static int ps2_wait_read() {
+    for(int i = 0; i < 100000; i++)
+        if(port_byte_in(MOUSE_STATUS_PORT) & PS2_OUTPUT_FULL)
+            return 1;
+    return 0;
+}
+
+static void ps2_command(uint8_t command) {
+    ps2_wait_write();
+    port_byte_out(MOUSE_COMMAND_PORT, command);
+}
+
+static uint8_t ps2_read() {
+    ps2_wait_read();
+    return port_byte_in(MOUSE_DATA_PORT);
+}
+
+// sends a byte to the mouse rather than the controller and eats the ACK
+static uint8_t mouse_write(uint8_t value) {
+    ps2_command(0xD4);
+    ps2_wait_write();
+    port_byte_out(MOUSE_DATA_PORT, value);
+    return ps2_read();
+}
+
+// the IntelliMouse knock: sample rates 200, 100, 80 switch on the wheel
+static int mouse_enable_wheel() {
+    mouse_write(0xF3); mouse_write(200);
+    mouse_write(0xF3); mouse_write(100);
+    mouse_write(0xF3); mouse_write(80);
+    mouse_write(0xF2);                  // get device id
+    return ps2_read() == 3;
+}
+
+static void mouse_packet() {
+    uint8_t flags = packet[0];
+    int dx, dy;
+
+    // overflowed deltas are garbage, keep only the buttons
+    if(flags & 0xC0) {
+        dx = dy = 0;
+    } else {
+        dx = (int)packet[1] - ((flags << 4) & 0x100);
+        dy = (int)packet[2] - ((flags << 3) & 0x100);
+    }
+    pending_dx += dx;
+    pending_dy -= dy;                   // the mouse counts up, the screen down
+    if(packet_size == 4)
+        pending_wheel += (signed char)(packet[3] << 4) >> 4;    // 4 bit signed
+    pending_buttons = flags & (MOUSE_LEFT | MOUSE_RIGHT | MOUSE_MIDDLE);
+    pending = 1;
+}
+
+/* Handles the mouse interrupt, one byte per IRQ */
+void mouse_handler(struct regs *r) {
+    uint8_t status = port_byte_in(MOUSE_STATUS_PORT);
+    uint8_t data;
+
+    if(!(status & PS2_OUTPUT_FULL) || !(status & PS2_AUX_DATA))
+        return;
+    data = port_byte_in(MOUSE_DATA_PORT);
+
+    // bit 3 of the first byte is always set, use it to find packet boundaries again
+    if(packet_index == 0 && !(data & 0x08))
+        return;
+    packet[packet_index++] = data;
+    if(packet_index < packet_size)
+        return;
+    packet_index = 0;
+
+    mouse_packet();
+    wait_queue_wake_one(&mouse_waiters);
+}
+
+/* Applies whatever motion piled up since the last update, then waits
+*  a tick so the packets of the next frame pile up too */
+void mouse_thread(void *arg) {
+    unsigned int flags;
+    int dx, dy, wheel;
+
+    while(1) {
+        flags = interrupts_save();
+        while(!pending)
+            wait_queue_sleep(&mouse_waiters);
+        dx = pending_dx;
+        dy = pending_dy;
+        wheel = pending_wheel;
+        mouse_buttons = pending_buttons;
+        pending_dx = pending_dy = pending_wheel = 0;
+        pending = 0;
+        interrupts_restore(flags);
+
+        mouse_x += dx;
+        mouse_y += dy;
+        mouse_wheel += wheel;
+        if(mouse_x < 0) mouse_x = 0;
+        if(mouse_y < 0) mouse_y = 0;
+        if(mouse_x >= vbe_mode->width) mouse_x = vbe_mode->width - 1;
+        if(mouse_y >= vbe_mode->height) mouse_y = vbe_mode->height - 1;
+        cursor_move(mouse_x, mouse_y);
+
+        thread_sleep(1);
+    }
+}
+
+// wheel counts clicks since the mouse was installed
+void mouse_state(int *x, int *y, int *buttons, int *wheel) {
+    *x = mouse_x;
+    *y = mouse_y;
+    *buttons = mouse_buttons;
+    *wheel = mouse_wheel;
+}
+
+/* Turns on the controller's second port and its interrupt, puts the
+*  mouse in streaming mode and installs the handler into IRQ12 */
+void mouse_install() {
+    uint8_t config;
+
+    ps2_command(0xA8);                  // enable the aux port
+    ps2_command(0x20);                  // read the controller configuration
+    config = ps2_read();
+    config |= 0x02;                     // IRQ12 on
+    config &= ~0x20;                    // aux clock on
+    ps2_command(0x60);
+    ps2_wait_write();
+    port_byte_out(MOUSE_DATA_PORT, config);
+
+    mouse_write(0xF6);                  // defaults
+    if(mouse_enable_wheel())
+        packet_size = 4;
+    mouse_write(0xF4);                  // start streaming
+
+    mouse_x = vbe_mode->width / 2;
+    mouse_y = vbe_mode->height / 2;
+    cursor_show(mouse_x, mouse_y);
+
+    thread_create("mouse", mouse_thread, 0, PRIORITY_HIGH);
+    irq_install_handler(12, mouse_handler);
+}
@@ -0,0 +1,20 @@
+#ifndef _MOUSE_H_
+#define _MOUSE_H_
+
+#define MOUSE_DATA_PORT     0x60
+#define MOUSE_STATUS_PORT   0x64
+#define MOUSE_COMMAND_PORT  0x64
+
+// status register bits
+#define PS2_OUTPUT_FULL     0x01
+#define PS2_INPUT_FULL      0x02
+#define PS2_AUX_DATA        0x20
+
+#define MOUSE_LEFT          0x01
+#define MOUSE_RIGHT         0x02
+#define MOUSE_MIDDLE        0x04
+
+void mouse_install();
+void mouse_state(int *x, int *y, int *buttons, int *wheel);
+
+#endif
@@ -1,6 +1,8 @@
 #include "screen.h"
+#include "serial.h"
 #include "../kernel/low_level.h"
 #include "../include/types.h"
+#include "../tools/utils.h"
 
 void enable_cursor(uint8_t cursor_start, uint8_t cursor_end)
 {
@@ -16,34 +18,30 @@ void disable_cursor() {
     port_byte_out(0x3d5, 0x20);
 }
 
-void printf(char *string, int col, int row) {
+// everything printed also goes out on the serial console, positions aside
+void printf(const char *string, int col, int row) {
     if(col >= 0 && row >= 0)
         set_cursor(get_screen_offset(col, row));
 
     for(int i = 0; string[i] != 0; i++) {
         print_char(string[i], col, row, 0);
     }
+    serial_puts(string);
 }
 
+// upper case digits without a prefix, negative numbers as their 32 bit pattern
 void print_hex(int decimal) {
-    int remainder = 0, i = count_digit(decimal); 
-    char *hexa_decimal;
-    while(decimal != 0) {
-        remainder = decimal % 16;
-        if(remainder >= 10) {
-            hexa_decimal[i] = remainder + 55;
-            i--;
-        } else {
-            hexa_decimal[i] = remainder + 48;
-            i--;
-        }
-        if(decimal == 0) {
-            hexa_decimal[i-1] = '\0';
-        }
-        decimal /= 16;
-    }
+    char hexa_decimal[9];
+    unsigned int value = decimal;
+    int i = sizeof(hexa_decimal) - 1;
+
+    hexa_decimal[i] = '\0';
+    do {
+        hexa_decimal[--i] = "0123456789ABCDEF"[value % 16];
+        value /= 16;
+    } while(value != 0);
 
-    printf(hexa_decimal, -1, -1);
+    printf(hexa_decimal + i, -1, -1);
 }
 void print_char(char character, int col, int row, char attribute_byte) {
     unsigned char *vidmem = (unsigned char*)VIDEO_MEMORY;
@@ -10,8 +10,10 @@
 #define REG_SCREEN_DATA 0x3d5
 
 
+void printf(const char *string, int col, int row);
 int get_screen_offset(int, int);
 int get_cursor();
+void set_cursor(int offset);
 void print_char(char character, int col, int row, char attribute_byte);
 void clear_screen();
 void print_hex(int decimal);
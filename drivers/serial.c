@@ -0,0 +1,178 @@
+#include "serial.h"
+#include "timer.h"
+#include "screen.h"
+#include "../include/system.h"
+#include "../kernel/low_level.h"
+#include "../kernel/spinlock.h"
+#include "../kernel/sched.h"
+#include "../include/conversion.h"
+
+/* 16550 UART on COM1, the second console next to the screen. Writers
+*  copy into a ring and return; the THRE interrupt refills the 16 byte
+*  FIFO from the ring each time it runs empty, so the CPU deals with the
+*  UART once per 16 bytes instead of polling the line status per byte.
+*  Only a writer that finds the ring full waits, one FIFO load at a time,
+*  and so does everything written before interrupts are on once the ring
+*  fills up. '\n' goes out as "\r\n" for terminals in raw mode, like
+*  qemu -serial stdio. */
+static char ring[SERIAL_RING_SIZE];
+static uint32_t ring_head, ring_tail;   // free running, head - tail bytes queued
+static struct spinlock serial_lock = SPINLOCK_INIT;
+static int present;
+static volatile int tx_active;          // the THRE interrupt is on and will refill the FIFO
+static struct wait_queue drained;
+
+// moves up to a FIFO load from the ring to the UART, the caller holds the lock
+static void fifo_fill() {
+    for(int i = 0; i < UART_FIFO_SIZE && ring_tail != ring_head; i++)
+        port_byte_out(COM1_PORT + UART_DATA, ring[ring_tail++ & (SERIAL_RING_SIZE - 1)]);
+}
+
+static void fifo_wait() {
+    while(!(port_byte_in(COM1_PORT + UART_LSR) & UART_LSR_THRE))
+        __asm__ __volatile__("pause");
+}
+
+static void ring_put(char c) {
+    if(ring_head - ring_tail == SERIAL_RING_SIZE) {
+        fifo_wait();
+        fifo_fill();
+    }
+    ring[ring_head++ & (SERIAL_RING_SIZE - 1)] = c;
+}
+
+// THRE is the only interrupt turned on, reading IIR acknowledges it
+static void serial_handler(struct regs *r) {
+    uint8_t iir;
+
+    spin_lock(&serial_lock);
+    iir = port_byte_in(COM1_PORT + UART_IIR);
+    if(!(iir & UART_IIR_NONE) && (iir & UART_IIR_ID) == UART_IIR_THRE) {
+        if(ring_tail == ring_head) {
+            // the last byte is out of the FIFO too, nothing left to do
+            port_byte_out(COM1_PORT + UART_IER, 0);
+            tx_active = 0;
+            wait_queue_wake_all(&drained);
+        } else {
+            fifo_fill();
+        }
+    }
+    spin_unlock(&serial_lock);
+}
+
+void serial_write(const char *data, uint32_t length) {
+    unsigned int flags;
+
+    if(!present)
+        return;
+    flags = spin_lock_irqsave(&serial_lock);
+    for(uint32_t i = 0; i < length; i++) {
+        if(data[i] == '\n')
+            ring_put('\r');
+        ring_put(data[i]);
+    }
+    // an idle transmitter gets the first FIFO load here, the interrupt does the rest
+    if(!tx_active) {
+        if(port_byte_in(COM1_PORT + UART_LSR) & UART_LSR_THRE)
+            fifo_fill();
+        tx_active = 1;
+        port_byte_out(COM1_PORT + UART_IER, UART_IER_THRE);
+    }
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+void serial_puts(const char *string) {
+    uint32_t length = 0;
+
+    while(string[length])
+        length++;
+    serial_write(string, length);
+}
+
+/* Pushes everything queued out by polling, for when the interrupt can't
+*  be waited for: with interrupts off, or before the machine goes down */
+void serial_flush() {
+    unsigned int flags;
+
+    if(!present)
+        return;
+    flags = spin_lock_irqsave(&serial_lock);
+    while(ring_tail != ring_head) {
+        fifo_wait();
+        fifo_fill();
+    }
+    spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/* Sets COM1 to 115200 8N1 with the FIFOs on and installs the handler
+*  into IRQ4. Without a UART at COM1 all output to it is dropped */
+void serial_init() {
+    uint16_t divisor = 115200 / SERIAL_BAUD;
+
+    port_byte_out(COM1_PORT + UART_IER, 0);
+    port_byte_out(COM1_PORT + UART_LCR, UART_LCR_DLAB);
+    port_byte_out(COM1_PORT + UART_DIVISOR_LOW, divisor & 0xFF);
+    port_byte_out(COM1_PORT + UART_DIVISOR_HIGH, divisor >> 8);
+    port_byte_out(COM1_PORT + UART_LCR, UART_LCR_8N1);
+    port_byte_out(COM1_PORT + UART_FCR, UART_FCR_ENABLE);
+
+    // a byte sent in loopback mode comes back if there is a UART at all
+    port_byte_out(COM1_PORT + UART_MCR, UART_MCR_LOOPBACK | UART_MCR_DTR_RTS);
+    port_byte_out(COM1_PORT + UART_DATA, 0xAE);
+    if(port_byte_in(COM1_PORT + UART_DATA) != 0xAE)
+        return;
+    port_byte_out(COM1_PORT + UART_MCR, UART_MCR_DTR_RTS | UART_MCR_OUT2);
+
+    irq_install_handler(COM1_IRQ, serial_handler);
+    present = 1;
+}
+
+/* cost to the writer of queueing a line against writing it out polled,
+*  and the rate the interrupt drains the ring at */
+#define BENCH_LINES     64
+#define BENCH_LINE      "serialbench 0123456789abcdefghijklmnopqrstuvwxyz\n"
+
+static void wait_drained() {
+    unsigned int flags = interrupts_save();
+    while(tx_active)
+        wait_queue_sleep(&drained);
+    interrupts_restore(flags);
+}
+
+void serial_benchmark() {
+    uint32_t line_length = sizeof(BENCH_LINE) - 1;
+    uint32_t queued, polled, ticks;
+    unsigned long long start;
+
+    if(!present) {
+        printf("no UART at COM1\n", -1, -1);
+        return;
+    }
+    wait_drained();
+    start = rdtsc();
+    for(int i = 0; i < BENCH_LINES; i++)
+        serial_write(BENCH_LINE, line_length);
+    queued = (uint32_t)divide64(rdtsc() - start, BENCH_LINES, 0);
+    ticks = sched_ticks();
+    wait_drained();
+    ticks = sched_ticks() - ticks;
+    if(ticks == 0)
+        ticks = 1;
+
+    start = rdtsc();
+    for(int i = 0; i < BENCH_LINES; i++) {
+        serial_write(BENCH_LINE, line_length);
+        serial_flush();
+    }
+    polled = (uint32_t)divide64(rdtsc() - start, BENCH_LINES, 0);
+
+    printf("serial line of ", -1, -1);
+    printf(itoa(line_length), -1, -1);
+    printf(" bytes: ", -1, -1);
+    printf(itoa(queued), -1, -1);
+    printf(" cycles queued, ", -1, -1);
+    printf(itoa(polled), -1, -1);
+    printf(" polled\ndrained at ", -1, -1);
+    printf(itoa(BENCH_LINES * (line_length + 1) * TIMER_HZ / ticks), -1, -1);
+    printf(" bytes/s\n", -1, -1);
+}
@@ -0,0 +1,44 @@
+#ifndef _SERIAL_H_
+#define _SERIAL_H_
+
+#include "../include/types.h"
+
+#define COM1_PORT           0x3F8
+#define COM1_IRQ            4
+#define SERIAL_BAUD         115200
+
+// 16550 registers, offsets from the base port
+#define UART_DATA           0           // THR when written, RBR when read
+#define UART_IER            1
+#define UART_DIVISOR_LOW    0           // with DLAB set
+#define UART_DIVISOR_HIGH   1
+#define UART_IIR            2           // read
+#define UART_FCR            2           // write
+#define UART_LCR            3
+#define UART_MCR            4
+#define UART_LSR            5
+
+#define UART_IER_THRE       0x02
+#define UART_IIR_NONE       0x01        // no interrupt pending
+#define UART_IIR_ID         0x0E
+#define UART_IIR_THRE       0x02
+#define UART_FCR_ENABLE     0x07        // FIFOs on, both cleared
+#define UART_LCR_8N1        0x03
+#define UART_LCR_DLAB       0x80
+#define UART_MCR_DTR_RTS    0x03
+#define UART_MCR_OUT2       0x08        // routes the UART's interrupt to the PIC
+#define UART_MCR_LOOPBACK   0x10
+#define UART_LSR_THRE       0x20        // transmit FIFO empty
+
+#define UART_FIFO_SIZE      16
+
+// bytes waiting for the transmitter, a power of two
+#define SERIAL_RING_SIZE    8192
+
+void serial_init();
+void serial_write(const char *data, uint32_t length);
+void serial_puts(const char *string);
+void serial_flush();
+void serial_benchmark();
+
+#endif
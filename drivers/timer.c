@@ -1,15 +1,65 @@
 #include "timer.h"
-
+#include "../kernel/low_level.h"
+#include "../kernel/sched.h"
+#include "../kernel/printk.h"
+#include "../kernel/profile.h"
 int timer_tick = 0;
-void timer_handler() {
+uint32_t tsc_per_us = 1;
+// IRQ0s per scheduler tick, more than one while the profiler samples with the PIT
+static int timer_divider = 1;
+static int timer_count = 0;
+// program channel 0 of the PIT to fire IRQ0 hz times per second
+void timer_phase(int hz) {
+    int divisor = PIT_FREQUENCY / hz;
+    port_byte_out(0x43, 0x36);              // channel 0, lobyte/hibyte, square wave
+    port_byte_out(0x40, divisor & 0xff);
+    port_byte_out(0x40, (divisor >> 8) & 0xff);
+}
+// runs the PIT at hz, a multiple of TIMER_HZ, keeping the tick at TIMER_HZ
+void timer_set_rate(int hz) {
+    timer_divider = hz / TIMER_HZ;
+    timer_count = 0;
+    timer_phase(hz);
+}
+// count TSC cycles across a 10 ms one-shot on PIT channel 2. polled, so it
+// works before interrupts are enabled
+void timer_calibrate_tsc() {
+    int count = PIT_FREQUENCY / 100;
+    unsigned long long start, end;
+    port_byte_out(0x61, (port_byte_in(0x61) & ~0x02) | 0x01);  // gate on, speaker off
+    port_byte_out(0x43, 0xB0);              // channel 2, lobyte/hibyte, interrupt on terminal count
+    port_byte_out(0x42, count & 0xff);
+    port_byte_out(0x42, (count >> 8) & 0xff);
+    start = rdtsc();
+    while(!(port_byte_in(0x61) & 0x20));    // OUT2 goes high when the count runs out
+    end = rdtsc();
+    tsc_per_us = (uint32_t)divide64(end - start, 10000, 0);
+    if(tsc_per_us == 0)
+        tsc_per_us = 1;
+}
+// busy wait, for short hardware delays where sleeping a whole tick is too coarse
+void udelay(uint32_t us) {
+    unsigned long long start = rdtsc();
+    unsigned long long cycles = (unsigned long long)us * tsc_per_us;
+    while(rdtsc() - start < cycles)
+        __asm__ __volatile__("pause");
+}
+void timer_handler(struct regs *r) {
+    if(profile_pit)
+        profile_sample(r);
+    if(++timer_count < timer_divider)
+        return;
+    timer_count = 0;
     timer_tick++;
-
-    if(timer_tick % 60 == 0) {
-        printf(itoa(timer_tick), -1, -1);
-        printf("\n", -1, -1);
-    }
+    sched_tick();
+    printk_tick();
+}
+// blocks the calling thread, the cpu is free for other threads meanwhile
+void timer_wait(int ticks) {
+    thread_sleep(ticks);
 }
-
 void timer_install() {
+    timer_calibrate_tsc();
+    timer_phase(TIMER_HZ);
     irq_install_handler(0, timer_handler);
-}
\ No newline at end of file
+}
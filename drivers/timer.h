@@ -1,3 +1,17 @@
 #pragma once
+#include "../include/types.h"
 
-void timer_handler();
\ No newline at end of file
+#define PIT_FREQUENCY 1193180
+#define TIMER_HZ 100
+
+struct regs;
+
+void timer_handler(struct regs *r);
+void timer_phase(int hz);
+void timer_set_rate(int hz);
+void timer_wait(int ticks);
+void timer_install();
+void timer_calibrate_tsc();
+void udelay(uint32_t us);
+
+extern uint32_t tsc_per_us;
\ No newline at end of file
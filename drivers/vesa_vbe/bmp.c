@@ -0,0 +1,330 @@
+#include "bmp.h"
+#include "vbe.h"
+#include "../screen.h"
+#include "../../fs/vfs.h"
+#include "../../kernel/low_level.h"
+#include "../../include/conversion.h"
+
+/* BMP decoding straight into the framebuffer. The image is read in place
+*  (from the initrd through vfs_mmap) one row at a time and every row is
+*  converted into the mode's pixel layout as it is written, so there is
+*  never a decoded copy of the whole image.
+*
+*  The kernel does not save FPU/SSE state on a context switch, so the
+*  conversion is done 32 bits at a time in integer registers: when the
+*  screen uses 8 bit channels in BMP byte order, four 24 bit pixels are
+*  unpacked from three word loads (or packed into three word stores)
+*  with shifts and masks. Any other layout goes through per channel
+*  lookup tables built once from the mode's masks and positions. */
+
+// lets us load and store pixels at any byte address
+typedef uint32_t unaligned_u32 __attribute__((aligned(1), may_alias));
+
+struct blit_target {
+    int ready;
+    int bytes;                  // per pixel on screen
+    int native;                 // 8 bit channels at 16/8/0, the BMP's own BGR order
+    uint32_t red[256];          // 8 bit channel value to screen pixel bits
+    uint32_t green[256];
+    uint32_t blue[256];
+};
+
+struct bmp_source {
+    const uint8_t *pixels;      // first byte of the first stored row
+    int width;
+    int height;                 // rows, always positive
+    int bottom_up;
+    int bpp;
+    uint32_t stride;            // bytes per stored row, rows are padded to 4 bytes
+    int red_shift, green_shift, blue_shift;     // 32 bpp only
+};
+
+static struct blit_target target;
+static uint32_t palette[256];               // colour table already in screen format
+static uint32_t row_pixels[BMP_MAX_WIDTH];  // one converted row for the lookup path
+static int force_lookup;                    // benchmark switch, skips the native paths
+
+static void channel_table(uint32_t *table, int size, int position) {
+    for(int v = 0; v < 256; v++) {
+        uint32_t bits = size >= 8 ? (uint32_t)v << (size - 8) : (uint32_t)v >> (8 - size);
+        table[v] = size ? bits << position : 0;
+    }
+}
+
+static void target_init() {
+    target.bytes = (vbe_mode->bpp + 7) / 8;
+    channel_table(target.red, vbe_mode->red_mask, vbe_mode->red_position);
+    channel_table(target.green, vbe_mode->green_mask, vbe_mode->green_position);
+    channel_table(target.blue, vbe_mode->blue_mask, vbe_mode->blue_position);
+    target.native = (target.bytes == 3 || target.bytes == 4)
+        && vbe_mode->red_mask == 8 && vbe_mode->red_position == 16
+        && vbe_mode->green_mask == 8 && vbe_mode->green_position == 8
+        && vbe_mode->blue_mask == 8 && vbe_mode->blue_position == 0;
+    target.ready = 1;
+}
+
+// four pixels from three loads: B0 G0 R0 B1 | G1 R1 B2 G2 | R2 B3 G3 R3
+static void swar_24_to_32(uint8_t *dest, const uint8_t *src, int count) {
+    const unaligned_u32 *in = (const unaligned_u32*)src;
+    unaligned_u32 *out = (unaligned_u32*)dest;
+    int i;
+
+    for(i = 0; i + 4 <= count; i += 4, in += 3) {
+        uint32_t w0 = in[0], w1 = in[1], w2 = in[2];
+        out[i] = w0 & 0xFFFFFF;
+        out[i + 1] = (w0 >> 24) | ((w1 & 0xFFFF) << 8);
+        out[i + 2] = (w1 >> 16) | ((w2 & 0xFF) << 16);
+        out[i + 3] = w2 >> 8;
+    }
+    for(src = (const uint8_t*)in; i < count; i++, src += 3)
+        out[i] = src[0] | (src[1] << 8) | (src[2] << 16);
+}
+
+// the reverse: four BGRx pixels packed into three stores
+static void swar_32_to_24(uint8_t *dest, const uint8_t *src, int count) {
+    const unaligned_u32 *in = (const unaligned_u32*)src;
+    unaligned_u32 *out = (unaligned_u32*)dest;
+    int i;
+
+    for(i = 0; i + 4 <= count; i += 4, out += 3) {
+        uint32_t p0 = in[i], p1 = in[i + 1], p2 = in[i + 2], p3 = in[i + 3];
+        out[0] = (p0 & 0xFFFFFF) | (p1 << 24);
+        out[1] = ((p1 >> 8) & 0xFFFF) | (p2 << 16);
+        out[2] = ((p2 >> 16) & 0xFF) | (p3 << 8);
+    }
+    for(dest = (uint8_t*)out; i < count; i++, dest += 3) {
+        uint32_t p = in[i];
+        dest[0] = p;
+        dest[1] = p >> 8;
+        dest[2] = p >> 16;
+    }
+}
+
+static void copy_words(uint8_t *dest, const uint8_t *src, uint32_t length) {
+    const unaligned_u32 *in = (const unaligned_u32*)src;
+    unaligned_u32 *out = (unaligned_u32*)dest;
+    uint32_t words = length / 4;
+
+    for(uint32_t i = 0; i < words; i++)
+        out[i] = in[i];
+    for(uint32_t i = words * 4; i < length; i++)
+        dest[i] = src[i];
+}
+
+// writes a row the native paths can't handle, one converted pixel at a time
+static void store_pixels(uint8_t *dest, uint32_t *pixels, int count) {
+    if(target.bytes == 4) {
+        for(int i = 0; i < count; i++)
+            ((uint32_t*)dest)[i] = pixels[i];
+    } else if(target.bytes == 3) {
+        for(int i = 0; i < count; i++, dest += 3) {
+            dest[0] = pixels[i];
+            dest[1] = pixels[i] >> 8;
+            dest[2] = pixels[i] >> 16;
+        }
+    } else if(target.bytes == 2) {
+        for(int i = 0; i < count; i++)
+            ((uint16_t*)dest)[i] = pixels[i];
+    }
+}
+
+// columns [first, first + count) of one stored row to the screen
+static void blit_row(struct bmp_source *bmp, const uint8_t *row, int first, int count, uint8_t *dest) {
+    const uint8_t *src;
+    int native = target.native && !force_lookup;
+    int i;
+
+    if(bmp->bpp == 24) {
+        src = row + first * 3;
+        if(native && target.bytes == 4) {
+            swar_24_to_32(dest, src, count);
+            return;
+        }
+        if(native) {
+            copy_words(dest, src, count * 3);
+            return;
+        }
+        for(i = 0; i < count; i++, src += 3)
+            row_pixels[i] = target.red[src[2]] | target.green[src[1]] | target.blue[src[0]];
+    } else if(bmp->bpp == 32) {
+        const unaligned_u32 *in = (const unaligned_u32*)(row + first * 4);
+        if(native && bmp->red_shift == 16 && bmp->green_shift == 8 && bmp->blue_shift == 0) {
+            if(target.bytes == 4)
+                copy_words(dest, (const uint8_t*)in, count * 4);
+            else
+                swar_32_to_24(dest, (const uint8_t*)in, count);
+            return;
+        }
+        for(i = 0; i < count; i++) {
+            uint32_t p = in[i];
+            row_pixels[i] = target.red[(p >> bmp->red_shift) & 0xFF]
+                          | target.green[(p >> bmp->green_shift) & 0xFF]
+                          | target.blue[(p >> bmp->blue_shift) & 0xFF];
+        }
+    } else {
+        // 1, 4 or 8 bit indices, the leftmost pixel in the high bits of a byte
+        int per_byte = 8 / bmp->bpp;
+        int mask = (1 << bmp->bpp) - 1;
+        for(i = 0; i < count; i++) {
+            int column = first + i;
+            int shift = 8 - bmp->bpp * (column % per_byte + 1);
+            row_pixels[i] = palette[(row[column / per_byte] >> shift) & mask];
+        }
+    }
+    store_pixels(dest, row_pixels, count);
+}
+
+// a contiguous run of 8 set bits, returns its shift or -1
+static int byte_mask_shift(uint32_t mask) {
+    for(int shift = 0; shift <= 24; shift += 8)
+        if(mask == 0xFFu << shift)
+            return shift;
+    return -1;
+}
+
+// checks the headers and fills in bmp and the palette. returns 0 for anything we can't draw
+static int bmp_parse(const uint8_t *image, uint32_t size, struct bmp_source *bmp) {
+    struct bmp_header *file = (struct bmp_header*)image;
+    struct dib_header *dib = (struct dib_header*)(image + sizeof(struct bmp_header));
+    uint32_t table;
+    uint32_t colors;
+    uint32_t rows;
+
+    if(size < sizeof(struct bmp_header) + sizeof(struct dib_header) || file->type != BMP_MAGIC)
+        return 0;
+    if(dib->headerSize < 40 || dib->headerSize > size - sizeof(struct bmp_header))
+        return 0;
+    if(dib->color_planes != 1 || dib->width <= 0 || dib->width > BMP_MAX_WIDTH || dib->height == 0)
+        return 0;
+
+    bmp->width = dib->width;
+    bmp->bottom_up = dib->height > 0;
+    bmp->height = bmp->bottom_up ? dib->height : -dib->height;
+    bmp->bpp = dib->colorDepth;
+    bmp->stride = ((bmp->width * bmp->bpp + 31) / 32) * 4;
+
+    if(bmp->bpp != 1 && bmp->bpp != 4 && bmp->bpp != 8 && bmp->bpp != 24 && bmp->bpp != 32)
+        return 0;
+    if(dib->compression != BI_RGB && !(dib->compression == BI_BITFIELDS && bmp->bpp == 32))
+        return 0;
+
+    rows = bmp->height;
+    if(file->offset > size || (size - file->offset) / bmp->stride < rows)
+        return 0;
+    bmp->pixels = image + file->offset;
+
+    if(bmp->bpp == 32) {
+        // BI_RGB is BGRx, the masks sit at the same offset in every header version
+        bmp->red_shift = 16;
+        bmp->green_shift = 8;
+        bmp->blue_shift = 0;
+        if(dib->compression == BI_BITFIELDS) {
+            bmp->red_shift = byte_mask_shift(dib->red_mask);
+            bmp->green_shift = byte_mask_shift(dib->green_mask);
+            bmp->blue_shift = byte_mask_shift(dib->blue_mask);
+            if(bmp->red_shift < 0 || bmp->green_shift < 0 || bmp->blue_shift < 0)
+                return 0;
+        }
+    }
+
+    if(bmp->bpp <= 8) {
+        colors = dib->color_num ? dib->color_num : 1u << bmp->bpp;
+        // offsets into the file, headerSize is within it so nothing wraps
+        table = sizeof(struct bmp_header) + dib->headerSize;
+        if(colors > 256 || colors * 4 > size - table)
+            return 0;
+        // BGRx entries, converted once here instead of once per pixel
+        for(uint32_t i = 0; i < 256; i++) {
+            const uint8_t *entry = image + table + (i < colors ? i : 0) * 4;
+            palette[i] = target.red[entry[2]] | target.green[entry[1]] | target.blue[entry[0]];
+        }
+    }
+    return 1;
+}
+
+/* Draws the BMP file in image with its top left corner at (x, y),
+*  clipped to the screen. Returns 0 if the image can't be decoded */
+int bmp_draw(const uint8_t *image, uint32_t size, int x, int y) {
+    struct bmp_source bmp;
+    uint8_t *fb = (uint8_t*)(uintptr_t)vbe_mode->framebuffer;
+    int first_column = 0, first_row = 0;
+    int columns, rows;
+
+    if(!target.ready)
+        target_init();
+    if(!bmp_parse(image, size, &bmp))
+        return 0;
+
+    if(x < 0)
+        first_column = -x;
+    if(y < 0)
+        first_row = -y;
+    columns = bmp.width;
+    if(x + columns > vbe_mode->width)
+        columns = vbe_mode->width - x;
+    rows = bmp.height;
+    if(y + rows > vbe_mode->height)
+        rows = vbe_mode->height - y;
+    if(columns <= first_column || rows <= first_row)
+        return 1;
+
+    for(int r = first_row; r < rows; r++) {
+        int stored = bmp.bottom_up ? bmp.height - 1 - r : r;
+        uint8_t *dest = fb + (y + r) * vbe_mode->pitch + (x + first_column) * target.bytes;
+        blit_row(&bmp, bmp.pixels + stored * bmp.stride, first_column, columns - first_column, dest);
+    }
+    LFB_WRITTEN((rows - first_row) * (columns - first_column) * target.bytes);
+    return 1;
+}
+
+int bmp_draw_file(char *path, int x, int y) {
+    int fd = vfs_open(path);
+    const uint8_t *image;
+    uint32_t size;
+
+    if(fd < 0)
+        return 0;
+    image = vfs_mmap(fd, &size);
+    vfs_close(fd);
+    return bmp_draw(image, size, x, y);
+}
+
+/* decode and blit of pic.bmp from the initrd, through the native
+*  word-at-a-time path and through the lookup tables */
+#define BENCH_ROUNDS 10
+
+static uint32_t bench_draw(const uint8_t *image, uint32_t size) {
+    unsigned long long start = rdtsc();
+
+    for(int round = 0; round < BENCH_ROUNDS; round++)
+        bmp_draw(image, size, 0, 0);
+    return (uint32_t)divide64(rdtsc() - start, BENCH_ROUNDS, 0);
+}
+
+void bmp_benchmark() {
+    int fd = vfs_open("pic.bmp");
+    const uint8_t *image;
+    uint32_t size, native, lookup;
+
+    if(fd < 0) {
+        printf("pic.bmp is not in the initrd\n", -1, -1);
+        return;
+    }
+    image = vfs_mmap(fd, &size);
+    vfs_close(fd);
+    if(!bmp_draw(image, size, 0, 0)) {
+        printf("pic.bmp: unsupported format\n", -1, -1);
+        return;
+    }
+
+    native = bench_draw(image, size);
+    force_lookup = 1;
+    lookup = bench_draw(image, size);
+    force_lookup = 0;
+
+    printf("bmp decode and blit: ", -1, -1);
+    printf(itoa(native), -1, -1);
+    printf(" cycles\nwith lookup tables only: ", -1, -1);
+    printf(itoa(lookup), -1, -1);
+    printf(" cycles\n", -1, -1);
+}
@@ -0,0 +1,46 @@
+#ifndef _BMP_H_
+#define _BMP_H_
+
+#include "../../include/types.h"
+
+#define BMP_MAGIC           0x4d42      // "BM"
+
+// compression values we understand
+#define BI_RGB              0
+#define BI_BITFIELDS        3
+
+// widest image row the generic path converts in one go
+#define BMP_MAX_WIDTH       2048
+
+// the file header is always 14 bytes long
+typedef struct bmp_header {
+    unsigned short type;
+    unsigned int size;
+    unsigned int reserved;
+    unsigned int offset;
+} __attribute__((packed)) bmp_header;
+
+
+typedef struct dib_header {
+    unsigned int headerSize;
+    int width;
+    int height;                 // positive: rows are stored bottom-up
+    unsigned short color_planes;
+    unsigned short colorDepth;
+    unsigned int compression;
+    unsigned int image_size;
+    int horizontal_resolution;
+    int vertical_resolution;
+    unsigned int color_num;
+    unsigned int importantCol;
+    // BITMAPV4 and later, or right after a 40 byte header with BI_BITFIELDS
+    unsigned int red_mask;
+    unsigned int green_mask;
+    unsigned int blue_mask;
+} __attribute__((packed)) dib_header;
+
+int bmp_draw(const uint8_t *image, uint32_t size, int x, int y);
+int bmp_draw_file(char *path, int x, int y);
+void bmp_benchmark();
+
+#endif
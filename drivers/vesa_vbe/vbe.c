@@ -1,7 +1,9 @@
 #include "vbe.h"
+#include "../../kernel/printk.h"
+#include "../../include/strings.h"
 
-unsigned char *vbe_info_pointer = 0x3000;
-unsigned char *vbe_mode_info_pointer = 0x3512;
+unsigned char *vbe_info_pointer = (unsigned char*)0x3000;
+unsigned char *vbe_mode_info_pointer = (unsigned char*)0x3512;
 
 struct vbe_info_structure *vbe;  // this will point to the structure of vbe_info by the bootloader form 0x3000 memory address
 struct vbe_mode_info_struture *vbe_mode;
@@ -15,15 +17,12 @@ int vbe_software_support() {
 
     // check whether bios supports vbe or not
     if(string_compare(vbe->signature, "VESA") == 0) {
-        printf("BIOS doesnt support VBE at all\n", -1, -1);
+        printk_level(LOG_WARN, "BIOS doesnt support VBE at all\n");
     }
-    printf("Signature: ", -1, -1);
-    printf(vbe->signature, -1, -1);
+    // the signature is not 0 terminated
+    printk("VBE signature %.4s\n", vbe->signature);
 }
 
 void get_vbe_mode_info() {
-    printf("\nWidth: ", -1, -1);
-    printf(itoa(vbe_mode->width), -1, -1);
-    printf("\nHeight: ", -1, -1);
-    printf(itoa(vbe_mode->height), -1, -1);
+    printk("VBE mode %dx%d\n", vbe_mode->width, vbe_mode->height);
 }
\ No newline at end of file
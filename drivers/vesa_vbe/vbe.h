@@ -60,6 +60,15 @@ typedef struct vbe_mode_info_struture {
 extern struct vbe_mode_info_struture *vbe_mode;
 extern struct vbe_info_structure *vbe;
 
+// drawing code reports what it stores to the LFB. only the host
+// simulator (sim/fbsim.c, built with FBSIM) keeps count
+#ifdef FBSIM
+extern uint32_t lfb_bytes_written;
+#define LFB_WRITTEN(bytes)  (lfb_bytes_written += (bytes))
+#else
+#define LFB_WRITTEN(bytes)  ((void)0)
+#endif
+
 int vbe_software_support();
 void get_vbe_mode_info();
 #endif
\ No newline at end of file
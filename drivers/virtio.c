@@ -0,0 +1,351 @@
+#include "virtio.h"
+#include "../kernel/pci.h"
+#include "../kernel/memory.h"
+#include "../kernel/low_level.h"
+
+/* virtio over PCI, shared by the virtio drivers. Both transports are
+*  handled: legacy devices keep their registers in I/O BAR 0, modern
+*  (virtio 1.0) devices describe memory mapped structures with vendor
+*  capabilities. Above that the two look the same: the driver negotiates
+*  features, sets up split virtqueues and hands them chains of buffers.
+*  Nothing here locks, every driver serializes access to its own queues. */
+
+// the compiler must not move ring accesses across this, x86 keeps stores in order
+#define compiler_barrier() __asm__ __volatile__("" : : : "memory")
+
+static inline uint8_t common_read8(struct virtio_device *vdev, int offset) {
+    return *(volatile uint8_t*)(vdev->common + offset);
+}
+
+static inline uint16_t common_read16(struct virtio_device *vdev, int offset) {
+    return *(volatile uint16_t*)(vdev->common + offset);
+}
+
+static inline uint32_t common_read32(struct virtio_device *vdev, int offset) {
+    return *(volatile uint32_t*)(vdev->common + offset);
+}
+
+static inline void common_write8(struct virtio_device *vdev, int offset, uint8_t value) {
+    *(volatile uint8_t*)(vdev->common + offset) = value;
+}
+
+static inline void common_write16(struct virtio_device *vdev, int offset, uint16_t value) {
+    *(volatile uint16_t*)(vdev->common + offset) = value;
+}
+
+static inline void common_write32(struct virtio_device *vdev, int offset, uint32_t value) {
+    *(volatile uint32_t*)(vdev->common + offset) = value;
+}
+
+// 64 bit fields are written as two halves, low first
+static inline void common_write64(struct virtio_device *vdev, int offset, uint32_t value) {
+    common_write32(vdev, offset, value);
+    common_write32(vdev, offset + 4, 0);
+}
+
+static uint8_t get_status(struct virtio_device *vdev) {
+    if(vdev->modern)
+        return common_read8(vdev, VIRTIO_COMMON_STATUS);
+    return port_byte_in(vdev->io + VIRTIO_LEGACY_STATUS);
+}
+
+static void set_status(struct virtio_device *vdev, uint8_t status) {
+    if(vdev->modern)
+        common_write8(vdev, VIRTIO_COMMON_STATUS, status);
+    else
+        port_byte_out(vdev->io + VIRTIO_LEGACY_STATUS, status);
+}
+
+// picks up the structures a modern device describes in its vendor capabilities
+static void find_structures(struct virtio_device *vdev) {
+    struct pci_device *pci = vdev->pci;
+    int cap = 0;
+
+    while((cap = pci_find_capability(pci, PCI_CAP_VENDOR, cap)) != 0) {
+        int type = pci_read8(pci, cap + VIRTIO_CAP_TYPE);
+        int bar = pci_read8(pci, cap + VIRTIO_CAP_BAR);
+        volatile uint8_t *address;
+
+        if(bar > 5 || pci->bar_is_io[bar] || pci->bar_size[bar] == 0)
+            continue;
+        address = (volatile uint8_t*)(pci->bar[bar] + pci_read32(pci, cap + VIRTIO_CAP_OFFSET));
+        if(type == VIRTIO_PCI_CAP_COMMON_CFG && vdev->common == 0) {
+            vdev->common = address;
+        } else if(type == VIRTIO_PCI_CAP_NOTIFY_CFG && vdev->notify_base == 0) {
+            vdev->notify_base = address;
+            vdev->notify_multiplier = pci_read32(pci, cap + VIRTIO_CAP_NOTIFY_MULTIPLIER);
+        } else if(type == VIRTIO_PCI_CAP_ISR_CFG && vdev->isr == 0) {
+            vdev->isr = address;
+        } else if(type == VIRTIO_PCI_CAP_DEVICE_CFG && vdev->device_config == 0) {
+            vdev->device_config = address;
+        }
+    }
+}
+
+/* Resets the device and announces a driver. Transitional devices offer
+*  both transports, the modern one is preferred. Returns -1 if pci is not
+*  a device this code can drive */
+int virtio_init(struct virtio_device *vdev, struct pci_device *pci) {
+    vdev->pci = pci;
+    vdev->modern = 0;
+    vdev->common = vdev->isr = vdev->device_config = vdev->notify_base = 0;
+    vdev->vector = -1;
+
+    if(pci_enable(pci) < 0)
+        return -1;
+    find_structures(vdev);
+    if(vdev->common && vdev->notify_base && vdev->isr) {
+        vdev->modern = 1;
+    } else if(pci->bar_is_io[0]) {
+        vdev->io = pci->bar[0];
+        vdev->config_offset = VIRTIO_LEGACY_CONFIG;
+    } else {
+        return -1;
+    }
+
+    set_status(vdev, 0);
+    // a modern device may take a moment to finish the reset
+    while(vdev->modern && get_status(vdev) != 0)
+        __asm__ __volatile__("pause");
+    set_status(vdev, VIRTIO_STATUS_ACKNOWLEDGE);
+    set_status(vdev, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    return 0;
+}
+
+/* *features holds the wanted feature bits 0 to 31 and comes back with
+*  the ones the device offers too. Modern devices also get VERSION_1.
+*  Returns -1 if the device does not accept the result */
+int virtio_negotiate(struct virtio_device *vdev, uint32_t *features) {
+    if(!vdev->modern) {
+        *features &= port_dword_in(vdev->io + VIRTIO_LEGACY_FEATURES);
+        port_dword_out(vdev->io + VIRTIO_LEGACY_GUEST_FEATURES, *features);
+        return 0;
+    }
+
+    common_write32(vdev, VIRTIO_COMMON_DEVICE_FEATURE_SELECT, 0);
+    *features &= common_read32(vdev, VIRTIO_COMMON_DEVICE_FEATURE);
+    common_write32(vdev, VIRTIO_COMMON_DEVICE_FEATURE_SELECT, 1);
+    if(!(common_read32(vdev, VIRTIO_COMMON_DEVICE_FEATURE) & VIRTIO_F_VERSION_1))
+        return -1;
+    common_write32(vdev, VIRTIO_COMMON_DRIVER_FEATURE_SELECT, 0);
+    common_write32(vdev, VIRTIO_COMMON_DRIVER_FEATURE, *features);
+    common_write32(vdev, VIRTIO_COMMON_DRIVER_FEATURE_SELECT, 1);
+    common_write32(vdev, VIRTIO_COMMON_DRIVER_FEATURE, VIRTIO_F_VERSION_1);
+
+    set_status(vdev, get_status(vdev) | VIRTIO_STATUS_FEATURES_OK);
+    if(!(get_status(vdev) & VIRTIO_STATUS_FEATURES_OK))
+        return -1;
+    return 0;
+}
+
+/* Routes every queue to one MSI-X vector. Call it before setting up the
+*  queues. Returns -1 if the device has to stay on its INTx line */
+int virtio_enable_msix(struct virtio_device *vdev, void (*handler)(struct regs *r)) {
+    int vector = pci_enable_msix(vdev->pci, 0, handler);
+
+    if(vector < 0)
+        return -1;
+    vdev->vector = vector;
+    // no interrupt for configuration changes, nothing here would act on one
+    if(vdev->modern) {
+        common_write16(vdev, VIRTIO_COMMON_MSIX_CONFIG, VIRTIO_NO_VECTOR);
+    } else {
+        vdev->config_offset = VIRTIO_LEGACY_CONFIG_MSIX;
+        port_word_out(vdev->io + VIRTIO_LEGACY_CONFIG_VECTOR, VIRTIO_NO_VECTOR);
+    }
+    return 0;
+}
+
+/* Split ring layout: descriptors, then the available ring, then the used
+*  ring on the next page. Legacy devices insist on exactly this, modern
+*  ones take the three addresses separately but are happy with it too */
+static uint32_t used_offset(uint16_t size) {
+    return PAGE_ALIGN_UP(size * sizeof(struct virtq_desc) + 6 + size * 2);
+}
+
+static uint32_t ring_pages(uint16_t size) {
+    return PAGE_ALIGN_UP(used_offset(size) + 6 + size * sizeof(struct virtq_used_elem)) / PAGE_SIZE;
+}
+
+// selects queue index and lays out its rings, returns -1 if it can't
+int virtio_queue_init(struct virtio_device *vdev, struct virtq *q, int index) {
+    uint32_t size, pages, rings;
+
+    if(vdev->modern) {
+        common_write16(vdev, VIRTIO_COMMON_QUEUE_SELECT, index);
+        size = common_read16(vdev, VIRTIO_COMMON_QUEUE_SIZE);
+        // modern devices let the driver pick a smaller queue
+        if(size > VIRTQ_MAX_SIZE) {
+            size = VIRTQ_MAX_SIZE;
+            common_write16(vdev, VIRTIO_COMMON_QUEUE_SIZE, size);
+        }
+    } else {
+        port_word_out(vdev->io + VIRTIO_LEGACY_QUEUE_SELECT, index);
+        size = port_word_in(vdev->io + VIRTIO_LEGACY_QUEUE_SIZE);
+    }
+    if(size == 0 || size > VIRTQ_MAX_SIZE)
+        return -1;
+
+    pages = ring_pages(size);
+    rings = frame_alloc_contiguous(pages);
+    if(rings == 0)
+        return -1;
+    for(uint32_t *p = (uint32_t*)rings; p < (uint32_t*)(rings + pages * PAGE_SIZE); p++)
+        *p = 0;
+
+    q->index = index;
+    q->size = size;
+    q->desc = (struct virtq_desc*)rings;
+    q->avail = (struct virtq_avail*)(rings + size * sizeof(struct virtq_desc));
+    q->used = (struct virtq_used*)(rings + used_offset(size));
+    q->free_head = 0;
+    q->free_count = size;
+    q->last_used = 0;
+    q->added = 0;
+    for(uint32_t i = 0; i < size; i++) {
+        q->desc[i].next = i + 1;
+        q->cookies[i] = 0;
+    }
+
+    if(vdev->modern) {
+        common_write64(vdev, VIRTIO_COMMON_QUEUE_DESC, (uint32_t)q->desc);
+        common_write64(vdev, VIRTIO_COMMON_QUEUE_AVAIL, (uint32_t)q->avail);
+        common_write64(vdev, VIRTIO_COMMON_QUEUE_USED, (uint32_t)q->used);
+        if(vdev->vector >= 0) {
+            common_write16(vdev, VIRTIO_COMMON_QUEUE_MSIX_VECTOR, 0);
+            if(common_read16(vdev, VIRTIO_COMMON_QUEUE_MSIX_VECTOR) != 0) {
+                frame_free_contiguous(rings, pages);
+                return -1;
+            }
+        }
+        q->notify = (volatile uint16_t*)(vdev->notify_base
+                  + common_read16(vdev, VIRTIO_COMMON_QUEUE_NOTIFY_OFF) * vdev->notify_multiplier);
+        common_write16(vdev, VIRTIO_COMMON_QUEUE_ENABLE, 1);
+    } else {
+        if(vdev->vector >= 0) {
+            port_word_out(vdev->io + VIRTIO_LEGACY_QUEUE_VECTOR, 0);
+            if(port_word_in(vdev->io + VIRTIO_LEGACY_QUEUE_VECTOR) != 0) {
+                frame_free_contiguous(rings, pages);
+                return -1;
+            }
+        }
+        port_dword_out(vdev->io + VIRTIO_LEGACY_QUEUE_PFN, rings >> PAGE_SHIFT);
+        q->notify = 0;
+    }
+    return 0;
+}
+
+void virtio_driver_ok(struct virtio_device *vdev) {
+    set_status(vdev, get_status(vdev) | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(struct virtio_device *vdev) {
+    set_status(vdev, get_status(vdev) | VIRTIO_STATUS_FAILED);
+}
+
+// offset is into the device specific configuration
+uint8_t virtio_config8(struct virtio_device *vdev, int offset) {
+    if(vdev->modern)
+        return vdev->device_config[offset];
+    return port_byte_in(vdev->io + vdev->config_offset + offset);
+}
+
+uint32_t virtio_config32(struct virtio_device *vdev, int offset) {
+    if(vdev->modern)
+        return *(volatile uint32_t*)(vdev->device_config + offset);
+    return port_dword_in(vdev->io + vdev->config_offset + offset);
+}
+
+// reading the ISR status also lowers the INTx line
+uint8_t virtio_isr(struct virtio_device *vdev) {
+    if(vdev->modern)
+        return *vdev->isr;
+    return port_byte_in(vdev->io + VIRTIO_LEGACY_ISR);
+}
+
+/* Chains count buffers into one request and makes it available. The
+*  device hears about it at the next virtq_kick, so a batch of requests
+*  costs a single notification. Returns -1 if the ring is too full */
+int virtq_add(struct virtq *q, struct virtq_buffer *buffers, int count, void *cookie) {
+    uint16_t head = q->free_head;
+    uint16_t i = head;
+
+    if(count <= 0 || count > q->free_count)
+        return -1;
+    for(int n = 0; n < count; n++) {
+        volatile struct virtq_desc *desc = &q->desc[i];
+        desc->addr = (uint32_t)buffers[n].addr;
+        desc->length = buffers[n].length;
+        desc->flags = (buffers[n].device_writes ? VIRTQ_DESC_F_WRITE : 0)
+                    | (n + 1 < count ? VIRTQ_DESC_F_NEXT : 0);
+        // next already points along the free list, the chain keeps that order
+        i = desc->next;
+    }
+    q->free_head = i;
+    q->free_count -= count;
+    q->cookies[head] = cookie;
+
+    q->avail->ring[q->avail->index & (q->size - 1)] = head;
+    compiler_barrier();
+    q->avail->index++;
+    q->added++;
+    return 0;
+}
+
+// notifies the device unless nothing was added or it asked not to be
+void virtq_kick(struct virtio_device *vdev, struct virtq *q) {
+    if(q->added == 0)
+        return;
+    q->added = 0;
+    // the new avail index must be visible before the flags are read
+    __sync_synchronize();
+    if(q->used->flags & VIRTQ_USED_F_NO_NOTIFY)
+        return;
+    if(vdev->modern)
+        *q->notify = q->index;
+    else
+        port_word_out(vdev->io + VIRTIO_LEGACY_QUEUE_NOTIFY, q->index);
+}
+
+/* The cookie of the next request the device has finished, or 0. length
+*  gets how many bytes the device wrote. The descriptors are free again */
+void *virtq_get_used(struct virtq *q, uint32_t *length) {
+    volatile struct virtq_used_elem *elem;
+    uint16_t head, i;
+    uint16_t count = 1;
+    void *cookie;
+
+    if(q->last_used == q->used->index)
+        return 0;
+    compiler_barrier();
+    elem = &q->used->ring[q->last_used & (q->size - 1)];
+    head = elem->id;
+    if(length)
+        *length = elem->length;
+    q->last_used++;
+
+    for(i = head; q->desc[i].flags & VIRTQ_DESC_F_NEXT; i = q->desc[i].next)
+        count++;
+    q->desc[i].next = q->free_head;
+    q->free_head = head;
+    q->free_count += count;
+
+    cookie = q->cookies[head];
+    q->cookies[head] = 0;
+    return cookie;
+}
+
+/* Asks the device not to interrupt when it uses buffers of q, for a
+*  driver that polls the queue anyway. Only a hint, the device may still */
+void virtq_disable_interrupts(struct virtq *q) {
+    q->avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+}
+
+/* Turns interrupts for q back on. Returns 1 if the device used buffers
+*  the caller hasn't handled yet, they may have come in before the flag
+*  got through and will raise no interrupt of their own */
+int virtq_enable_interrupts(struct virtq *q) {
+    q->avail->flags = 0;
+    __sync_synchronize();
+    return q->last_used != q->used->index;
+}
@@ -0,0 +1,147 @@
+#ifndef _VIRTIO_H_
+#define _VIRTIO_H_
+
+#include "../include/types.h"
+
+struct pci_device;
+struct regs;
+
+#define VIRTIO_VENDOR               0x1AF4
+
+// device status
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FEATURES_OK   0x08
+#define VIRTIO_STATUS_FAILED        0x80
+
+// bit 32, the first bit of the second feature word
+#define VIRTIO_F_VERSION_1          0x00000001
+
+#define VIRTIO_ISR_QUEUE            0x01
+#define VIRTIO_NO_VECTOR            0xFFFF
+
+// legacy devices: registers in I/O BAR 0
+#define VIRTIO_LEGACY_FEATURES      0x00
+#define VIRTIO_LEGACY_GUEST_FEATURES 0x04
+#define VIRTIO_LEGACY_QUEUE_PFN     0x08
+#define VIRTIO_LEGACY_QUEUE_SIZE    0x0C
+#define VIRTIO_LEGACY_QUEUE_SELECT  0x0E
+#define VIRTIO_LEGACY_QUEUE_NOTIFY  0x10
+#define VIRTIO_LEGACY_STATUS        0x12
+#define VIRTIO_LEGACY_ISR           0x13
+#define VIRTIO_LEGACY_CONFIG_VECTOR 0x14    // only while MSI-X is on
+#define VIRTIO_LEGACY_QUEUE_VECTOR  0x16
+#define VIRTIO_LEGACY_CONFIG        0x14    // device config, 0x18 while MSI-X is on
+#define VIRTIO_LEGACY_CONFIG_MSIX   0x18
+
+// modern devices: vendor capabilities point at these structures in the BARs
+#define VIRTIO_PCI_CAP_COMMON_CFG   1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG   2
+#define VIRTIO_PCI_CAP_ISR_CFG      3
+#define VIRTIO_PCI_CAP_DEVICE_CFG   4
+
+// offsets in the capability
+#define VIRTIO_CAP_TYPE             3
+#define VIRTIO_CAP_BAR              4
+#define VIRTIO_CAP_OFFSET           8
+#define VIRTIO_CAP_NOTIFY_MULTIPLIER 16
+
+// common configuration structure
+#define VIRTIO_COMMON_DEVICE_FEATURE_SELECT 0x00
+#define VIRTIO_COMMON_DEVICE_FEATURE        0x04
+#define VIRTIO_COMMON_DRIVER_FEATURE_SELECT 0x08
+#define VIRTIO_COMMON_DRIVER_FEATURE        0x0C
+#define VIRTIO_COMMON_MSIX_CONFIG           0x10
+#define VIRTIO_COMMON_STATUS                0x14
+#define VIRTIO_COMMON_QUEUE_SELECT          0x16
+#define VIRTIO_COMMON_QUEUE_SIZE            0x18
+#define VIRTIO_COMMON_QUEUE_MSIX_VECTOR     0x1A
+#define VIRTIO_COMMON_QUEUE_ENABLE          0x1C
+#define VIRTIO_COMMON_QUEUE_NOTIFY_OFF      0x1E
+#define VIRTIO_COMMON_QUEUE_DESC            0x20
+#define VIRTIO_COMMON_QUEUE_AVAIL           0x28
+#define VIRTIO_COMMON_QUEUE_USED            0x30
+
+// split virtqueues
+#define VIRTQ_MAX_SIZE              256
+#define VIRTQ_DESC_F_NEXT           0x1
+#define VIRTQ_DESC_F_WRITE          0x2     // the device writes this buffer
+#define VIRTQ_AVAIL_F_NO_INTERRUPT  0x1
+#define VIRTQ_USED_F_NO_NOTIFY      0x1
+
+struct virtq_desc {
+    uint64_t addr;
+    uint32_t length;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed));
+
+struct virtq_avail {
+    uint16_t flags;
+    uint16_t index;
+    uint16_t ring[];
+} __attribute__((packed));
+
+struct virtq_used_elem {
+    uint32_t id;
+    uint32_t length;
+} __attribute__((packed));
+
+struct virtq_used {
+    uint16_t flags;
+    uint16_t index;
+    struct virtq_used_elem ring[];
+} __attribute__((packed));
+
+// one piece of a request for virtq_add
+typedef struct virtq_buffer {
+    void *addr;
+    uint32_t length;
+    int device_writes;
+} virtq_buffer;
+
+typedef struct virtq {
+    int index;
+    uint16_t size;
+    volatile struct virtq_desc *desc;
+    volatile struct virtq_avail *avail;
+    volatile struct virtq_used *used;
+    uint16_t free_head;         // chain of unused descriptors
+    uint16_t free_count;
+    uint16_t last_used;         // used ring entries up to here are handled
+    uint16_t added;             // made available since the last notification
+    volatile uint16_t *notify;  // modern devices: where to write the queue index
+    void *cookies[VIRTQ_MAX_SIZE];  // what the caller passed for each chain head
+} virtq;
+
+typedef struct virtio_device {
+    struct pci_device *pci;
+    int modern;
+    uint16_t io;                // legacy: I/O BAR 0
+    uint16_t config_offset;     // legacy: device config, it moves when MSI-X is on
+    volatile uint8_t *common;   // modern: the structures the capabilities point at
+    volatile uint8_t *isr;
+    volatile uint8_t *device_config;
+    volatile uint8_t *notify_base;
+    uint32_t notify_multiplier;
+    int vector;                 // MSI-X vector, -1 while the device raises INTx
+} virtio_device;
+
+int virtio_init(struct virtio_device *vdev, struct pci_device *pci);
+int virtio_negotiate(struct virtio_device *vdev, uint32_t *features);
+int virtio_enable_msix(struct virtio_device *vdev, void (*handler)(struct regs *r));
+int virtio_queue_init(struct virtio_device *vdev, struct virtq *q, int index);
+void virtio_driver_ok(struct virtio_device *vdev);
+void virtio_fail(struct virtio_device *vdev);
+uint8_t virtio_config8(struct virtio_device *vdev, int offset);
+uint32_t virtio_config32(struct virtio_device *vdev, int offset);
+uint8_t virtio_isr(struct virtio_device *vdev);
+
+int virtq_add(struct virtq *q, struct virtq_buffer *buffers, int count, void *cookie);
+void virtq_kick(struct virtio_device *vdev, struct virtq *q);
+void *virtq_get_used(struct virtq *q, uint32_t *length);
+void virtq_disable_interrupts(struct virtq *q);
+int virtq_enable_interrupts(struct virtq *q);
+
+#endif
@@ -0,0 +1,197 @@
+#include "virtio_blk.h"
+#include "virtio.h"
+#include "block.h"
+#include "../include/system.h"
+#include "../kernel/pci.h"
+#include "../kernel/spinlock.h"
+#include "../kernel/trace.h"
+
+/* virtio block device, registered as "vda". Every request is a chain of
+*  descriptors: the header, the data and a status byte, so a queue of 256
+*  descriptors keeps up to 85 requests in flight. Requests that don't fit
+*  wait in a backlog and go out as soon as completions free descriptors.
+*  Completions arrive by MSI-X, or INTx on machines without a local APIC,
+*  and one interrupt reaps everything the device has finished. */
+#define MAX_IN_FLIGHT   (VIRTQ_MAX_SIZE / 3)
+
+// the parts of a request the device reads and writes besides the data
+struct blk_slot {
+    struct virtio_blk_header header;
+    volatile uint8_t status;
+    struct block_request *req;
+    struct blk_slot *next;
+};
+
+static struct virtio_device vdev;
+static struct virtq queue;
+static struct block_device disk;
+static int has_flush;
+
+static struct blk_slot slots[MAX_IN_FLIGHT];
+static struct blk_slot *free_slots;
+static struct block_request *backlog_head, *backlog_tail;
+static int completing;
+static struct spinlock lock = SPINLOCK_INIT;
+
+// hands req to the device, -1 if there is no room for it yet. lock held
+static int start_request(struct block_request *req) {
+    struct blk_slot *slot = free_slots;
+    struct virtq_buffer buffers[BLOCK_MAX_SEGMENTS + 2];
+    int count = 0;
+    int needed = 2 + (req->op == BLOCK_FLUSH ? 0 : req->segment_count ? req->segment_count : 1);
+
+    if(slot == 0 || queue.free_count < needed)
+        return -1;
+    free_slots = slot->next;
+
+    slot->req = req;
+    slot->status = 0xFF;
+    slot->header.type = req->op == BLOCK_WRITE ? VIRTIO_BLK_T_OUT
+                      : req->op == BLOCK_FLUSH ? VIRTIO_BLK_T_FLUSH : VIRTIO_BLK_T_IN;
+    slot->header.reserved = 0;
+    slot->header.sector = req->op == BLOCK_FLUSH ? 0 : req->sector;
+
+    buffers[count].addr = &slot->header;
+    buffers[count].length = sizeof(struct virtio_blk_header);
+    buffers[count++].device_writes = 0;
+    if(req->op != BLOCK_FLUSH && req->segment_count == 0) {
+        buffers[count].addr = req->buffer;
+        buffers[count].length = req->count << SECTOR_SHIFT;
+        buffers[count++].device_writes = req->op == BLOCK_READ;
+    }
+    for(int i = 0; req->op != BLOCK_FLUSH && i < req->segment_count; i++) {
+        buffers[count].addr = req->segments[i].addr;
+        buffers[count].length = req->segments[i].length;
+        buffers[count++].device_writes = req->op == BLOCK_READ;
+    }
+    buffers[count].addr = (void*)&slot->status;
+    buffers[count].length = 1;
+    buffers[count++].device_writes = 1;
+
+    virtq_add(&queue, buffers, count, slot);
+    trace(TRACE_BLOCK_SUBMIT, slot->header.sector);
+    return 0;
+}
+
+static int virtio_blk_submit(struct block_device *dev, struct block_request *req) {
+    unsigned int flags;
+
+    if(req->op != BLOCK_FLUSH && (req->count == 0 || req->sector >= dev->sectors
+                                  || req->count > dev->sectors - req->sector
+                                  || req->segment_count > BLOCK_MAX_SEGMENTS))
+        return -1;
+    req->status = BLOCK_PENDING;
+    // without the flush feature the device writes through, nothing to wait for
+    if(req->op == BLOCK_FLUSH && !has_flush) {
+        req->status = BLOCK_OK;
+        req->done(req);
+        return 0;
+    }
+
+    flags = spin_lock_irqsave(&lock);
+    req->next = 0;
+    // behind the backlog, or requests would overtake each other
+    if(backlog_head || start_request(req) < 0) {
+        if(backlog_tail)
+            backlog_tail->next = req;
+        else
+            backlog_head = req;
+        backlog_tail = req;
+    }
+    spin_unlock_irqrestore(&lock, flags);
+    return 0;
+}
+
+// callbacks resubmitting from inside a completion share its single kick
+static void virtio_blk_kick(struct block_device *dev) {
+    unsigned int flags = spin_lock_irqsave(&lock);
+    if(!completing)
+        virtq_kick(&vdev, &queue);
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+static void virtio_blk_complete() {
+    struct block_request *done_head = 0, *done_tail = 0, *req;
+    struct blk_slot *slot;
+    unsigned int flags = spin_lock_irqsave(&lock);
+
+    while((slot = virtq_get_used(&queue, 0)) != 0) {
+        req = slot->req;
+        req->status = slot->status == VIRTIO_BLK_S_OK ? BLOCK_OK : BLOCK_ERROR;
+        trace(TRACE_BLOCK_DONE, slot->header.sector);
+        req->next = 0;
+        if(done_tail)
+            done_tail->next = req;
+        else
+            done_head = req;
+        done_tail = req;
+        slot->next = free_slots;
+        free_slots = slot;
+    }
+    while(backlog_head && start_request(backlog_head) == 0) {
+        backlog_head = backlog_head->next;
+        if(backlog_head == 0)
+            backlog_tail = 0;
+    }
+    completing = 1;
+    spin_unlock_irqrestore(&lock, flags);
+
+    // without the lock, a callback may submit the next request
+    while(done_head) {
+        req = done_head;
+        done_head = req->next;
+        req->done(req);
+    }
+
+    flags = spin_lock_irqsave(&lock);
+    completing = 0;
+    virtq_kick(&vdev, &queue);
+    spin_unlock_irqrestore(&lock, flags);
+}
+
+static void virtio_blk_irq(struct regs *r) {
+    // the INTx line may be shared, reading the ISR tells and acknowledges
+    if(vdev.vector < 0 && !(virtio_isr(&vdev) & VIRTIO_ISR_QUEUE))
+        return;
+    virtio_blk_complete();
+}
+
+void virtio_blk_init() {
+    struct pci_device *pci = pci_find_device(VIRTIO_VENDOR, VIRTIO_BLK_MODERN_ID, 0);
+    uint32_t features = VIRTIO_BLK_F_FLUSH;
+
+    if(pci == 0)
+        pci = pci_find_device(VIRTIO_VENDOR, VIRTIO_BLK_LEGACY_ID, 0);
+    if(pci == 0 || virtio_init(&vdev, pci) < 0)
+        return;
+    if(virtio_negotiate(&vdev, &features) < 0) {
+        virtio_fail(&vdev);
+        return;
+    }
+    has_flush = (features & VIRTIO_BLK_F_FLUSH) != 0;
+
+    if(virtio_enable_msix(&vdev, virtio_blk_irq) < 0)
+        irq_install_handler(pci->irq_line, virtio_blk_irq);
+    if(virtio_queue_init(&vdev, &queue, 0) < 0) {
+        virtio_fail(&vdev);
+        return;
+    }
+    for(int i = 0; i < MAX_IN_FLIGHT; i++) {
+        slots[i].next = free_slots;
+        free_slots = &slots[i];
+    }
+
+    // a disk past 2 TB is used up to there, sector numbers are 32 bit
+    disk.sectors = virtio_config32(&vdev, VIRTIO_BLK_CAPACITY + 4) ? 0xFFFFFFFF
+                 : virtio_config32(&vdev, VIRTIO_BLK_CAPACITY);
+    disk.name[0] = 'v';
+    disk.name[1] = 'd';
+    disk.name[2] = 'a';
+    disk.name[3] = 0;
+    disk.submit = virtio_blk_submit;
+    disk.kick = virtio_blk_kick;
+    disk.driver = &vdev;
+
+    virtio_driver_ok(&vdev);
+    block_register(&disk);
+}
@@ -0,0 +1,30 @@
+#ifndef _VIRTIO_BLK_H_
+#define _VIRTIO_BLK_H_
+
+#include "../include/types.h"
+
+#define VIRTIO_BLK_LEGACY_ID    0x1001      // transitional device
+#define VIRTIO_BLK_MODERN_ID    0x1042
+
+// feature bits
+#define VIRTIO_BLK_F_FLUSH      (1 << 9)
+
+// device configuration
+#define VIRTIO_BLK_CAPACITY     0x00        // 64 bit, in 512 byte sectors
+
+// request types
+#define VIRTIO_BLK_T_IN         0
+#define VIRTIO_BLK_T_OUT        1
+#define VIRTIO_BLK_T_FLUSH      4
+
+#define VIRTIO_BLK_S_OK         0
+
+struct virtio_blk_header {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed));
+
+void virtio_blk_init();
+
+#endif
@@ -0,0 +1,183 @@
+#include "virtio_net.h"
+#include "virtio.h"
+#include "../include/system.h"
+#include "../kernel/pci.h"
+#include "../kernel/spinlock.h"
+#include "../net/net.h"
+
+/* virtio network device, registered as "eth0". Receive buffers are
+*  posted ahead of time, one packet buffer per descriptor, the
+*  virtio_net_header first and the frame behind it, so a received packet
+*  goes up the stack in the buffer it arrived in. The interrupt only
+*  wakes the net thread and turns further receive interrupts off until
+*  the thread has emptied the ring. Sent buffers are collected on the
+*  next send or poll, the send queue raises no interrupts at all. */
+
+static struct virtio_device vdev;
+static struct virtq rx, tx;
+static struct net_device netdev;
+static uint32_t header_length;
+static int rx_posted;
+static struct spinlock lock = SPINLOCK_INIT;
+
+// without the MAC feature the address is up to us, this is QEMU's default
+static const uint8_t default_mac[ETH_ALEN] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+
+// tops the receive ring up from the pool. lock held
+static void rx_refill() {
+    struct virtq_buffer buffer;
+    struct netbuf *b;
+
+    while(rx_posted < NET_RX_BUFFERS && rx.free_count > 0 && (b = netbuf_alloc()) != 0) {
+        buffer.addr = b->head;
+        buffer.length = NETBUF_SIZE;
+        buffer.device_writes = 1;
+        virtq_add(&rx, &buffer, 1, b);
+        rx_posted++;
+    }
+    netdev.rx_short = rx_posted < NET_RX_BUFFERS && rx.free_count > 0;
+    virtq_kick(&vdev, &rx);
+}
+
+// packets the device finished sending go back to the pool. lock held
+static void tx_reap() {
+    struct netbuf *b;
+
+    while((b = virtq_get_used(&tx, 0)) != 0)
+        netbuf_free(b);
+}
+
+static int virtio_net_transmit(struct net_device *dev, struct netbuf *b) {
+    struct virtio_net_header *header;
+    struct virtq_buffer buffer;
+    unsigned int flags = spin_lock_irqsave(&lock);
+
+    tx_reap();
+    if(tx.free_count == 0) {
+        spin_unlock_irqrestore(&lock, flags);
+        return -1;
+    }
+    header = (struct virtio_net_header*)netbuf_push(b, header_length);
+    header->flags = 0;
+    header->gso_type = 0;
+    header->header_length = 0;
+    header->gso_size = 0;
+    header->checksum_start = 0;
+    header->checksum_offset = 0;
+    if(header_length == sizeof(struct virtio_net_header))
+        header->buffer_count = 0;
+    if(b->checksum_start) {
+        header->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        header->checksum_start = b->checksum_start - (b->data + header_length);
+        header->checksum_offset = b->checksum_offset;
+    }
+    buffer.addr = b->data;
+    buffer.length = b->length;
+    buffer.device_writes = 0;
+    virtq_add(&tx, &buffer, 1, b);
+    virtq_kick(&vdev, &tx);
+    spin_unlock_irqrestore(&lock, flags);
+    return 0;
+}
+
+/* From the net thread: takes every packet out of the receive ring, puts
+*  fresh buffers in their place and hands the packets up without the
+*  lock. Goes round again if more came in while interrupts were off */
+static void virtio_net_poll(struct net_device *dev) {
+    struct netbuf *head, *tail, *b;
+    struct virtio_net_header *header;
+    uint32_t length;
+    unsigned int flags;
+    int more;
+
+    do {
+        head = tail = 0;
+        flags = spin_lock_irqsave(&lock);
+        tx_reap();
+        while((b = virtq_get_used(&rx, &length)) != 0) {
+            rx_posted--;
+            if(length < header_length) {
+                dev->rx_dropped++;
+                netbuf_free(b);
+                continue;
+            }
+            header = (struct virtio_net_header*)b->head;
+            b->data = b->head + header_length;
+            b->length = length - header_length;
+            b->checksum_ok = (header->flags & (VIRTIO_NET_HDR_F_DATA_VALID | VIRTIO_NET_HDR_F_NEEDS_CSUM)) != 0;
+            b->next = 0;
+            if(tail)
+                tail->next = b;
+            else
+                head = b;
+            tail = b;
+        }
+        rx_refill();
+        more = virtq_enable_interrupts(&rx);
+        if(more)
+            virtq_disable_interrupts(&rx);
+        spin_unlock_irqrestore(&lock, flags);
+
+        while(head) {
+            b = head;
+            head = b->next;
+            net_receive(dev, b);
+        }
+    } while(more);
+}
+
+static void virtio_net_irq(struct regs *r) {
+    // the INTx line may be shared, reading the ISR tells and acknowledges
+    if(vdev.vector < 0 && !(virtio_isr(&vdev) & VIRTIO_ISR_QUEUE))
+        return;
+    virtq_disable_interrupts(&rx);
+    net_wake();
+}
+
+void virtio_net_init() {
+    struct pci_device *pci = pci_find_device(VIRTIO_VENDOR, VIRTIO_NET_MODERN_ID, 0);
+    uint32_t features = VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_MAC;
+    unsigned int flags;
+
+    if(pci == 0)
+        pci = pci_find_device(VIRTIO_VENDOR, VIRTIO_NET_LEGACY_ID, 0);
+    if(pci == 0 || virtio_init(&vdev, pci) < 0)
+        return;
+    if(virtio_negotiate(&vdev, &features) < 0) {
+        virtio_fail(&vdev);
+        return;
+    }
+    // VERSION_1 devices always send buffer_count, legacy ones only with MRG_RXBUF
+    header_length = vdev.modern ? sizeof(struct virtio_net_header) : VIRTIO_NET_LEGACY_HEADER;
+
+    if(virtio_enable_msix(&vdev, virtio_net_irq) < 0)
+        irq_install_handler(pci->irq_line, virtio_net_irq);
+    if(virtio_queue_init(&vdev, &rx, VIRTIO_NET_RX_QUEUE) < 0
+       || virtio_queue_init(&vdev, &tx, VIRTIO_NET_TX_QUEUE) < 0) {
+        virtio_fail(&vdev);
+        return;
+    }
+    virtq_disable_interrupts(&tx);
+
+    for(int i = 0; i < ETH_ALEN; i++)
+        netdev.mac[i] = (features & VIRTIO_NET_F_MAC) ? virtio_config8(&vdev, VIRTIO_NET_CONFIG_MAC + i)
+                      : default_mac[i];
+    netdev.name[0] = 'e';
+    netdev.name[1] = 't';
+    netdev.name[2] = 'h';
+    netdev.name[3] = '0';
+    netdev.name[4] = 0;
+    netdev.checksum_offload = (features & VIRTIO_NET_F_CSUM) != 0;
+    netdev.transmit = virtio_net_transmit;
+    netdev.poll = virtio_net_poll;
+    netdev.driver = &vdev;
+    if(net_register(&netdev) < 0) {
+        virtio_fail(&vdev);
+        return;
+    }
+
+    virtio_driver_ok(&vdev);
+    flags = spin_lock_irqsave(&lock);
+    rx_refill();
+    spin_unlock_irqrestore(&lock, flags);
+}
@@ -0,0 +1,38 @@
+#ifndef _VIRTIO_NET_H_
+#define _VIRTIO_NET_H_
+
+#include "../include/types.h"
+
+#define VIRTIO_NET_LEGACY_ID    0x1000      // transitional device
+#define VIRTIO_NET_MODERN_ID    0x1041
+
+// feature bits
+#define VIRTIO_NET_F_CSUM       (1 << 0)    // the device completes checksums we leave partial
+#define VIRTIO_NET_F_GUEST_CSUM (1 << 1)    // it tells us which received checksums it checked
+#define VIRTIO_NET_F_MAC        (1 << 5)
+
+// device configuration
+#define VIRTIO_NET_CONFIG_MAC   0x00
+
+#define VIRTIO_NET_RX_QUEUE     0
+#define VIRTIO_NET_TX_QUEUE     1
+
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 0x01
+#define VIRTIO_NET_HDR_F_DATA_VALID 0x02
+
+// in front of every packet either way, legacy devices leave out buffer_count
+struct virtio_net_header {
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t header_length;
+    uint16_t gso_size;
+    uint16_t checksum_start;
+    uint16_t checksum_offset;
+    uint16_t buffer_count;
+} __attribute__((packed));
+
+#define VIRTIO_NET_LEGACY_HEADER    10
+
+void virtio_net_init();
+
+#endif
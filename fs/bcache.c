@@ -0,0 +1,531 @@
+#include "bcache.h"
+#include "../kernel/sched.h"
+#include "../kernel/memory.h"
+#include "../kernel/low_level.h"
+#include "../kernel/trace.h"
+#include "../drivers/screen.h"
+#include "../tools/utils.h"
+#include "../include/conversion.h"
+
+/* Block cache between the block drivers and the file systems. The disk
+*  is cached in 4 KB blocks, found through a hash of device and block
+*  number. Eviction is CLOCK: a hand sweeps the buffers and takes the
+*  first clean, unused one that hasn't been referenced since its last
+*  pass. Writes only mark buffers dirty. bcache_sync writes every run of
+*  consecutive dirty blocks with a single request and kicks the device
+*  once, the flusher thread does that every few seconds.
+*  Each device also has a read-ahead stream. While a reader keeps asking
+*  for the next block the window doubles up to READAHEAD_MAX blocks, and
+*  reaching the first block of a window starts reading the next one, so
+*  the disk stays a window ahead of the reader. Any other access resets
+*  the window.
+*  Threads only run on the BSP and the completions arrive there too, so
+*  turning interrupts off is all the locking this needs. */
+static struct buffer buffers[BCACHE_BLOCKS];
+static struct buffer *hash_table[1 << BCACHE_HASH_BITS];
+static int clock_hand;
+
+// one read or write of a run of consecutive blocks
+struct bcache_io {
+    struct block_request req;
+    struct buffer *blocks[BLOCK_MAX_SEGMENTS];
+    int count;
+    int used;
+};
+static struct bcache_io ios[BCACHE_MAX_IO];
+static int ios_in_flight;
+static struct wait_queue io_waiters;
+
+struct readahead {
+    struct block_device *dev;
+    uint32_t last;              // the block asked for last
+    uint32_t next;              // the first block not read ahead yet
+    int window;                 // 0 while the reader is not sequential
+};
+static struct readahead streams[MAX_BLOCK_DEVICES];
+static int readahead_enabled = 1;
+
+static uint32_t requests_issued;    // for the benchmark
+
+static inline uint32_t hash(struct block_device *dev, uint32_t block) {
+    return ((block ^ ((uint32_t)dev >> 6)) * 2654435761u) >> (32 - BCACHE_HASH_BITS);
+}
+
+static struct buffer *lookup(struct block_device *dev, uint32_t block) {
+    struct buffer *b;
+    for(b = hash_table[hash(dev, block)]; b; b = b->hash_next)
+        if(b->dev == dev && b->block == block)
+            return b;
+    return 0;
+}
+
+static void hash_insert(struct buffer *b) {
+    struct buffer **head = &hash_table[hash(b->dev, b->block)];
+    b->hash_next = *head;
+    *head = b;
+}
+
+static void hash_remove(struct buffer *b) {
+    struct buffer **link;
+    for(link = &hash_table[hash(b->dev, b->block)]; *link; link = &(*link)->hash_next) {
+        if(*link == b) {
+            *link = b->hash_next;
+            break;
+        }
+    }
+    b->dev = 0;
+}
+
+static inline uint32_t device_blocks(struct block_device *dev) {
+    return dev->sectors / BCACHE_BLOCK_SECTORS;
+}
+
+static struct readahead *stream(struct block_device *dev) {
+    for(int i = 0; i < MAX_BLOCK_DEVICES; i++) {
+        if(streams[i].dev == dev)
+            return &streams[i];
+        if(streams[i].dev == 0) {
+            streams[i].dev = dev;
+            streams[i].last = 0xFFFFFFFF;
+            return &streams[i];
+        }
+    }
+    return 0;
+}
+
+// the next clean, unused buffer the clock hand passes twice, or 0
+static struct buffer *evict() {
+    for(int step = 0; step < 2 * BCACHE_BLOCKS; step++) {
+        struct buffer *b = &buffers[clock_hand];
+        clock_hand = (clock_hand + 1) % BCACHE_BLOCKS;
+
+        if(b->refcount || (b->flags & (BUF_BUSY | BUF_DIRTY)))
+            continue;
+        if(b->flags & BUF_REFERENCED) {
+            b->flags &= ~BUF_REFERENCED;
+            continue;
+        }
+        if(b->dev)
+            hash_remove(b);
+        b->flags = 0;
+        return b;
+    }
+    return 0;
+}
+
+static struct buffer *allocate(struct block_device *dev, uint32_t block) {
+    struct buffer *b = evict();
+
+    if(b) {
+        b->dev = dev;
+        b->block = block;
+        hash_insert(b);
+    }
+    return b;
+}
+
+static struct bcache_io *io_alloc() {
+    for(int i = 0; i < BCACHE_MAX_IO; i++) {
+        if(!ios[i].used) {
+            ios[i].used = 1;
+            ios[i].count = 0;
+            ios_in_flight++;
+            return &ios[i];
+        }
+    }
+    return 0;
+}
+
+// runs from the driver's IRQ handler
+static void io_done(struct block_request *req) {
+    struct bcache_io *io = req->arg;
+
+    for(int i = 0; i < io->count; i++) {
+        struct buffer *b = io->blocks[i];
+        if(req->status == BLOCK_OK) {
+            if(req->op == BLOCK_READ)
+                b->flags |= BUF_VALID;
+        } else if(req->op == BLOCK_WRITE) {
+            b->flags |= BUF_DIRTY;          // the next sync tries again
+        } else if(b->dev) {
+            hash_remove(b);                 // the next reader tries again
+        }
+        b->flags &= ~BUF_BUSY;
+    }
+    io->used = 0;
+    ios_in_flight--;
+    wait_queue_wake_all(&io_waiters);
+}
+
+static void io_submit(struct bcache_io *io, int op) {
+    struct block_device *dev = io->blocks[0]->dev;
+    struct block_request *req = &io->req;
+
+    req->op = op;
+    req->sector = io->blocks[0]->block * BCACHE_BLOCK_SECTORS;
+    req->count = io->count * BCACHE_BLOCK_SECTORS;
+    req->buffer = 0;
+    req->segment_count = io->count;
+    for(int i = 0; i < io->count; i++) {
+        req->segments[i].addr = io->blocks[i]->data;
+        req->segments[i].length = BCACHE_BLOCK_SIZE;
+    }
+    req->done = io_done;
+    req->arg = io;
+    requests_issued++;
+    if(dev->submit(dev, req) < 0) {
+        req->status = BLOCK_ERROR;
+        io_done(req);
+    }
+}
+
+/* Starts one read of up to count uncached blocks from block on, stopping
+*  at the first block that is cached already. The block at index mark
+*  gets BUF_READAHEAD. Returns the number of blocks read, 0 when there is
+*  no free request or buffer. The device is not kicked */
+static int read_run(struct block_device *dev, uint32_t block, int count, int mark) {
+    struct bcache_io *io;
+    uint32_t end = device_blocks(dev);
+
+    if(count > BLOCK_MAX_SEGMENTS)
+        count = BLOCK_MAX_SEGMENTS;
+    if(count <= 0 || block >= end || lookup(dev, block) || (io = io_alloc()) == 0)
+        return 0;
+    while(io->count < count && block + io->count < end && !lookup(dev, block + io->count)) {
+        struct buffer *b = allocate(dev, block + io->count);
+        if(b == 0)
+            break;
+        b->flags = BUF_BUSY | (io->count == mark ? BUF_READAHEAD : 0);
+        io->blocks[io->count++] = b;
+    }
+    if(io->count == 0) {
+        io->used = 0;
+        ios_in_flight--;
+        return 0;
+    }
+    trace(TRACE_BCACHE_MISS, block);
+    io_submit(io, BLOCK_READ);
+    return io->count;
+}
+
+// the next window of a sequential reader, without waiting for it
+static void readahead(struct block_device *dev, struct readahead *ra) {
+    ra->next += read_run(dev, ra->next, ra->window, 0);
+    if(ra->window < READAHEAD_MAX)
+        ra->window *= 2;
+}
+
+static int has_dirty() {
+    for(int i = 0; i < BCACHE_BLOCKS; i++)
+        if(buffers[i].flags & BUF_DIRTY)
+            return 1;
+    return 0;
+}
+
+/* The buffer holding block, read from the disk if need be, or 0 on a
+*  read error. Every buffer from here goes back with bcache_put */
+struct buffer *bcache_get(struct block_device *dev, uint32_t block) {
+    struct readahead *ra = readahead_enabled ? stream(dev) : 0;
+    struct buffer *b;
+    unsigned int flags;
+    int sequential = 0;
+
+    if(block >= device_blocks(dev))
+        return 0;
+    flags = interrupts_save();
+    if(ra && block != ra->last) {
+        sequential = block == ra->last + 1;
+        if(!sequential)
+            ra->window = 0;
+        else if(ra->window == 0)
+            ra->window = READAHEAD_MIN;
+        ra->last = block;
+    }
+
+    while((b = lookup(dev, block)) == 0) {
+        // a miss: the block and, for a sequential reader, the window behind it
+        int count = read_run(dev, block, sequential ? 1 + ra->window : 1, 1);
+        if(count > 0) {
+            if(sequential) {
+                ra->next = block + count;
+                if(ra->window < READAHEAD_MAX)
+                    ra->window *= 2;
+            }
+            dev->kick(dev);
+            continue;
+        }
+        // no request or no clean buffer free: wait for one to come back
+        if(ios_in_flight > 0) {
+            wait_queue_sleep(&io_waiters);
+        } else if(!has_dirty() || bcache_sync(0) < 0) {
+            interrupts_restore(flags);
+            return 0;
+        }
+    }
+
+    b->refcount++;
+    b->flags |= BUF_REFERENCED;
+    if((b->flags & BUF_READAHEAD) && ra && ra->window) {
+        b->flags &= ~BUF_READAHEAD;
+        if(ra->next <= block)
+            ra->next = block + 1;
+        readahead(dev, ra);
+        dev->kick(dev);
+    }
+    while(b->flags & BUF_BUSY)
+        wait_queue_sleep(&io_waiters);
+    if(!(b->flags & BUF_VALID)) {
+        b->refcount--;
+        b = 0;
+    }
+    interrupts_restore(flags);
+    return b;
+}
+
+void bcache_put(struct buffer *buf) {
+    unsigned int flags = interrupts_save();
+    buf->refcount--;
+    interrupts_restore(flags);
+}
+
+// the caller changed buf->data, it goes to the disk at the next sync
+void bcache_mark_dirty(struct buffer *buf) {
+    unsigned int flags = interrupts_save();
+    buf->flags |= BUF_DIRTY | BUF_VALID;
+    interrupts_restore(flags);
+}
+
+// starts the reads of every uncached run in the range, one request per run
+static void prefetch(struct block_device *dev, uint32_t block, uint32_t count) {
+    unsigned int flags = interrupts_save();
+    uint32_t end = block + count;
+    int started = 0;
+
+    while(block < end) {
+        int n;
+        if(lookup(dev, block)) {
+            block++;
+            continue;
+        }
+        n = read_run(dev, block, end - block, -1);
+        if(n == 0)
+            break;
+        block += n;
+        started = 1;
+    }
+    if(started)
+        dev->kick(dev);
+    interrupts_restore(flags);
+}
+
+/* copies length bytes starting offset bytes into sector from the disk
+*  through the cache, returns 0 or -1 */
+int bcache_read_bytes(struct block_device *dev, uint32_t sector, uint32_t offset, uint32_t length, void *dest) {
+    uint32_t position = (sector % BCACHE_BLOCK_SECTORS) * SECTOR_SIZE + offset;
+    uint32_t first = sector / BCACHE_BLOCK_SECTORS + position / BCACHE_BLOCK_SIZE;
+    uint32_t last;
+    uint8_t *out = dest;
+
+    if(length == 0)
+        return 0;
+    position %= BCACHE_BLOCK_SIZE;
+    last = first + (position + length - 1) / BCACHE_BLOCK_SIZE;
+    // a single block is left to bcache_get, which reads ahead when it can
+    if(last > first)
+        prefetch(dev, first, last - first + 1);
+    for(uint32_t block = first; block <= last; block++) {
+        struct buffer *b = bcache_get(dev, block);
+        uint32_t count = BCACHE_BLOCK_SIZE - position;
+
+        if(b == 0)
+            return -1;
+        if(count > length)
+            count = length;
+        memory_copy((char*)b->data + position, (char*)out, count);
+        out += count;
+        length -= count;
+        position = 0;
+        bcache_put(b);
+    }
+    return 0;
+}
+
+// copies count sectors from the disk through the cache, returns 0 or -1
+int bcache_read(struct block_device *dev, uint32_t sector, uint32_t count, void *dest) {
+    return bcache_read_bytes(dev, sector, 0, count << SECTOR_SHIFT, dest);
+}
+
+/* copies count sectors into the cache and marks them dirty. Blocks that
+*  are overwritten whole are not read first */
+int bcache_write(struct block_device *dev, uint32_t sector, uint32_t count, void *src) {
+    uint32_t first = sector / BCACHE_BLOCK_SECTORS;
+    uint32_t last = (sector + count - 1) / BCACHE_BLOCK_SECTORS;
+    uint8_t *in = src;
+
+    if(count == 0)
+        return 0;
+    if(last >= device_blocks(dev))
+        return -1;
+    for(uint32_t block = first; block <= last; block++) {
+        uint32_t start = block == first ? (sector % BCACHE_BLOCK_SECTORS) << SECTOR_SHIFT : 0;
+        uint32_t end = block == last ? ((sector + count - 1) % BCACHE_BLOCK_SECTORS + 1) << SECTOR_SHIFT
+                                     : BCACHE_BLOCK_SIZE;
+        struct buffer *b = 0;
+        unsigned int flags = interrupts_save();
+
+        if(start == 0 && end == BCACHE_BLOCK_SIZE && lookup(dev, block) == 0) {
+            b = allocate(dev, block);
+            if(b) {
+                b->refcount = 1;
+                b->flags = BUF_VALID | BUF_REFERENCED;
+            }
+        }
+        interrupts_restore(flags);
+        if(b == 0 && (b = bcache_get(dev, block)) == 0)
+            return -1;
+        memory_copy((char*)in, (char*)b->data + start, end - start);
+        in += end - start;
+        bcache_mark_dirty(b);
+        bcache_put(b);
+    }
+    return 0;
+}
+
+static int dirty_idle(struct buffer *b) {
+    return b && (b->flags & (BUF_DIRTY | BUF_BUSY)) == BUF_DIRTY;
+}
+
+/* Writes the dirty blocks of dev, or of every device when dev is 0, and
+*  waits for them. Consecutive dirty blocks go out as one request and
+*  each device is kicked once per batch. Returns -1 if a write failed */
+int bcache_sync(struct block_device *dev) {
+    struct block_device *kicked[MAX_BLOCK_DEVICES];
+    int kicked_count = 0;
+    unsigned int flags = interrupts_save();
+    int result = 0;
+
+    for(int i = 0; i < BCACHE_BLOCKS; i++) {
+        struct buffer *b = &buffers[i];
+        struct bcache_io *io;
+        int k;
+
+        if(!dirty_idle(b) || (dev && b->dev != dev))
+            continue;
+        // only the first block of a run starts a request
+        if(b->block > 0 && dirty_idle(lookup(b->dev, b->block - 1)))
+            continue;
+        // a run longer than one request takes several
+        while(dirty_idle(b)) {
+            while((io = io_alloc()) == 0) {
+                for(k = 0; k < kicked_count; k++)
+                    kicked[k]->kick(kicked[k]);
+                wait_queue_sleep(&io_waiters);
+            }
+            while(dirty_idle(b) && io->count < BLOCK_MAX_SEGMENTS) {
+                b->flags = (b->flags & ~BUF_DIRTY) | BUF_BUSY;
+                io->blocks[io->count++] = b;
+                b = lookup(b->dev, b->block + 1);
+            }
+            if(io->count == 0) {
+                io->used = 0;
+                ios_in_flight--;
+                break;
+            }
+            io_submit(io, BLOCK_WRITE);
+            for(k = 0; k < kicked_count && kicked[k] != io->blocks[0]->dev; k++);
+            if(k == kicked_count && kicked_count < MAX_BLOCK_DEVICES)
+                kicked[kicked_count++] = io->blocks[0]->dev;
+        }
+    }
+    for(int k = 0; k < kicked_count; k++)
+        kicked[k]->kick(kicked[k]);
+
+    // wait for the writes, then make the device commit them
+    for(int i = 0; i < BCACHE_BLOCKS; i++) {
+        struct buffer *b = &buffers[i];
+        if(dev && b->dev != dev)
+            continue;
+        while(b->flags & BUF_BUSY)
+            wait_queue_sleep(&io_waiters);
+        if(b->flags & BUF_DIRTY)
+            result = -1;
+    }
+    interrupts_restore(flags);
+    for(int k = 0; k < kicked_count; k++)
+        if(block_transfer(kicked[k], BLOCK_FLUSH, 0, 0, 0) != BLOCK_OK)
+            result = -1;
+    return result;
+}
+
+// forgets the clean, unused blocks of dev
+void bcache_invalidate(struct block_device *dev) {
+    unsigned int flags = interrupts_save();
+
+    for(int i = 0; i < BCACHE_BLOCKS; i++) {
+        struct buffer *b = &buffers[i];
+        if(b->dev == dev && b->refcount == 0 && !(b->flags & (BUF_BUSY | BUF_DIRTY))) {
+            hash_remove(b);
+            b->flags = 0;
+        }
+    }
+    for(int i = 0; i < MAX_BLOCK_DEVICES; i++)
+        if(streams[i].dev == dev)
+            streams[i].window = 0;
+    interrupts_restore(flags);
+}
+
+static void flusher(void *arg) {
+    while(1) {
+        thread_sleep(BCACHE_FLUSH_INTERVAL);
+        if(has_dirty())
+            bcache_sync(0);
+    }
+}
+
+void bcache_init() {
+    for(int i = 0; i < BCACHE_BLOCKS; i++)
+        buffers[i].data = (uint8_t*)frame_alloc();
+    thread_create("bcache", flusher, 0, PRIORITY_NORMAL);
+}
+
+/* reads the start of the first disk 4 KB at a time: cold without and
+*  with read-ahead, then again from the cache */
+#define BENCH_BYTES     (512 * 1024)
+
+static void bench_pass(struct block_device *dev, char *name, uint8_t *buffer) {
+    uint32_t requests = requests_issued;
+    unsigned long long start = rdtsc();
+    uint32_t cycles;
+    int result = 0;
+
+    for(uint32_t sector = 0; sector < BENCH_BYTES / SECTOR_SIZE && result == 0; sector += BCACHE_BLOCK_SECTORS)
+        result = bcache_read(dev, sector, BCACHE_BLOCK_SECTORS, buffer);
+    cycles = (uint32_t)divide64(rdtsc() - start, BENCH_BYTES / 1024, 0);
+
+    printf(name, -1, -1);
+    printf(itoa(cycles), -1, -1);
+    printf(" cycles per KB, ", -1, -1);
+    printf(itoa(requests_issued - requests), -1, -1);
+    printf(result ? " requests, read error\n" : " requests\n", -1, -1);
+}
+
+void bcache_benchmark() {
+    struct block_device *dev = block_get(0);
+    uint32_t buffer;
+
+    if(dev == 0 || device_blocks(dev) < BENCH_BYTES / BCACHE_BLOCK_SIZE) {
+        printf("no disk large enough\n", -1, -1);
+        return;
+    }
+    buffer = frame_alloc();
+
+    bcache_invalidate(dev);
+    readahead_enabled = 0;
+    bench_pass(dev, "cold: ", (uint8_t*)buffer);
+    bcache_invalidate(dev);
+    readahead_enabled = 1;
+    bench_pass(dev, "cold with read-ahead: ", (uint8_t*)buffer);
+    bench_pass(dev, "cached: ", (uint8_t*)buffer);
+
+    frame_free(buffer);
+}
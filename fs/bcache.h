@@ -0,0 +1,46 @@
+#ifndef _BCACHE_H_
+#define _BCACHE_H_
+
+#include "../include/types.h"
+#include "../drivers/block.h"
+
+#define BCACHE_BLOCK_SIZE   4096
+#define BCACHE_BLOCK_SECTORS (BCACHE_BLOCK_SIZE / SECTOR_SIZE)
+#define BCACHE_BLOCKS       256         // 1 MB of cache
+#define BCACHE_HASH_BITS    9
+#define BCACHE_MAX_IO       16          // requests in flight at once
+
+// read-ahead window in blocks, it doubles while a reader stays sequential
+#define READAHEAD_MIN       2
+#define READAHEAD_MAX       BLOCK_MAX_SEGMENTS
+
+// dirty blocks reach the disk at the latest this many ticks later
+#define BCACHE_FLUSH_INTERVAL 500
+
+#define BUF_VALID           0x01        // data is the disk's or newer
+#define BUF_DIRTY           0x02        // newer than the disk
+#define BUF_BUSY            0x04        // a read or write is in flight
+#define BUF_REFERENCED      0x08        // used since the clock hand last passed
+#define BUF_READAHEAD       0x10        // reaching this block starts the next window
+
+typedef struct buffer {
+    struct block_device *dev;
+    uint32_t block;
+    uint8_t *data;
+    volatile int flags;
+    int refcount;
+    struct buffer *hash_next;
+} buffer;
+
+void bcache_init();
+struct buffer *bcache_get(struct block_device *dev, uint32_t block);
+void bcache_put(struct buffer *buf);
+void bcache_mark_dirty(struct buffer *buf);
+int bcache_read(struct block_device *dev, uint32_t sector, uint32_t count, void *dest);
+int bcache_read_bytes(struct block_device *dev, uint32_t sector, uint32_t offset, uint32_t length, void *dest);
+int bcache_write(struct block_device *dev, uint32_t sector, uint32_t count, void *src);
+int bcache_sync(struct block_device *dev);
+void bcache_invalidate(struct block_device *dev);
+void bcache_benchmark();
+
+#endif
@@ -0,0 +1,496 @@
+#include "fat.h"
+#include "bcache.h"
+#include "../drivers/block.h"
+#include "../drivers/screen.h"
+#include "../kernel/memory.h"
+#include "../kernel/low_level.h"
+#include "../include/conversion.h"
+
+/* FAT12 and FAT16, read only. The whole FAT is read once at mount and
+*  decoded into a table of 16 bit next-cluster entries, so following a
+*  chain never touches the disk. fat_read turns the chain into extents,
+*  runs of consecutive clusters, and reads each extent with a single
+*  bcache_read_bytes call. The cache sends every uncached run of blocks
+*  as one request, so a cold extent costs one request, not one per
+*  cluster.
+*  Path lookups go through a direct mapped cache of (directory, name)
+*  entries. Scanning a directory caches every entry in it, and names
+*  that are not there are cached as missing, so opening a path again
+*  doesn't read any directory. Nothing ever changes the disk, so the
+*  cache never has to be invalidated. */
+static struct fat_volume volume;
+static struct fat_file files[FAT_MAX_OPEN];
+
+#define DCACHE_EMPTY    0
+#define DCACHE_FOUND    1
+#define DCACHE_MISSING  2
+
+struct dcache_entry {
+    uint16_t parent;            // first cluster of the directory, 0 for the root
+    uint16_t cluster;
+    uint32_t size;
+    uint8_t attributes;
+    uint8_t state;
+    char name[FAT_DCACHE_NAME];
+};
+static struct dcache_entry dcache[FAT_DCACHE_SIZE];
+
+static inline char lower(char c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// case insensitive, a is 0 terminated and b is length characters long
+static int names_equal(const char *a, const char *b, int length) {
+    for(int i = 0; i < length; i++)
+        if(a[i] == 0 || lower(a[i]) != lower(b[i]))
+            return 0;
+    return a[length] == 0;
+}
+
+static uint32_t name_hash(uint16_t parent, const char *name, int length) {
+    uint32_t hash = 2166136261u ^ parent;
+    for(int i = 0; i < length; i++) {
+        hash ^= (uint8_t)lower(name[i]);
+        hash *= 16777619u;
+    }
+    return hash & (FAT_DCACHE_SIZE - 1);
+}
+
+static void dcache_insert(uint16_t parent, const char *name, int length, struct fat_dirent *d) {
+    struct dcache_entry *e = &dcache[name_hash(parent, name, length)];
+    unsigned int flags;
+
+    if(length >= FAT_DCACHE_NAME)
+        return;
+    flags = interrupts_save();
+    e->parent = parent;
+    e->state = d ? DCACHE_FOUND : DCACHE_MISSING;
+    e->cluster = d ? d->cluster : 0;
+    e->size = d ? d->size : 0;
+    e->attributes = d ? d->attributes : 0;
+    for(int i = 0; i < length; i++)
+        e->name[i] = name[i];
+    e->name[length] = 0;
+    interrupts_restore(flags);
+}
+
+// copies the cached entry to *result, returns 0 when there is none
+static int dcache_find(uint16_t parent, const char *name, int length, struct dcache_entry *result) {
+    struct dcache_entry *e = &dcache[name_hash(parent, name, length)];
+    unsigned int flags = interrupts_save();
+    int found = 0;
+
+    if(e->state != DCACHE_EMPTY && e->parent == parent && names_equal(e->name, name, length)) {
+        *result = *e;
+        found = 1;
+    }
+    interrupts_restore(flags);
+    return found;
+}
+
+static inline uint32_t cluster_sector(uint16_t cluster) {
+    return volume.data_start + (cluster - 2) * volume.sectors_per_cluster;
+}
+
+static inline int valid_cluster(uint16_t cluster) {
+    return cluster >= 2 && cluster < volume.cluster_count + 2;
+}
+
+static uint8_t lfn_checksum(const char *short_name) {
+    uint8_t sum = 0;
+    for(int i = 0; i < 11; i++)
+        sum = ((sum & 1) << 7) + (sum >> 1) + (uint8_t)short_name[i];
+    return sum;
+}
+
+// "NAME    EXT" to "NAME.EXT", returns the length
+static int short_name(struct fat_dirent *d, char *name) {
+    int length = 0;
+
+    for(int i = 0; i < 8 && d->name[i] != ' '; i++)
+        name[length++] = d->name[i];
+    if((uint8_t)name[0] == 0x05)        // a real 0xE5, which would mean deleted
+        name[0] = (char)0xE5;
+    if(d->name[8] != ' ') {
+        name[length++] = '.';
+        for(int i = 8; i < 11 && d->name[i] != ' '; i++)
+            name[length++] = d->name[i];
+    }
+    name[length] = 0;
+    return length;
+}
+
+// long names are kept as ascii, anything else becomes '?'
+static void lfn_copy(char *dest, uint8_t *src, int count) {
+    for(int i = 0; i < count; i++) {
+        uint16_t c = src[i * 2] | (src[i * 2 + 1] << 8);
+        if(c == 0) {
+            dest[i] = 0;
+            return;
+        }
+        dest[i] = c < 0x80 ? (char)c : '?';
+    }
+}
+
+/* Walks the directory at cluster (0 is the root) and caches every entry
+*  in it. Returns 1 and fills *found if one of them is called name */
+static int scan_directory(uint16_t dir, const char *name, int length, struct dcache_entry *found) {
+    struct fat_dirent entries[SECTOR_SIZE / sizeof(struct fat_dirent)];
+    char long_name[20 * 13 + 1];        // at most 20 pieces of 13 characters
+    char short_buffer[13];
+    int long_expected = -1;             // pieces still to come, -1 when there is no long name
+    uint8_t long_checksum = 0;
+    uint16_t cluster = dir;
+    uint32_t index = 0;
+    int result = 0;
+
+    while(1) {
+        uint32_t sector;
+
+        if(dir == 0) {
+            if(index == volume.root_sectors)
+                break;
+            sector = volume.root_start + index;
+        } else {
+            if(index == volume.sectors_per_cluster) {
+                cluster = volume.fat[cluster];
+                index = 0;
+            }
+            if(!valid_cluster(cluster))
+                break;
+            sector = cluster_sector(cluster) + index;
+        }
+        index++;
+        if(bcache_read(volume.dev, sector, 1, entries) < 0)
+            break;
+
+        for(int i = 0; i < SECTOR_SIZE / sizeof(struct fat_dirent); i++) {
+            struct fat_dirent *d = &entries[i];
+            char *entry_name;
+            int entry_length;
+
+            if(d->name[0] == 0)
+                return result;          // nothing follows the end marker
+            if((uint8_t)d->name[0] == 0xE5) {
+                long_expected = -1;
+                continue;
+            }
+            if(d->attributes == FAT_ATTR_LFN) {
+                struct fat_lfn *l = (struct fat_lfn*)d;
+                int piece = l->order & 0x1F;
+                if(l->order & 0x40) {
+                    long_expected = piece;
+                    long_checksum = l->checksum;
+                    long_name[piece * 13] = 0;
+                }
+                if(piece == 0 || piece > 20 || piece != long_expected || l->checksum != long_checksum) {
+                    long_expected = -1;
+                    continue;
+                }
+                long_expected--;
+                lfn_copy(long_name + (piece - 1) * 13, (uint8_t*)l->name1, 5);
+                lfn_copy(long_name + (piece - 1) * 13 + 5, (uint8_t*)l->name2, 6);
+                lfn_copy(long_name + (piece - 1) * 13 + 11, (uint8_t*)l->name3, 2);
+                continue;
+            }
+            if(d->attributes & FAT_ATTR_VOLUME_ID) {
+                long_expected = -1;
+                continue;
+            }
+
+            if(long_expected == 0 && lfn_checksum(d->name) == long_checksum) {
+                entry_name = long_name;
+                for(entry_length = 0; long_name[entry_length]; entry_length++);
+            } else {
+                entry_name = short_buffer;
+                entry_length = short_name(d, short_buffer);
+            }
+            long_expected = -1;
+            if(entry_name[0] == '.' && (entry_length == 1 || (entry_length == 2 && entry_name[1] == '.')))
+                continue;
+
+            dcache_insert(dir, entry_name, entry_length, d);
+            if(!result && names_equal(entry_name, name, length)) {
+                found->cluster = d->cluster;
+                found->size = d->size;
+                found->attributes = d->attributes;
+                result = 1;
+            }
+        }
+    }
+    return result;
+}
+
+// resolves a path relative to the root, returns 0 if it doesn't exist
+static int lookup(char *path, struct dcache_entry *result) {
+    result->cluster = 0;
+    result->size = 0;
+    result->attributes = FAT_ATTR_DIRECTORY;
+
+    while(*path) {
+        uint16_t dir = result->cluster;
+        int length;
+
+        if(*path == '/') {
+            path++;
+            continue;
+        }
+        for(length = 0; path[length] && path[length] != '/'; length++);
+        if(!(result->attributes & FAT_ATTR_DIRECTORY))
+            return 0;
+        if(dcache_find(dir, path, length, result)) {
+            if(result->state == DCACHE_MISSING)
+                return 0;
+        } else if(!scan_directory(dir, path, length, result)) {
+            dcache_insert(dir, path, length, 0);
+            return 0;
+        }
+        path += length;
+    }
+    return 1;
+}
+
+static int valid_boot_sector(struct fat_boot_sector *bs) {
+    return bs->bytes_per_sector == SECTOR_SIZE
+        && bs->sectors_per_cluster != 0
+        && (bs->sectors_per_cluster & (bs->sectors_per_cluster - 1)) == 0
+        && bs->reserved_sectors != 0
+        && (bs->fat_count == 1 || bs->fat_count == 2)
+        && bs->fat_sectors != 0         // 0 here means FAT32
+        && bs->root_entries != 0;
+}
+
+// reads and decodes the first FAT with one request
+static int load_fat(uint32_t fat_sectors) {
+    uint32_t raw_pages = PAGE_ALIGN_UP(fat_sectors * SECTOR_SIZE) / PAGE_SIZE;
+    uint32_t entries = volume.cluster_count + 2;
+    uint32_t raw = frame_alloc_contiguous(raw_pages);
+    uint8_t *bytes = (uint8_t*)raw;
+
+    if(raw == 0)
+        return 0;
+    // the table must not outrun the FAT, a FAT12 entry takes 1.5 bytes
+    if(entries > (volume.type == 12 ? fat_sectors * SECTOR_SIZE * 2 / 3 : fat_sectors * SECTOR_SIZE / 2))
+        entries = volume.type == 12 ? fat_sectors * SECTOR_SIZE * 2 / 3 : fat_sectors * SECTOR_SIZE / 2;
+    volume.fat_pages = PAGE_ALIGN_UP(entries * sizeof(uint16_t)) / PAGE_SIZE;
+    volume.fat = (uint16_t*)frame_alloc_contiguous(volume.fat_pages);
+    if(volume.fat == 0 || block_transfer(volume.dev, BLOCK_READ, volume.fat_start, fat_sectors, bytes) != BLOCK_OK) {
+        if(volume.fat)
+            frame_free_contiguous((uint32_t)volume.fat, volume.fat_pages);
+        volume.fat = 0;
+        frame_free_contiguous(raw, raw_pages);
+        return 0;
+    }
+
+    for(uint32_t n = 0; n < entries; n++) {
+        uint32_t value, end;
+        if(volume.type == 12) {
+            uint32_t offset = n + n / 2;
+            value = bytes[offset] | (bytes[offset + 1] << 8);
+            value = n & 1 ? value >> 4 : value & 0xFFF;
+            end = 0xFF7;                // bad cluster, then the end markers
+        } else {
+            value = bytes[n * 2] | (bytes[n * 2 + 1] << 8);
+            end = 0xFFF7;
+        }
+        // a chain pointing outside the volume ends there
+        if(value != FAT_FREE && (value >= end || !valid_cluster(value)))
+            value = FAT_END;
+        volume.fat[n] = value;
+    }
+    // entries the table had no room for read as chain ends
+    volume.cluster_count = entries - 2;
+    frame_free_contiguous(raw, raw_pages);
+    return 1;
+}
+
+/* Mounts the FAT file system on dev, either on the whole disk or in the
+*  first FAT partition of an MBR. Returns 0 on success, -1 otherwise */
+int fat_mount(struct block_device *dev) {
+    uint8_t sector[SECTOR_SIZE];
+    struct fat_boot_sector *bs = (struct fat_boot_sector*)sector;
+    uint32_t start = 0, total, root_sectors;
+
+    if(dev == 0 || volume.fat || bcache_read(dev, 0, 1, sector) < 0)
+        return -1;
+    if(!valid_boot_sector(bs)) {
+        if(sector[510] != 0x55 || sector[511] != 0xAA)
+            return -1;
+        for(int i = 0; i < 4 && start == 0; i++) {
+            uint8_t *partition = sector + 446 + i * 16;
+            uint8_t type = partition[4];
+            if(type == 0x01 || type == 0x04 || type == 0x06 || type == 0x0E)
+                start = partition[8] | (partition[9] << 8) | (partition[10] << 16) | (partition[11] << 24);
+        }
+        if(start == 0 || bcache_read(dev, start, 1, sector) < 0 || !valid_boot_sector(bs))
+            return -1;
+    }
+
+    total = bs->total_sectors16 ? bs->total_sectors16 : bs->total_sectors32;
+    root_sectors = (bs->root_entries * sizeof(struct fat_dirent) + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    volume.dev = dev;
+    volume.sectors_per_cluster = bs->sectors_per_cluster;
+    volume.cluster_bytes = bs->sectors_per_cluster * SECTOR_SIZE;
+    volume.fat_start = start + bs->reserved_sectors;
+    volume.root_start = volume.fat_start + bs->fat_count * bs->fat_sectors;
+    volume.root_sectors = root_sectors;
+    volume.data_start = volume.root_start + root_sectors;
+    if(total <= volume.data_start - start)
+        return -1;
+    volume.cluster_count = (total - (volume.data_start - start)) / bs->sectors_per_cluster;
+    if(volume.cluster_count < 4085)
+        volume.type = 12;
+    else if(volume.cluster_count < 65525)
+        volume.type = 16;
+    else
+        return -1;                      // FAT32
+    return load_fat(bs->fat_sectors) ? 0 : -1;
+}
+
+// path is relative to the root of the volume, returns 0 if there is no such file
+struct fat_file *fat_open(char *path) {
+    struct dcache_entry entry;
+    struct fat_file *f = 0;
+    unsigned int flags;
+
+    if(volume.fat == 0 || !lookup(path, &entry))
+        return 0;
+    flags = interrupts_save();
+    for(int i = 0; i < FAT_MAX_OPEN; i++) {
+        if(!files[i].used) {
+            f = &files[i];
+            f->used = 1;
+            break;
+        }
+    }
+    interrupts_restore(flags);
+    if(f == 0)
+        return 0;
+    f->cluster = entry.cluster;
+    f->size = entry.size;
+    f->attributes = entry.attributes;
+    f->cursor_index = 0;
+    f->cursor_cluster = entry.cluster;
+    return f;
+}
+
+void fat_close(struct fat_file *f) {
+    f->used = 0;
+}
+
+/* Copies up to length bytes from offset, returns how many or -1. Each
+*  run of consecutive clusters is one read */
+int fat_read(struct fat_file *f, uint32_t offset, void *buffer, uint32_t length) {
+    uint8_t *out = buffer;
+    uint32_t index, within, done = 0;
+    uint16_t cluster;
+
+    if(f->attributes & FAT_ATTR_DIRECTORY)
+        return -1;
+    if(offset >= f->size)
+        return 0;
+    if(length > f->size - offset)
+        length = f->size - offset;
+    index = offset / volume.cluster_bytes;
+    within = offset % volume.cluster_bytes;
+
+    // walk from the cursor when reading on from there, else from the start
+    if(index < f->cursor_index || !valid_cluster(f->cursor_cluster)) {
+        f->cursor_index = 0;
+        f->cursor_cluster = f->cluster;
+    }
+    cluster = f->cursor_cluster;
+    for(uint32_t i = f->cursor_index; i < index && valid_cluster(cluster); i++)
+        cluster = volume.fat[cluster];
+
+    while(done < length) {
+        uint32_t run = 1, bytes;
+
+        if(!valid_cluster(cluster))
+            return done ? (int)done : -1;
+        while(run * volume.cluster_bytes - within < length - done && volume.fat[cluster + run - 1] == cluster + run)
+            run++;
+        bytes = run * volume.cluster_bytes - within;
+        if(bytes > length - done)
+            bytes = length - done;
+        if(bcache_read_bytes(volume.dev, cluster_sector(cluster), within, bytes, out + done) < 0)
+            return done ? (int)done : -1;
+        done += bytes;
+
+        // on to the last cluster of the run, and past it if it was used up
+        index += run - 1;
+        cluster += run - 1;
+        if(within + bytes < run * volume.cluster_bytes)
+            break;
+        cluster = volume.fat[cluster];
+        index++;
+        within = 0;
+    }
+    f->cursor_index = index;
+    f->cursor_cluster = cluster;
+    return done;
+}
+
+/* path lookups, cold and from the lookup cache, and reading a file cold
+*  and from the block cache */
+#define BENCH_LOOKUPS   1000
+#define BENCH_PATH      "bin/hello"
+#define BENCH_FILE      "pic.bmp"
+
+void fat_benchmark() {
+    struct fat_file *f;
+    unsigned long long start;
+    uint32_t first_open, cached_open, cold_read, cached_read, pages, buffer;
+
+    if(volume.fat == 0) {
+        printf("no FAT volume mounted\n", -1, -1);
+        return;
+    }
+    for(int i = 0; i < FAT_DCACHE_SIZE; i++)
+        dcache[i].state = DCACHE_EMPTY;
+
+    start = rdtsc();
+    f = fat_open(BENCH_PATH);
+    first_open = (uint32_t)(rdtsc() - start);
+    if(f == 0) {
+        printf(BENCH_PATH " is not on the disk\n", -1, -1);
+        return;
+    }
+    fat_close(f);
+    start = rdtsc();
+    for(int i = 0; i < BENCH_LOOKUPS; i++)
+        fat_close(fat_open(BENCH_PATH));
+    cached_open = (uint32_t)divide64(rdtsc() - start, BENCH_LOOKUPS, 0);
+
+    f = fat_open(BENCH_FILE);
+    if(f == 0 || f->size == 0) {
+        printf(BENCH_FILE " is not on the disk\n", -1, -1);
+        return;
+    }
+    pages = PAGE_ALIGN_UP(f->size) / PAGE_SIZE;
+    buffer = frame_alloc_contiguous(pages);
+    if(buffer == 0) {
+        fat_close(f);
+        printf("not enough memory for the file\n", -1, -1);
+        return;
+    }
+    bcache_invalidate(volume.dev);
+    start = rdtsc();
+    fat_read(f, 0, (void*)buffer, f->size);
+    cold_read = (uint32_t)divide64(rdtsc() - start, f->size / 1024 + 1, 0);
+    start = rdtsc();
+    fat_read(f, 0, (void*)buffer, f->size);
+    cached_read = (uint32_t)divide64(rdtsc() - start, f->size / 1024 + 1, 0);
+    frame_free_contiguous(buffer, pages);
+    fat_close(f);
+
+    printf("open " BENCH_PATH ": ", -1, -1);
+    printf(itoa(first_open), -1, -1);
+    printf(" cycles cold, ", -1, -1);
+    printf(itoa(cached_open), -1, -1);
+    printf(" cached\nread " BENCH_FILE ": ", -1, -1);
+    printf(itoa(cold_read), -1, -1);
+    printf(" cycles per KB cold, ", -1, -1);
+    printf(itoa(cached_read), -1, -1);
+    printf(" cached\n", -1, -1);
+}
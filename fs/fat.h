@@ -0,0 +1,103 @@
+#ifndef _FAT_H_
+#define _FAT_H_
+
+#include "../include/types.h"
+
+struct block_device;
+
+#define FAT_MAX_OPEN        16
+#define FAT_NAME_MAX        255
+#define FAT_PATH_MAX        256
+
+// lookup cache: direct mapped, names longer than this are not cached
+#define FAT_DCACHE_SIZE     256
+#define FAT_DCACHE_NAME     32
+
+// decoded FAT entries: free, the next cluster, or the end of a chain
+#define FAT_FREE            0x0000
+#define FAT_END             0xFFFF
+
+#define FAT_ATTR_READ_ONLY  0x01
+#define FAT_ATTR_HIDDEN     0x02
+#define FAT_ATTR_SYSTEM     0x04
+#define FAT_ATTR_VOLUME_ID  0x08
+#define FAT_ATTR_DIRECTORY  0x10
+#define FAT_ATTR_ARCHIVE    0x20
+#define FAT_ATTR_LFN        0x0F
+
+// boot sector, with the BIOS Parameter Block boot/bootloader.asm sketches
+struct fat_boot_sector {
+    uint8_t jump[3];
+    char oem[8];
+    uint16_t bytes_per_sector;
+    uint8_t sectors_per_cluster;
+    uint16_t reserved_sectors;
+    uint8_t fat_count;
+    uint16_t root_entries;
+    uint16_t total_sectors16;
+    uint8_t media;
+    uint16_t fat_sectors;
+    uint16_t sectors_per_track;
+    uint16_t heads;
+    uint32_t hidden_sectors;
+    uint32_t total_sectors32;
+} __attribute__((packed));
+
+struct fat_dirent {
+    char name[11];              // 8.3, space padded
+    uint8_t attributes;
+    uint8_t reserved;
+    uint8_t create_tenths;
+    uint16_t create_time;
+    uint16_t create_date;
+    uint16_t access_date;
+    uint16_t cluster_high;      // FAT32 only
+    uint16_t write_time;
+    uint16_t write_date;
+    uint16_t cluster;
+    uint32_t size;
+} __attribute__((packed));
+
+// long file name entry, 13 UCS-2 characters of the name each
+struct fat_lfn {
+    uint8_t order;              // 0x40 marks the last piece, which comes first
+    uint16_t name1[5];
+    uint8_t attributes;
+    uint8_t type;
+    uint8_t checksum;
+    uint16_t name2[6];
+    uint16_t cluster;
+    uint16_t name3[2];
+} __attribute__((packed));
+
+typedef struct fat_volume {
+    struct block_device *dev;
+    int type;                   // 12 or 16
+    uint32_t sectors_per_cluster;
+    uint32_t cluster_bytes;
+    uint32_t fat_start;         // everything in sectors from the start of the disk
+    uint32_t root_start;
+    uint32_t root_sectors;
+    uint32_t data_start;
+    uint32_t cluster_count;
+    uint16_t *fat;              // the next cluster of each cluster, decoded
+    uint32_t fat_pages;
+} fat_volume;
+
+typedef struct fat_file {
+    int used;
+    uint16_t cluster;           // first cluster, 0 for the root directory
+    uint32_t size;
+    uint8_t attributes;
+    // where the last read ended, sequential reads don't walk the chain again
+    uint32_t cursor_index;
+    uint16_t cursor_cluster;
+} fat_file;
+
+int fat_mount(struct block_device *dev);
+struct fat_file *fat_open(char *path);
+int fat_read(struct fat_file *f, uint32_t offset, void *buffer, uint32_t length);
+void fat_close(struct fat_file *f);
+void fat_benchmark();
+
+#endif
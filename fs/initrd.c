@@ -0,0 +1,152 @@
+#include "initrd.h"
+
+uint32_t initrd_size = 0;
+int initrd_file_count = 0;
+
+static struct initrd_file files[INITRD_MAX_FILES];
+// slots hold index + 1 into files[], 0 is an empty slot
+static uint16_t path_index[INITRD_INDEX_SIZE];
+
+static uint32_t octal_to_int(char *field, int length) {
+    uint32_t value = 0;
+    for(int i = 0; i < length && field[i] >= '0' && field[i] <= '7'; i++)
+        value = value * 8 + (field[i] - '0');
+    return value;
+}
+
+static int is_ustar(struct tar_header *header) {
+    return header->magic[0] == 'u' && header->magic[1] == 's' && header->magic[2] == 't'
+        && header->magic[3] == 'a' && header->magic[4] == 'r';
+}
+
+static struct tar_header *next_header(struct tar_header *header) {
+    uint32_t size = octal_to_int(header->size, sizeof(header->size));
+    return (struct tar_header*)((uint8_t*)header + TAR_BLOCK_SIZE + ((size + TAR_BLOCK_SIZE - 1) & ~(TAR_BLOCK_SIZE - 1)));
+}
+
+// "./bin/hello" and "/bin/hello" both mean "bin/hello"
+static char *skip_leading(char *path) {
+    if(path[0] == '.' && path[1] == '/')
+        path += 2;
+    while(*path == '/')
+        path++;
+    return path;
+}
+
+// fields are nul terminated unless they fill the whole field
+static int field_length(char *field, int size) {
+    int length = 0;
+    while(length < size && field[length])
+        length++;
+    return length;
+}
+
+// FNV-1a, continued across calls so prefix, '/' and name hash like one string
+static uint32_t hash_bytes(uint32_t hash, char *bytes, int length) {
+    for(int i = 0; i < length; i++) {
+        hash ^= (uint8_t)bytes[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+#define HASH_SEED 2166136261u
+
+static uint32_t hash_path(char *path) {
+    path = skip_leading(path);
+    return hash_bytes(HASH_SEED, path, field_length(path, 512));
+}
+
+// ustar splits long names into prefix and name, joined with a '/'
+static void header_path(struct tar_header *header, char *path) {
+    int length = 0;
+    int i;
+
+    if(header->prefix[0]) {
+        for(i = 0; i < sizeof(header->prefix) && header->prefix[i]; i++)
+            path[length++] = header->prefix[i];
+        path[length++] = '/';
+    }
+    for(i = 0; i < sizeof(header->name) && header->name[i]; i++)
+        path[length++] = header->name[i];
+    path[length] = 0;
+}
+
+// compares path against the entry's name without building it in a buffer
+static int header_matches(struct tar_header *header, char *path) {
+    char *name = header->name;
+    int length;
+
+    path = skip_leading(path);
+    if(header->prefix[0]) {
+        char *prefix = skip_leading(header->prefix);
+        length = field_length(prefix, header->prefix + sizeof(header->prefix) - prefix);
+        for(int i = 0; i < length; i++)
+            if(*path++ != prefix[i])
+                return 0;
+        if(*path++ != '/')
+            return 0;
+    } else {
+        name = skip_leading(name);
+    }
+    length = field_length(name, header->name + sizeof(header->name) - name);
+    for(int i = 0; i < length; i++)
+        if(*path++ != name[i])
+            return 0;
+    return *path == 0;
+}
+
+static void index_insert(struct initrd_file *file) {
+    uint32_t slot = file->hash % INITRD_INDEX_SIZE;
+
+    while(path_index[slot])
+        slot = (slot + 1) % INITRD_INDEX_SIZE;
+    path_index[slot] = (file - files) + 1;
+}
+
+/* One pass over the ustar headers at boot: finds where the archive ends
+*  and indexes every regular file by path. Returns 0 if there is no archive */
+int initrd_init() {
+    struct tar_header *header = (struct tar_header*)INITRD_BASE;
+    struct initrd_file *file;
+    char path[sizeof(header->prefix) + 1 + sizeof(header->name) + 1];
+
+    if(!is_ustar(header))
+        return 0;
+    for(; is_ustar(header); header = next_header(header)) {
+        if(header->typeflag != TAR_REGULAR && header->typeflag != TAR_REGULAR_OLD)
+            continue;
+
+        // a later entry with the same path replaces the earlier one, as 'tar -r' intends
+        header_path(header, path);
+        file = initrd_lookup(path);
+        if(file == 0 && initrd_file_count < INITRD_MAX_FILES) {
+            file = &files[initrd_file_count++];
+            file->hash = hash_path(path);
+            index_insert(file);
+        }
+        if(file) {
+            file->header = header;
+            file->data = (uint8_t*)header + TAR_BLOCK_SIZE;
+            file->size = octal_to_int(header->size, sizeof(header->size));
+        }
+    }
+    initrd_size = (uint8_t*)header - (uint8_t*)INITRD_BASE;
+    return 1;
+}
+
+// O(1) expected: one hash and usually a single probe
+struct initrd_file *initrd_lookup(char *path) {
+    uint32_t hash;
+    uint32_t slot;
+
+    if(path == 0 || initrd_file_count == 0)
+        return 0;
+    hash = hash_path(path);
+    for(slot = hash % INITRD_INDEX_SIZE; path_index[slot]; slot = (slot + 1) % INITRD_INDEX_SIZE) {
+        struct initrd_file *file = &files[path_index[slot] - 1];
+        if(file->hash == hash && header_matches(file->header, path))
+            return file;
+    }
+    return 0;
+}
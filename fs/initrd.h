@@ -0,0 +1,56 @@
+#ifndef _INITRD_H_
+#define _INITRD_H_
+
+#include "../include/types.h"
+
+// the emulator places boot/initrd/initrd.tar here before the kernel runs:
+// bochsrc.bxrc uses optramimage1, 'make qemu' a -device loader
+#define INITRD_BASE     0x400000
+
+#define TAR_BLOCK_SIZE  512
+
+// ustar header, every field is ascii, numbers are octal
+struct tar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];              // "ustar"
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} __attribute__((packed));
+
+#define TAR_REGULAR     '0'
+#define TAR_REGULAR_OLD '\0'
+
+// the path index is an open addressed hash table built once at boot,
+// keep it at most half full so probe sequences stay short
+#define INITRD_MAX_FILES    128
+#define INITRD_INDEX_SIZE   (INITRD_MAX_FILES * 2)
+
+// a regular file in the archive. data points into the archive itself,
+// which stays where the emulator put it for as long as the kernel runs
+typedef struct initrd_file {
+    uint32_t hash;
+    struct tar_header *header;
+    uint8_t *data;
+    uint32_t size;
+} initrd_file;
+
+extern uint32_t initrd_size;
+extern int initrd_file_count;
+
+int initrd_init();
+struct initrd_file *initrd_lookup(char *path);
+
+#endif
@@ -0,0 +1,121 @@
+#include "vfs.h"
+#include "initrd.h"
+#include "fat.h"
+#include "../kernel/low_level.h"
+#include "../tools/utils.h"
+
+/* The initrd is already in memory, so there is no page cache and nothing
+*  to fill: vfs_mmap hands out a pointer into the archive and vfs_read is
+*  a single copy from it. Files under disk/ are on the FAT volume and are
+*  read through the block cache; they can't be mapped. */
+static struct file open_files[VFS_MAX_OPEN];
+
+static struct file *get_file(int fd) {
+    if(fd < 0 || fd >= VFS_MAX_OPEN || (open_files[fd].node == 0 && open_files[fd].fat == 0))
+        return 0;
+    return &open_files[fd];
+}
+
+// returns a descriptor, or -1 if there is no such file or no free slot
+int vfs_open(char *path) {
+    struct initrd_file *node = 0;
+    struct fat_file *fat = 0;
+    unsigned int flags;
+    int fd = -1, prefix;
+
+    for(prefix = 0; VFS_DISK_PREFIX[prefix] && path[prefix] == VFS_DISK_PREFIX[prefix]; prefix++);
+    if(VFS_DISK_PREFIX[prefix] == 0)
+        fat = fat_open(path + prefix);
+    else
+        node = initrd_lookup(path);
+    if(node == 0 && fat == 0)
+        return -1;
+
+    flags = interrupts_save();
+    for(int i = 0; i < VFS_MAX_OPEN; i++) {
+        if(open_files[i].node == 0 && open_files[i].fat == 0) {
+            open_files[i].node = node;
+            open_files[i].fat = fat;
+            open_files[i].offset = 0;
+            fd = i;
+            break;
+        }
+    }
+    interrupts_restore(flags);
+    if(fd < 0 && fat)
+        fat_close(fat);
+    return fd;
+}
+
+void vfs_close(int fd) {
+    struct file *f = get_file(fd);
+    if(f == 0)
+        return;
+    if(f->fat)
+        fat_close(f->fat);
+    f->fat = 0;
+    f->node = 0;
+}
+
+// copies up to length bytes from the current offset, returns the number copied
+int vfs_read(int fd, void *buffer, uint32_t length) {
+    struct file *f = get_file(fd);
+
+    if(f == 0)
+        return -1;
+    if(f->fat) {
+        int count = fat_read(f->fat, f->offset, buffer, length);
+        if(count > 0)
+            f->offset += count;
+        return count;
+    }
+    if(f->offset >= f->node->size)
+        return 0;
+    if(length > f->node->size - f->offset)
+        length = f->node->size - f->offset;
+    memory_copy((char*)f->node->data + f->offset, buffer, length);
+    f->offset += length;
+    return length;
+}
+
+int vfs_seek(int fd, int offset, int whence) {
+    struct file *f = get_file(fd);
+    int position;
+
+    if(f == 0)
+        return -1;
+    if(whence == SEEK_SET)
+        position = offset;
+    else if(whence == SEEK_CUR)
+        position = f->offset + offset;
+    else if(whence == SEEK_END)
+        position = (f->fat ? f->fat->size : f->node->size) + offset;
+    else
+        return -1;
+    if(position < 0)
+        return -1;
+    f->offset = position;
+    return position;
+}
+
+uint32_t vfs_size(int fd) {
+    struct file *f = get_file(fd);
+    if(f == 0)
+        return 0;
+    return f->fat ? f->fat->size : f->node->size;
+}
+
+/* The file's bytes in place, valid for as long as the kernel runs, even
+*  after the descriptor is closed. Read only: they are the archive itself.
+*  Files on disk have no bytes in place, they give 0 */
+const uint8_t *vfs_mmap(int fd, uint32_t *size) {
+    struct file *f = get_file(fd);
+
+    if(size)
+        *size = 0;
+    if(f == 0 || f->fat)
+        return 0;
+    if(size)
+        *size = f->node->size;
+    return f->node->data;
+}
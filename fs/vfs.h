@@ -0,0 +1,33 @@
+#ifndef _VFS_H_
+#define _VFS_H_
+
+#include "../include/types.h"
+
+#define VFS_MAX_OPEN    32
+
+// whence values for vfs_seek
+#define SEEK_SET        0
+#define SEEK_CUR        1
+#define SEEK_END        2
+
+// paths under this prefix are on the FAT volume, everything else is in the initrd
+#define VFS_DISK_PREFIX "disk/"
+
+struct initrd_file;
+struct fat_file;
+
+// an open file: which file, initrd or FAT, and where the next read starts
+typedef struct file {
+    struct initrd_file *node;
+    struct fat_file *fat;
+    uint32_t offset;
+} file;
+
+int vfs_open(char *path);
+void vfs_close(int fd);
+int vfs_read(int fd, void *buffer, uint32_t length);
+int vfs_seek(int fd, int offset, int whence);
+uint32_t vfs_size(int fd);
+const uint8_t *vfs_mmap(int fd, uint32_t *size);
+
+#endif
@@ -0,0 +1,137 @@
+#include "cursor.h"
+#include "window.h"
+#include "../drivers/vesa_vbe/vbe.h"
+#include "../kernel/low_level.h"
+
+/* Software cursor drawn straight onto the framebuffer, outside the
+*  compositor. Before it is drawn the pixels it covers are saved, so
+*  moving it only restores and redraws two 16x16 squares and never
+*  damages any window. The compositor suspends it around a flush, since
+*  painting under a drawn cursor would leave a stale save-under behind.
+*  Every entry point runs with interrupts off, so the mouse thread and
+*  whoever is flushing can't interleave. */
+static const char *arrow[CURSOR_SIZE] = {
+    "X...............",
+    "XX..............",
+    "XOX.............",
+    "XOOX............",
+    "XOOOX...........",
+    "XOOOOX..........",
+    "XOOOOOX.........",
+    "XOOOOOOX........",
+    "XOOOOOOOX.......",
+    "XOOOOOOOOX......",
+    "XOOOOOXXXXX.....",
+    "XOOXOOX.........",
+    "XOX.XOOX........",
+    "XX..XOOX........",
+    "X....XOOX.......",
+    ".....XXXX.......",
+};
+
+static uint8_t save_under[CURSOR_SIZE * CURSOR_SIZE * 4];
+static int cursor_x, cursor_y;
+static int visible;             // wanted on screen
+static int drawn;               // actually on screen, save_under is valid
+static int suspended;
+static struct RECT saved;       // the on screen part save_under holds
+
+static inline uint8_t *screen_pixel(int x, int y, int bytes) {
+    return (uint8_t*)(uintptr_t)vbe_mode->framebuffer + y * vbe_mode->pitch + x * bytes;
+}
+
+static void put_pixel(uint8_t *dest, uint32_t pixel, int bytes) {
+    if(bytes == 4)
+        *(uint32_t*)dest = pixel;
+    else if(bytes == 2)
+        *(uint16_t*)dest = pixel;
+    else {
+        dest[0] = pixel;
+        dest[1] = pixel >> 8;
+        dest[2] = pixel >> 16;
+    }
+}
+
+static void draw() {
+    struct RECT screen = { .width = vbe_mode->width, .height = vbe_mode->height, .x = 0, .y = 0 };
+    struct RECT box = { .width = CURSOR_SIZE, .height = CURSOR_SIZE, .x = cursor_x, .y = cursor_y };
+    int bytes = (vbe_mode->bpp + 7) / 8;
+    uint32_t black = gui_rgb(0x000000), white = gui_rgb(0xFFFFFF);
+    uint8_t *save = save_under;
+
+    if(!rect_intersect(&box, &screen, &saved))
+        return;
+    for(int y = saved.y; y < saved.y + saved.height; y++) {
+        uint8_t *row = screen_pixel(saved.x, y, bytes);
+        for(int i = 0; i < saved.width * bytes; i++)
+            *save++ = row[i];
+        for(int x = saved.x; x < saved.x + saved.width; x++) {
+            char c = arrow[y - cursor_y][x - cursor_x];
+            if(c != '.') {
+                put_pixel(row + (x - saved.x) * bytes, c == 'X' ? black : white, bytes);
+                LFB_WRITTEN(bytes);
+            }
+        }
+    }
+    drawn = 1;
+}
+
+static void restore() {
+    int bytes = (vbe_mode->bpp + 7) / 8;
+    uint8_t *save = save_under;
+
+    if(!drawn)
+        return;
+    for(int y = saved.y; y < saved.y + saved.height; y++) {
+        uint8_t *row = screen_pixel(saved.x, y, bytes);
+        for(int i = 0; i < saved.width * bytes; i++)
+            row[i] = *save++;
+    }
+    LFB_WRITTEN(saved.width * saved.height * bytes);
+    drawn = 0;
+}
+
+void cursor_show(int x, int y) {
+    unsigned int flags = interrupts_save();
+    restore();
+    cursor_x = x;
+    cursor_y = y;
+    visible = 1;
+    if(!suspended)
+        draw();
+    interrupts_restore(flags);
+}
+
+void cursor_hide() {
+    unsigned int flags = interrupts_save();
+    restore();
+    visible = 0;
+    interrupts_restore(flags);
+}
+
+void cursor_move(int x, int y) {
+    unsigned int flags = interrupts_save();
+    if(x != cursor_x || y != cursor_y) {
+        restore();
+        cursor_x = x;
+        cursor_y = y;
+        if(visible && !suspended)
+            draw();
+    }
+    interrupts_restore(flags);
+}
+
+// takes the cursor off the screen until cursor_resume, moves only update its position
+void cursor_suspend() {
+    unsigned int flags = interrupts_save();
+    if(suspended++ == 0)
+        restore();
+    interrupts_restore(flags);
+}
+
+void cursor_resume() {
+    unsigned int flags = interrupts_save();
+    if(--suspended == 0 && visible)
+        draw();
+    interrupts_restore(flags);
+}
@@ -0,0 +1,12 @@
+#ifndef _CURSOR_H_
+#define _CURSOR_H_
+
+#define CURSOR_SIZE     16
+
+void cursor_show(int x, int y);
+void cursor_hide();
+void cursor_move(int x, int y);
+void cursor_suspend();
+void cursor_resume();
+
+#endif
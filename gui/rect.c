@@ -0,0 +1,131 @@
+#include "rect.h"
+
+int rect_empty(struct RECT *r) {
+    return r->width <= 0 || r->height <= 0;
+}
+
+// returns 0 and leaves out empty when a and b don't overlap
+int rect_intersect(struct RECT *a, struct RECT *b, struct RECT *out) {
+    int left = a->x > b->x ? a->x : b->x;
+    int top = a->y > b->y ? a->y : b->y;
+    int right = a->x + a->width < b->x + b->width ? a->x + a->width : b->x + b->width;
+    int bottom = a->y + a->height < b->y + b->height ? a->y + a->height : b->y + b->height;
+
+    out->x = left;
+    out->y = top;
+    out->width = right - left;
+    out->height = bottom - top;
+    return !rect_empty(out);
+}
+
+/* r minus hole as at most 4 disjoint pieces: full width bands above and
+*  below the hole, then what is left and right of it. Returns the count */
+int rect_subtract(struct RECT *r, struct RECT *hole, struct RECT *pieces) {
+    struct RECT overlap;
+    int count = 0;
+
+    if(!rect_intersect(r, hole, &overlap)) {
+        pieces[0] = *r;
+        return 1;
+    }
+    if(overlap.y > r->y) {
+        pieces[count].x = r->x;
+        pieces[count].y = r->y;
+        pieces[count].width = r->width;
+        pieces[count++].height = overlap.y - r->y;
+    }
+    if(overlap.y + overlap.height < r->y + r->height) {
+        pieces[count].x = r->x;
+        pieces[count].y = overlap.y + overlap.height;
+        pieces[count].width = r->width;
+        pieces[count++].height = r->y + r->height - (overlap.y + overlap.height);
+    }
+    if(overlap.x > r->x) {
+        pieces[count].x = r->x;
+        pieces[count].y = overlap.y;
+        pieces[count].width = overlap.x - r->x;
+        pieces[count++].height = overlap.height;
+    }
+    if(overlap.x + overlap.width < r->x + r->width) {
+        pieces[count].x = overlap.x + overlap.width;
+        pieces[count].y = overlap.y;
+        pieces[count].width = r->x + r->width - (overlap.x + overlap.width);
+        pieces[count++].height = overlap.height;
+    }
+    return count;
+}
+
+void rect_list_clear(struct RECT_LIST *list) {
+    list->count = 0;
+}
+
+// replaces the whole list with one rectangle covering it and r. drawing
+// a few pixels twice is cheaper than tracking unbounded fragments
+static void rect_list_collapse(struct RECT_LIST *list, struct RECT *r) {
+    int left = r->x, top = r->y;
+    int right = r->x + r->width, bottom = r->y + r->height;
+
+    for(int i = 0; i < list->count; i++) {
+        struct RECT *other = &list->rects[i];
+        if(other->x < left) left = other->x;
+        if(other->y < top) top = other->y;
+        if(other->x + other->width > right) right = other->x + other->width;
+        if(other->y + other->height > bottom) bottom = other->y + other->height;
+    }
+    list->count = 1;
+    list->rects[0].x = left;
+    list->rects[0].y = top;
+    list->rects[0].width = right - left;
+    list->rects[0].height = bottom - top;
+}
+
+// pieces of a new rectangle still to be checked against the list from
+// index 'first' on. every split replaces one entry with at most 4
+struct pending_rect {
+    struct RECT r;
+    int first;
+};
+static struct pending_rect pending[3 * MAX_DAMAGE_RECTS + 1];
+
+// adds only the parts of r the list doesn't cover yet. returns 0 if the list is full
+static int rect_list_add_disjoint(struct RECT_LIST *list, struct RECT *r) {
+    struct RECT pieces[4];
+    struct RECT overlap;
+    int top = 0;
+    int i, count;
+
+    pending[top].r = *r;
+    pending[top++].first = 0;
+    while(top > 0) {
+        struct pending_rect item = pending[--top];
+        for(i = item.first; i < list->count; i++)
+            if(rect_intersect(&item.r, &list->rects[i], &overlap))
+                break;
+        if(i == list->count) {
+            if(list->count == MAX_DAMAGE_RECTS)
+                return 0;
+            list->rects[list->count++] = item.r;
+            continue;
+        }
+        count = rect_subtract(&item.r, &list->rects[i], pieces);
+        for(int j = 0; j < count; j++) {
+            pending[top].r = pieces[j];
+            pending[top++].first = i + 1;
+        }
+    }
+    return 1;
+}
+
+void rect_list_add(struct RECT_LIST *list, struct RECT *r) {
+    if(rect_empty(r))
+        return;
+    if(!rect_list_add_disjoint(list, r))
+        rect_list_collapse(list, r);
+}
+
+unsigned int rect_list_area(struct RECT_LIST *list) {
+    unsigned int area = 0;
+    for(int i = 0; i < list->count; i++)
+        area += list->rects[i].width * list->rects[i].height;
+    return area;
+}
@@ -0,0 +1,27 @@
+#ifndef _RECT_H_
+#define _RECT_H_
+
+// damage rectangles per frame before the list collapses into its bounding box
+#define MAX_DAMAGE_RECTS    32
+
+struct RECT {
+    int width;
+    int height;
+    int x;
+    int y;
+};
+
+// disjoint rectangles, rect_list_add keeps it that way
+struct RECT_LIST {
+    int count;
+    struct RECT rects[MAX_DAMAGE_RECTS];
+};
+
+int rect_empty(struct RECT *r);
+int rect_intersect(struct RECT *a, struct RECT *b, struct RECT *out);
+int rect_subtract(struct RECT *r, struct RECT *hole, struct RECT *pieces);
+void rect_list_clear(struct RECT_LIST *list);
+void rect_list_add(struct RECT_LIST *list, struct RECT *r);
+unsigned int rect_list_area(struct RECT_LIST *list);
+
+#endif
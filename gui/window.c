@@ -0,0 +1,301 @@
+#include "window.h"
+#include "cursor.h"
+#include "../drivers/vesa_vbe/vbe.h"
+#include "../drivers/screen.h"
+#include "../kernel/memory.h"
+#include "../kernel/low_level.h"
+#include "../include/conversion.h"
+
+/* Compositor. Windows keep their contents in their own surfaces and
+*  changes only record damage, screen rectangles that need redrawing.
+*  compositor_flush then repaints just the damaged area: each damaged
+*  rectangle is handed down the window stack from the top, every window
+*  copies the part of it that it covers and passes on only what lies
+*  outside its frame. Pixels hidden behind another window are never
+*  drawn and every damaged pixel is written exactly once.
+*  All of this runs on one thread, nothing here takes a lock. Only the
+*  mouse cursor (gui/cursor.c) is drawn from elsewhere. */
+static struct WINDOW windows[MAX_WINDOWS];
+static struct WINDOW *top_window;
+static struct RECT_LIST damage;
+static struct RECT screen;
+static int pixel_bytes;
+static uint32_t desktop_pixel;
+static uint32_t pixels_drawn;       // for the benchmark
+static int next_window_id = 1;
+
+// a damaged rectangle and the highest window it may still hit
+struct paint_item {
+    struct RECT r;
+    struct WINDOW *w;
+};
+// each step pops one item and pushes at most 4 for a lower window
+static struct paint_item paint_stack[3 * MAX_WINDOWS + 1];
+
+static inline void copy_span(uint8_t *dest, uint8_t *src, uint32_t length) {
+    uint32_t words = length / 4, bytes = length & 3;
+
+    __asm__ __volatile__("rep movsl" : "+D"(dest), "+S"(src), "+c"(words) : : "memory");
+    __asm__ __volatile__("rep movsb" : "+D"(dest), "+S"(src), "+c"(bytes) : : "memory");
+}
+
+static void fill_span(uint8_t *dest, uint32_t pixel, int count) {
+    if(pixel_bytes == 4) {
+        __asm__ __volatile__("rep stosl" : "+D"(dest), "+c"(count) : "a"(pixel) : "memory");
+    } else if(pixel_bytes == 3) {
+        for(int i = 0; i < count; i++, dest += 3) {
+            dest[0] = pixel;
+            dest[1] = pixel >> 8;
+            dest[2] = pixel >> 16;
+        }
+    } else {
+        for(int i = 0; i < count; i++)
+            ((uint16_t*)dest)[i] = pixel;
+    }
+}
+
+// 0xRRGGBB to the screen's pixel format
+uint32_t gui_rgb(uint32_t rgb) {
+    uint32_t r = (rgb >> 16) & 0xFF, g = (rgb >> 8) & 0xFF, b = rgb & 0xFF;
+    return ((r >> (8 - vbe_mode->red_mask)) << vbe_mode->red_position)
+         | ((g >> (8 - vbe_mode->green_mask)) << vbe_mode->green_position)
+         | ((b >> (8 - vbe_mode->blue_mask)) << vbe_mode->blue_position);
+}
+
+static inline uint8_t *screen_pixel(int x, int y) {
+    return (uint8_t*)(uintptr_t)vbe_mode->framebuffer + y * vbe_mode->pitch + x * pixel_bytes;
+}
+
+static void fill_background(struct RECT *r) {
+    for(int y = r->y; y < r->y + r->height; y++)
+        fill_span(screen_pixel(r->x, y), desktop_pixel, r->width);
+    pixels_drawn += r->width * r->height;
+    LFB_WRITTEN(r->width * r->height * pixel_bytes);
+}
+
+// r is in screen coordinates and inside w's frame
+static void copy_from_surface(struct WINDOW *w, struct RECT *r) {
+    uint8_t *src = w->surface + (r->y - w->frame.y) * w->pitch + (r->x - w->frame.x) * pixel_bytes;
+
+    for(int y = r->y; y < r->y + r->height; y++, src += w->pitch)
+        copy_span(screen_pixel(r->x, y), src, r->width * pixel_bytes);
+    pixels_drawn += r->width * r->height;
+    LFB_WRITTEN(r->width * r->height * pixel_bytes);
+}
+
+static void paint(struct RECT *r) {
+    struct RECT pieces[4];
+    struct RECT visible;
+    struct paint_item item;
+    int top = 0;
+    int count;
+
+    paint_stack[top].r = *r;
+    paint_stack[top++].w = top_window;
+    while(top > 0) {
+        item = paint_stack[--top];
+        while(item.w && !rect_intersect(&item.r, &item.w->frame, &visible))
+            item.w = item.w->below;
+        if(item.w == 0) {
+            fill_background(&item.r);
+            continue;
+        }
+        copy_from_surface(item.w, &visible);
+        count = rect_subtract(&item.r, &item.w->frame, pieces);
+        for(int i = 0; i < count; i++) {
+            paint_stack[top].r = pieces[i];
+            paint_stack[top++].w = item.w->below;
+        }
+    }
+}
+
+void compositor_init() {
+    pixel_bytes = (vbe_mode->bpp + 7) / 8;
+    screen.x = 0;
+    screen.y = 0;
+    screen.width = vbe_mode->width;
+    screen.height = vbe_mode->height;
+    desktop_pixel = gui_rgb(DESKTOP_COLOR);
+    rect_list_clear(&damage);
+    compositor_damage(&screen);
+}
+
+// r is in screen coordinates, whatever lies off screen is dropped
+void compositor_damage(struct RECT *r) {
+    struct RECT clipped;
+
+    if(rect_intersect(r, &screen, &clipped))
+        rect_list_add(&damage, &clipped);
+}
+
+// redraws everything damaged since the last flush
+void compositor_flush() {
+    if(damage.count == 0)
+        return;
+    cursor_suspend();
+    for(int i = 0; i < damage.count; i++)
+        paint(&damage.rects[i]);
+    rect_list_clear(&damage);
+    cursor_resume();
+}
+
+static void stack_unlink(struct WINDOW *w) {
+    if(w->above)
+        w->above->below = w->below;
+    else
+        top_window = w->below;
+    if(w->below)
+        w->below->above = w->above;
+    w->above = w->below = 0;
+}
+
+static void stack_push_top(struct WINDOW *w) {
+    w->below = top_window;
+    w->above = 0;
+    if(top_window)
+        top_window->above = w;
+    top_window = w;
+}
+
+/* A new window on top of the stack, filled with color under a title bar.
+*  Returns 0 when there is no free slot or no memory for the surface */
+struct WINDOW *window_create(int x, int y, int width, int height, uint32_t color) {
+    struct WINDOW *w = 0;
+    struct RECT title = { .width = width, .height = TITLE_BAR_HEIGHT, .x = 0, .y = 0 };
+    struct RECT body = { .width = width, .height = height - TITLE_BAR_HEIGHT, .x = 0, .y = TITLE_BAR_HEIGHT };
+    uint32_t surface;
+
+    if(width <= 0 || height <= 0)
+        return 0;
+    if(pixel_bytes == 0)
+        compositor_init();
+    for(int i = 0; i < MAX_WINDOWS; i++) {
+        if(windows[i].surface == 0) {
+            w = &windows[i];
+            break;
+        }
+    }
+    if(w == 0)
+        return 0;
+
+    w->pitch = width * pixel_bytes;
+    w->pages = PAGE_ALIGN_UP(w->pitch * height) / PAGE_SIZE;
+    surface = frame_alloc_contiguous(w->pages);
+    if(surface == 0)
+        return 0;
+    w->surface = (uint8_t*)(uintptr_t)surface;
+    w->id = next_window_id++;
+    w->frame.x = x;
+    w->frame.y = y;
+    w->frame.width = width;
+    w->frame.height = height;
+    stack_push_top(w);
+
+    window_fill(w, &title, TITLE_BAR_COLOR);
+    window_fill(w, &body, color);
+    return w;
+}
+
+void window_destroy(struct WINDOW *w) {
+    stack_unlink(w);
+    compositor_damage(&w->frame);
+    frame_free_contiguous((uint32_t)(uintptr_t)w->surface, w->pages);
+    w->surface = 0;
+}
+
+// only the old and the new frame are repainted, the surface is unchanged
+void window_move(struct WINDOW *w, int x, int y) {
+    compositor_damage(&w->frame);
+    w->frame.x = x;
+    w->frame.y = y;
+    compositor_damage(&w->frame);
+}
+
+void window_raise(struct WINDOW *w) {
+    if(w == top_window)
+        return;
+    stack_unlink(w);
+    stack_push_top(w);
+    compositor_damage(&w->frame);
+}
+
+// r is relative to the window, color is 0xRRGGBB
+void window_fill(struct WINDOW *w, struct RECT *r, uint32_t color) {
+    struct RECT bounds = { .width = w->frame.width, .height = w->frame.height, .x = 0, .y = 0 };
+    struct RECT clipped;
+    uint32_t pixel = gui_rgb(color);
+
+    if(!rect_intersect(r, &bounds, &clipped))
+        return;
+    for(int y = clipped.y; y < clipped.y + clipped.height; y++)
+        fill_span(w->surface + y * w->pitch + clipped.x * pixel_bytes, pixel, clipped.width);
+    window_damage(w, &clipped);
+}
+
+// marks part of the window's surface as changed, r is relative to the window
+void window_damage(struct WINDOW *w, struct RECT *r) {
+    struct RECT moved = *r;
+    struct RECT clipped;
+
+    moved.x += w->frame.x;
+    moved.y += w->frame.y;
+    if(rect_intersect(&moved, &w->frame, &clipped))
+        compositor_damage(&clipped);
+}
+
+/* a window dragged across three others, against repainting the whole
+*  screen every frame */
+#define BENCH_FRAMES 50
+#define BENCH_WINDOWS 4
+
+void gui_benchmark() {
+    static const uint32_t colors[BENCH_WINDOWS] = { 0xC0C0C0, 0x808000, 0x008080, 0xE0E0E0 };
+    struct WINDOW *bench[BENCH_WINDOWS];
+    unsigned long long start;
+    uint32_t move_cycles, move_pixels, full_cycles, full_pixels;
+    int i;
+
+    compositor_init();
+    for(i = 0; i < BENCH_WINDOWS; i++) {
+        bench[i] = window_create(40 + i * 60, 40 + i * 40, 240, 180, colors[i]);
+        if(bench[i] == 0) {
+            printf("not enough memory for the windows\n", -1, -1);
+            while(--i >= 0)
+                window_destroy(bench[i]);
+            return;
+        }
+    }
+    compositor_flush();
+
+    pixels_drawn = 0;
+    start = rdtsc();
+    for(i = 0; i < BENCH_FRAMES; i++) {
+        window_move(bench[BENCH_WINDOWS - 1], 220 + i * 4, 160 + i * 2);
+        compositor_flush();
+    }
+    move_cycles = (uint32_t)divide64(rdtsc() - start, BENCH_FRAMES, 0);
+    move_pixels = pixels_drawn / BENCH_FRAMES;
+
+    pixels_drawn = 0;
+    start = rdtsc();
+    for(i = 0; i < BENCH_FRAMES; i++) {
+        compositor_damage(&screen);
+        compositor_flush();
+    }
+    full_cycles = (uint32_t)divide64(rdtsc() - start, BENCH_FRAMES, 0);
+    full_pixels = pixels_drawn / BENCH_FRAMES;
+
+    for(i = 0; i < BENCH_WINDOWS; i++)
+        window_destroy(bench[i]);
+    compositor_flush();
+
+    printf("window move: ", -1, -1);
+    printf(itoa(move_cycles), -1, -1);
+    printf(" cycles, ", -1, -1);
+    printf(itoa(move_pixels), -1, -1);
+    printf(" pixels per frame\nfull repaint: ", -1, -1);
+    printf(itoa(full_cycles), -1, -1);
+    printf(" cycles, ", -1, -1);
+    printf(itoa(full_pixels), -1, -1);
+    printf(" pixels per frame\n", -1, -1);
+}
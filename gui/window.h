@@ -1,15 +1,39 @@
 #ifndef _WINDOW_H_
 #define _WINDOW_H_
 
-struct RECT {
-    int width;
-    int height;
-    int x;
-    int y;
-};
+#include "../include/types.h"
+#include "rect.h"
+
+#define MAX_WINDOWS         16
+#define TITLE_BAR_HEIGHT    16
+
+#define DESKTOP_COLOR       0x3A6EA5
+#define TITLE_BAR_COLOR     0x000080
 
+// a window owns a surface in the screen's own pixel format, so composing
+// it onto the framebuffer is a plain copy of the visible spans
 struct WINDOW {
-    
+    int id;
+    struct RECT frame;              // position and size on screen
+    uint8_t *surface;
+    uint32_t pitch;                 // bytes per surface row
+    uint32_t pages;                 // frames behind the surface
+    struct WINDOW *above;           // z order, bottom to top
+    struct WINDOW *below;
 };
 
+void compositor_init();
+void compositor_damage(struct RECT *r);
+void compositor_flush();
+uint32_t gui_rgb(uint32_t rgb);
+
+struct WINDOW *window_create(int x, int y, int width, int height, uint32_t color);
+void window_destroy(struct WINDOW *w);
+void window_move(struct WINDOW *w, int x, int y);
+void window_raise(struct WINDOW *w);
+void window_fill(struct WINDOW *w, struct RECT *r, uint32_t color);
+void window_damage(struct WINDOW *w, struct RECT *r);
+
+void gui_benchmark();
+
 #endif
\ No newline at end of file
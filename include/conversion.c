@@ -1,30 +1,20 @@
 #include "conversion.h"
 
+// the string lives in a static buffer, it is only good until the next call
 char *itoa(int digit) {
-    int i, remainder = 0;      // to store the last digit
-    char *numbers;       // converted integer to chars stoarge
-    int count_d = i = count_digit(digit);
+    static char numbers[12];            // "-2147483648" and the terminator
+    char *p = numbers + sizeof(numbers) - 1;
+    unsigned int value = digit < 0 ? -(unsigned int)digit : digit;
 
-    if(count_d > 0 && count_d < 2) {        // check if the digit is one, then convert.
-        *numbers = digit + '0';
-        *(numbers+1) = '\0';
-        return numbers;
-    } // otherwise the digit is more than one
-
-    // the first thing you must do is reverse the number.
-    // by invoking the reverse_Number func
-    // digit = reverse_number(digit);
-    while(digit > 0) {
-        // Get the last digit
-        remainder = digit % 10;
-        numbers[i-1] = remainder + '0';       // add the ascii value of '0' character to get its character equlivalent.
-        digit /= 10;                        // divide the digit by 10 to proceed with the number digit
-        if(digit == 0) {
-            numbers[count_d] = '\0';
-        }
-        i--;                                // incrementing i
-    }
-    return numbers;
+    *p = '\0';
+    // fill in from the last digit backwards
+    do {
+        *--p = value % 10 + '0';
+        value /= 10;
+    } while(value > 0);
+    if(digit < 0)
+        *--p = '-';
+    return p;
 }
 
 int reverse_number(int digit) { 
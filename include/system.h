@@ -32,7 +32,6 @@ extern void putch(unsigned char c);
 extern void cls();
 
 /* GDT.C */
-extern void gdt_set_gate(int num, unsigned long base, unsigned long limit, unsigned char access, unsigned char gran);
 extern void gdt_install();
 
 /* IDT.C */
@@ -43,9 +42,13 @@ extern void idt_install();
 extern void isrs_install();
 
 /* IRQ.C */
-extern void irq_install_handler(int irq, void (*handler)(struct regs *r));
+typedef void (*irq_handler_t)(struct regs *r);
+extern void irq_install_handler(int irq, irq_handler_t handler);
+extern void irq_remove_handler(int irq, irq_handler_t handler);
 extern void irq_uninstall_handler(int irq);
 extern void irq_install();
+extern unsigned int irq_round_trip();
+extern void irq_benchmark();
 
 /* TIMER.C */
 extern void timer_wait(int ticks);
@@ -6,6 +6,8 @@
 
 typedef unsigned short int uint16_t;
 typedef unsigned int uint32_t;
+typedef unsigned long long uint64_t;
+typedef unsigned long uintptr_t;       // pointer sized, in the host build too
 typedef unsigned char uint8_t;
 typedef unsigned char byte;
 
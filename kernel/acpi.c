@@ -0,0 +1,69 @@
+#include "acpi.h"
+
+static struct rsdp *rsdp;
+static struct acpi_sdt_header *rsdt;
+
+static int checksum_ok(void *table, int length) {
+    uint8_t sum = 0;
+    uint8_t *p = (uint8_t*)table;
+    for(int i = 0; i < length; i++)
+        sum += p[i];
+    return sum == 0;
+}
+
+static int signature_is(char *signature, char *expected, int length) {
+    for(int i = 0; i < length; i++)
+        if(signature[i] != expected[i])
+            return 0;
+    return 1;
+}
+
+// the RSDP sits on a 16 byte boundary in the given physical range
+static struct rsdp *rsdp_scan(uint32_t start, uint32_t end) {
+    for(uint32_t addr = start; addr < end; addr += 16) {
+        struct rsdp *r = (struct rsdp*)addr;
+        if(signature_is(r->signature, "RSD PTR ", 8) && checksum_ok(r, sizeof(struct rsdp)))
+            return r;
+    }
+    return 0;
+}
+
+// finds the root table, first in the EBDA, then in the BIOS area below 1 MB.
+// later calls just report whether the first one found it
+int acpi_init() {
+    uint32_t ebda = (uint32_t)(*(uint16_t*)0x40E) << 4;
+
+    if(rsdt)
+        return 1;
+    if(ebda)
+        rsdp = rsdp_scan(ebda, ebda + 1024);
+    if(rsdp == 0)
+        rsdp = rsdp_scan(0xE0000, 0x100000);
+    if(rsdp == 0)
+        return 0;
+
+    rsdt = (struct acpi_sdt_header*)rsdp->rsdt_address;
+    if(!signature_is(rsdt->signature, "RSDT", 4) || !checksum_ok(rsdt, rsdt->length)) {
+        rsdt = 0;
+        return 0;
+    }
+    return 1;
+}
+
+// returns the table with the given four letter signature, e.g. "APIC" for the MADT
+struct acpi_sdt_header *acpi_find_table(char *signature) {
+    uint32_t *entries;
+    int count;
+
+    if(rsdt == 0)
+        return 0;
+
+    entries = (uint32_t*)(rsdt + 1);
+    count = (rsdt->length - sizeof(struct acpi_sdt_header)) / 4;
+    for(int i = 0; i < count; i++) {
+        struct acpi_sdt_header *table = (struct acpi_sdt_header*)entries[i];
+        if(signature_is(table->signature, signature, 4) && checksum_ok(table, table->length))
+            return table;
+    }
+    return 0;
+}
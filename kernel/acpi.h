@@ -0,0 +1,83 @@
+#ifndef _ACPI_H_
+#define _ACPI_H_
+
+#include "../include/types.h"
+
+struct rsdp {
+    char signature[8];          // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed));
+
+// header shared by every system description table
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+struct madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+} __attribute__((packed));
+
+// MADT entries follow the struct madt, each starts with type and length
+#define MADT_LAPIC              0
+#define MADT_IOAPIC             1
+#define MADT_LAPIC_OVERRIDE     5
+
+#define MADT_LAPIC_ENABLED      0x1
+
+struct madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct madt_lapic {
+    struct madt_entry entry;
+    uint8_t acpi_cpu_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+struct madt_ioapic {
+    struct madt_entry entry;
+    uint8_t ioapic_id;
+    uint8_t reserved;
+    uint32_t address;
+    uint32_t gsi_base;
+} __attribute__((packed));
+
+struct madt_lapic_override {
+    struct madt_entry entry;
+    uint16_t reserved;
+    uint64_t address;
+} __attribute__((packed));
+
+// PCI express memory mapped configuration space, one entry per segment group
+struct mcfg {
+    struct acpi_sdt_header header;
+    uint64_t reserved;
+} __attribute__((packed));
+
+struct mcfg_entry {
+    uint64_t base;
+    uint16_t segment;
+    uint8_t start_bus;
+    uint8_t end_bus;
+    uint32_t reserved;
+} __attribute__((packed));
+
+int acpi_init();
+struct acpi_sdt_header *acpi_find_table(char *signature);
+
+#endif
@@ -0,0 +1,86 @@
+#include "apic.h"
+#include "spinlock.h"
+#include "../drivers/timer.h"
+
+uint32_t lapic_base = LAPIC_DEFAULT_BASE;
+int lapic_enabled;
+uint32_t lapic_timer_hz;               // input clock of the local timers, after the divider
+
+// the ICR is written in two halves, two cpus sending at once would mix them up
+static struct spinlock icr_lock = SPINLOCK_INIT;
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return *(volatile uint32_t*)(lapic_base + reg);
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(lapic_base + reg) = value;
+}
+
+// software enables the calling cpu's local APIC and routes spurious interrupts
+void lapic_enable() {
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    lapic_enabled = 1;
+}
+
+int lapic_id() {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi() {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static void lapic_send(int apic_id, uint32_t command) {
+    unsigned int flags = spin_lock_irqsave(&icr_lock);
+
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while(lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING)
+        __asm__ __volatile__("pause");
+
+    spin_unlock_irqrestore(&icr_lock, flags);
+}
+
+void lapic_send_init(int apic_id) {
+    lapic_send(apic_id, ICR_INIT | ICR_LEVEL_ASSERT | ICR_LEVEL_TRIGGER);
+    lapic_send(apic_id, ICR_INIT | ICR_LEVEL_TRIGGER);
+}
+
+// the AP starts executing in real mode at trampoline, which must be page aligned and below 1 MB
+void lapic_send_startup(int apic_id, uint32_t trampoline) {
+    lapic_send(apic_id, ICR_STARTUP | (trampoline >> 12));
+}
+
+void lapic_send_ipi_others(int vector) {
+    lapic_send(0, ICR_ALL_BUT_SELF | ICR_LEVEL_ASSERT | vector);
+}
+
+/* Lets the calling cpu's timer count down for 10 ms of TSC time. Every
+*  local APIC counts the same bus clock, so one calibration does for all */
+uint32_t lapic_timer_calibrate() {
+    uint32_t elapsed;
+
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    udelay(10000);
+    elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+    lapic_timer_hz = elapsed * 100;
+    return lapic_timer_hz;
+}
+
+// interrupts the calling cpu on vector hz times a second, lapic_timer_calibrate must have run
+void lapic_timer_periodic(int vector, uint32_t hz) {
+    uint32_t count = lapic_timer_hz / hz;
+
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | vector);
+    lapic_write(LAPIC_TIMER_INITIAL, count ? count : 1);
+}
+
+void lapic_timer_stop() {
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+}
@@ -0,0 +1,54 @@
+#ifndef _APIC_H_
+#define _APIC_H_
+
+#include "../include/types.h"
+
+#define LAPIC_DEFAULT_BASE      0xFEE00000
+
+// local APIC registers, offsets from the MMIO base
+#define LAPIC_ID                0x020
+#define LAPIC_EOI               0x0B0
+#define LAPIC_SVR               0x0F0
+#define LAPIC_ICR_LOW           0x300
+#define LAPIC_ICR_HIGH          0x310
+#define LAPIC_LVT_TIMER         0x320
+#define LAPIC_TIMER_INITIAL     0x380
+#define LAPIC_TIMER_CURRENT     0x390
+#define LAPIC_TIMER_DIVIDE      0x3E0
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_ICR_PENDING       0x1000
+#define LAPIC_LVT_MASKED        0x10000
+#define LAPIC_TIMER_PERIODIC    0x20000
+#define LAPIC_TIMER_DIVIDE_16   0x3
+
+#define ICR_INIT                0x00000500
+#define ICR_STARTUP             0x00000600
+#define ICR_LEVEL_ASSERT        0x00004000
+#define ICR_LEVEL_TRIGGER       0x00008000
+#define ICR_ALL_BUT_SELF        0x000C0000
+
+// interrupt vectors owned by the local APIC, above the remapped PIC range.
+// MSI vectors are handed out to PCI devices by kernel/pci.c
+#define MSI_VECTOR_BASE         0x30
+#define MSI_VECTORS             16
+#define PROFILE_VECTOR          0xE0    // local timer of the sampling profiler
+#define PROFILE_IPI_VECTOR      0xE1    // tells the other cpus to start or stop theirs
+#define IPI_WAKEUP_VECTOR       0xF0
+#define LAPIC_SPURIOUS_VECTOR   0xFF
+
+extern uint32_t lapic_base;
+extern int lapic_enabled;
+extern uint32_t lapic_timer_hz;
+
+void lapic_enable();
+int lapic_id();
+void lapic_eoi();
+void lapic_send_init(int apic_id);
+void lapic_send_startup(int apic_id, uint32_t trampoline);
+void lapic_send_ipi_others(int vector);
+uint32_t lapic_timer_calibrate();
+void lapic_timer_periodic(int vector, uint32_t hz);
+void lapic_timer_stop();
+
+#endif
@@ -0,0 +1,226 @@
+#include "bench.h"
+#include "low_level.h"
+#include "memory.h"
+#include "percpu.h"
+#include "sched.h"
+#include "printk.h"
+#include "../include/system.h"
+#include "../drivers/screen.h"
+#include "../drivers/serial.h"
+#include "../drivers/timer.h"
+#include "../drivers/vesa_vbe/vbe.h"
+#include "../drivers/vesa_vbe/bmp.h"
+#include "../tools/utils.h"
+#include "../net/net.h"
+
+/* Benchmark suite. Every entry of the registry below is measured
+*  BENCH_RUNS times and reported on the serial line as one line
+*  scripts/benchdiff.py reads:
+*    bench begin <tsc_per_us> <cpus>
+*    B <name> <min> <median> <unit>
+*    bench <name> failed | skipped
+*    bench end
+*  The benchmark build of the kernel (make bench) runs the suite from
+*  bench_thread on boot and powers QEMU off through isa-debug-exit, the
+*  bench terminal command runs it on a live system. The lines go out
+*  through printk, to the netlog sink as well once that ran. */
+
+/* --- the benchmarks, each returns cycles per operation --- */
+
+#define MEMCPY_BYTES    65536
+#define MEMCPY_PAGES    (MEMCPY_BYTES / PAGE_SIZE)
+
+static uint32_t bench_memcpy() {
+    static char *source, *dest;
+    unsigned long long start;
+
+    if(source == 0) {
+        source = (char*)frame_alloc_contiguous(MEMCPY_PAGES);
+        dest = (char*)frame_alloc_contiguous(MEMCPY_PAGES);
+        if(source == 0 || dest == 0)
+            return 0;
+    }
+    start = rdtsc();
+    memory_copy(source, dest, MEMCPY_BYTES);
+    return (uint32_t)divide64(rdtsc() - start, MEMCPY_BYTES / 1024, 0);
+}
+
+// a full row of the text console, written character by character
+#define PRINT_LINES     16
+
+static uint32_t bench_print() {
+    unsigned long long start = rdtsc();
+
+    for(int line = 0; line < PRINT_LINES; line++)
+        for(int col = 0; col < MAX_COLS; col++)
+            print_char('a' + (col + line) % 26, col, 0, 0);
+    return (uint32_t)divide64(rdtsc() - start, PRINT_LINES, 0);
+}
+
+// the text console moved up a row, as when the cursor runs off the bottom
+#define SCROLLS         16
+
+static uint32_t bench_scroll() {
+    unsigned long long start = rdtsc();
+
+    for(int i = 0; i < SCROLLS; i++)
+        handling_scrolling(MAX_ROWS * MAX_COLS * 2);
+    return (uint32_t)divide64(rdtsc() - start, SCROLLS, 0);
+}
+
+/* a 256x256 24 bit BMP decoded to the framebuffer, built in memory so
+*  the suite doesn't depend on the initrd's pictures */
+#define BLIT_SIZE       256
+#define BLIT_OFFSET     (sizeof(struct bmp_header) + 40)
+#define BLIT_BYTES      (BLIT_OFFSET + BLIT_SIZE * BLIT_SIZE * 3)
+#define BLITS           4
+
+static uint32_t bench_blit() {
+    static uint8_t *image;
+    struct bmp_header *file;
+    struct dib_header *dib;
+    unsigned long long start;
+
+    if(image == 0) {
+        image = (uint8_t*)frame_alloc_contiguous(PAGE_ALIGN_UP(BLIT_BYTES) / PAGE_SIZE);
+        if(image == 0)
+            return 0;
+        file = (struct bmp_header*)image;
+        dib = (struct dib_header*)(image + sizeof(struct bmp_header));
+        file->type = BMP_MAGIC;
+        file->size = BLIT_BYTES;
+        file->reserved = 0;
+        file->offset = BLIT_OFFSET;
+        dib->headerSize = 40;
+        dib->width = BLIT_SIZE;
+        dib->height = BLIT_SIZE;
+        dib->color_planes = 1;
+        dib->colorDepth = 24;
+        dib->compression = BI_RGB;
+        dib->image_size = BLIT_SIZE * BLIT_SIZE * 3;
+        dib->horizontal_resolution = 0;
+        dib->vertical_resolution = 0;
+        dib->color_num = 0;
+        dib->importantCol = 0;
+        for(uint32_t i = BLIT_OFFSET; i < BLIT_BYTES; i++)
+            image[i] = i * 7;
+    }
+    // a linear graphics mode the rows fit in, not whatever a text mode left behind
+    if(vbe_mode->framebuffer == 0 || vbe_mode->bpp < 15 || vbe_mode->width == 0
+       || vbe_mode->pitch < vbe_mode->width * ((vbe_mode->bpp + 7) / 8))
+        return 0;
+    start = rdtsc();
+    for(int i = 0; i < BLITS; i++)
+        bmp_draw(image, BLIT_BYTES, 0, 0);
+    return (uint32_t)divide64(rdtsc() - start, BLITS, 0);
+}
+
+static uint32_t bench_irq() {
+    return irq_round_trip();
+}
+
+static uint32_t bench_switch() {
+    return sched_switch_cycles();
+}
+
+// a 1 KB datagram to the gateway, under make bench QEMU's user mode network
+static uint32_t bench_udp() {
+    return net_send_cycles(1);
+}
+
+// make bench NET= runs without the card
+static int bench_udp_available() {
+    return net_get() != 0;
+}
+
+// a page frame taken and given back, and a 64 KB contiguous run
+#define ALLOCS          1000
+
+static uint32_t bench_frame_alloc() {
+    unsigned long long start = rdtsc();
+
+    for(int i = 0; i < ALLOCS; i++)
+        frame_free(frame_alloc());
+    return (uint32_t)divide64(rdtsc() - start, ALLOCS, 0);
+}
+
+static uint32_t bench_frame_alloc_contiguous() {
+    unsigned long long start = rdtsc();
+
+    for(int i = 0; i < ALLOCS / 10; i++) {
+        uint32_t run = frame_alloc_contiguous(16);
+        if(run)
+            frame_free_contiguous(run, 16);
+    }
+    return (uint32_t)divide64(rdtsc() - start, ALLOCS / 10, 0);
+}
+
+static const struct benchmark benchmarks[] = {
+    { "memcpy",             "cycles/KB",     bench_memcpy },
+    { "console_print",      "cycles/line",   bench_print },
+    { "console_scroll",     "cycles/scroll", bench_scroll },
+    { "bmp_blit",           "cycles/frame",  bench_blit },
+    { "irq_round_trip",     "cycles",        bench_irq },
+    { "context_switch",     "cycles",        bench_switch },
+    { "frame_alloc",        "cycles",        bench_frame_alloc },
+    { "frame_alloc_64k",    "cycles",        bench_frame_alloc_contiguous },
+    { "udp_send",           "cycles",        bench_udp, bench_udp_available },
+};
+
+#define BENCHMARKS      (int)(sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/* --- running them --- */
+
+static void sort(uint32_t *values, int count) {
+    for(int i = 1; i < count; i++)
+        for(int j = i; j > 0 && values[j - 1] > values[j]; j--) {
+            uint32_t swap = values[j];
+            values[j] = values[j - 1];
+            values[j - 1] = swap;
+        }
+}
+
+/* Runs every benchmark and prints its line. Returns the number that
+*  failed, a 0 measurement means the benchmark couldn't run. Skipped
+*  ones don't count */
+int bench_run_all() {
+    uint32_t values[BENCH_RUNS];
+    int failed = 0;
+
+    printk("bench begin %u %d\n", tsc_per_us, cpu_count > 0 ? cpu_count : 1);
+    for(int i = 0; i < BENCHMARKS; i++) {
+        const struct benchmark *b = &benchmarks[i];
+
+        if(b->available && !b->available()) {
+            printk("bench %s skipped\n", b->name);
+            continue;
+        }
+        for(int run = 0; run < BENCH_RUNS; run++)
+            values[run] = b->run();
+        sort(values, BENCH_RUNS);
+        if(values[0] == 0) {
+            failed++;
+            printk("bench %s failed\n", b->name);
+        } else {
+            printk("B %s %u %u %s\n", b->name, values[0], values[BENCH_RUNS / 2], b->unit);
+        }
+    }
+    printk("bench end\n");
+    return failed;
+}
+
+// makes QEMU exit once everything logged so far is out on the serial line
+void bench_exit(int code) {
+    printk_flush();
+    serial_flush();
+    port_dword_out(BENCH_EXIT_PORT, code);
+    // not under QEMU, or without the device
+    __asm__ __volatile__("cli");
+    while(1)
+        __asm__ __volatile__("hlt");
+}
+
+// started by the benchmark build of the kernel in place of the desktop
+void bench_thread(void *arg) {
+    bench_exit(bench_run_all() ? BENCH_EXIT_FAILURE : BENCH_EXIT_SUCCESS);
+}
@@ -0,0 +1,28 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include "../include/types.h"
+
+#define BENCH_RUNS          5           // measurements per benchmark, the median is reported
+
+// QEMU's isa-debug-exit device (-device isa-debug-exit,iobase=0xf4,iosize=0x04)
+// exits with status (value << 1) | 1
+#define BENCH_EXIT_PORT     0xF4
+#define BENCH_EXIT_SUCCESS  0
+#define BENCH_EXIT_FAILURE  1
+
+/* one microbenchmark, run returns a single measurement in unit, lower is
+*  better. available, if there is one, says whether the hardware it
+*  measures is there at all; without it the benchmark is skipped */
+typedef struct benchmark {
+    const char *name;
+    const char *unit;
+    uint32_t (*run)();
+    int (*available)();
+} benchmark;
+
+int bench_run_all();
+void bench_exit(int code);
+void bench_thread(void *arg);
+
+#endif
@@ -0,0 +1,48 @@
+#include "elf.h"
+#include "process.h"
+#include "paging.h"
+#include "memory.h"
+
+/* Loading only checks the headers and records one region per PT_LOAD
+*  segment. Nothing is copied or mapped here, the page fault handler
+*  brings pages in from the archive as the program touches them, so
+*  starting a program costs the same whatever its size. */
+int elf_load(struct process *p, uint8_t *image, uint32_t size) {
+    elf32_ehdr *header = (elf32_ehdr*)image;
+    elf32_phdr *ph;
+
+    if(size < sizeof(elf32_ehdr) || header->e_magic != ELF_MAGIC)
+        return 0;
+    if(header->e_class != ELFCLASS32 || header->e_data != ELFDATA2LSB)
+        return 0;
+    if(header->e_type != ET_EXEC || header->e_machine != EM_386)
+        return 0;
+    // the program header table inside the image, worked out so nothing wraps
+    if(header->e_phentsize < sizeof(elf32_phdr) || header->e_phoff > size
+       || header->e_phnum > (size - header->e_phoff) / header->e_phentsize)
+        return 0;
+
+    for(int i = 0; i < header->e_phnum; i++) {
+        ph = (elf32_phdr*)(image + header->e_phoff + i * header->e_phentsize);
+        if(ph->p_type != PT_LOAD || ph->p_memsz == 0)
+            continue;
+
+        // user space only, file bytes inside the image, and offsets that
+        // line up with addresses within a page so pages can be shared.
+        // sizes are compared with the room left so the sums can't wrap
+        if(ph->p_vaddr < USER_BASE || ph->p_vaddr > USER_STACK_TOP - USER_STACK_SIZE
+           || ph->p_memsz > USER_STACK_TOP - USER_STACK_SIZE - ph->p_vaddr)
+            return 0;
+        if(ph->p_offset > size || ph->p_filesz > size - ph->p_offset || ph->p_filesz > ph->p_memsz)
+            return 0;
+        if((ph->p_offset & (PAGE_SIZE - 1)) != (ph->p_vaddr & (PAGE_SIZE - 1)))
+            return 0;
+
+        if(!process_add_region(p, ph->p_vaddr, ph->p_vaddr + ph->p_memsz,
+                               image + ph->p_offset, ph->p_filesz, ph->p_flags & PF_W))
+            return 0;
+    }
+
+    p->entry = header->e_entry;
+    return p->entry >= USER_BASE && p->entry < USER_END;
+}
@@ -0,0 +1,64 @@
+/* Global Descriptor Table management, one table per cpu.
+*  The bootloader's GDT (boot/gdt.asm) only has flat code and data
+*  segments. Once we are running C code every cpu switches to its own
+*  table, which adds ring 3 code and data, the cpu's TSS and a small
+*  data segment whose base is the cpu's struct cpu, loaded into gs. */
+#include "gdt.h"
+#include "percpu.h"
+
+struct cpu cpus[MAX_CPUS];
+int cpu_count = 1;
+
+/* This is in boot/interrups.asm, it loads the table and reloads
+*  cs, ds, es, fs and ss */
+extern void gdt_flush(struct gdt_ptr *gp);
+
+/* Setup a descriptor in the given Global Descriptor Table */
+void gdt_set_gate(struct gdt_entry *gdt, int num, unsigned long base, unsigned long limit, unsigned char access, unsigned char gran)
+{
+    /* Setup the descriptor base address */
+    gdt[num].base_low = (base & 0xFFFF);
+    gdt[num].base_middle = (base >> 16) & 0xFF;
+    gdt[num].base_high = (base >> 24) & 0xFF;
+
+    /* Setup the descriptor limits */
+    gdt[num].limit_low = (limit & 0xFFFF);
+    gdt[num].granularity = ((limit >> 16) & 0x0F);
+
+    /* Finally, set up the granularity and access flags */
+    gdt[num].granularity |= (gran & 0xF0);
+    gdt[num].access = access;
+}
+
+/* Builds the cpu's table, loads it and points gs and the task
+*  register at this cpu's data */
+void gdt_install_cpu(struct cpu *c)
+{
+    c->self = c;
+
+    c->tss.ss0 = GDT_KERNEL_DATA;
+    c->tss.iomap_base = sizeof(struct tss_entry);
+
+    gdt_set_gate(c->gdt, 0, 0, 0, 0, 0);
+    gdt_set_gate(c->gdt, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF);    /* ring 0 code */
+    gdt_set_gate(c->gdt, 2, 0, 0xFFFFFFFF, 0x92, 0xCF);    /* ring 0 data */
+    gdt_set_gate(c->gdt, 3, 0, 0xFFFFFFFF, 0xFA, 0xCF);    /* ring 3 code */
+    gdt_set_gate(c->gdt, 4, 0, 0xFFFFFFFF, 0xF2, 0xCF);    /* ring 3 data */
+    gdt_set_gate(c->gdt, 5, (unsigned long)&c->tss, sizeof(struct tss_entry) - 1, 0x89, 0x00);
+    gdt_set_gate(c->gdt, 6, (unsigned long)c, sizeof(struct cpu) - 1, 0x92, 0x40);
+
+    c->gdtp.limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
+    c->gdtp.base = (unsigned int)c->gdt;
+
+    gdt_flush(&c->gdtp);
+    __asm__ __volatile__("mov %0, %%gs" : : "r"((unsigned short)GDT_PERCPU));
+    __asm__ __volatile__("ltr %0" : : "r"((unsigned short)GDT_TSS));
+}
+
+/* The bootstrap processor is always cpus[0] */
+void gdt_install()
+{
+    cpus[0].id = 0;
+    cpus[0].online = 1;
+    gdt_install_cpu(&cpus[0]);
+}
@@ -0,0 +1,61 @@
+#ifndef _GDT_H_
+#define _GDT_H_
+
+#include "../include/types.h"
+
+// selectors, every cpu has its own GDT with this same layout. the per-cpu
+// segment therefore has the same selector everywhere but a different base,
+// which is what lets gs reach the running cpu's struct cpu.
+// boot/interrups.asm and boot/syscall.asm hardcode these, keep them in sync.
+// sysenter/sysexit derive every segment from GDT_KERNEL_CODE, so the user
+// segments have to follow the kernel ones in exactly this order
+#define GDT_KERNEL_CODE     0x08
+#define GDT_KERNEL_DATA     0x10
+#define GDT_USER_CODE       0x18
+#define GDT_USER_DATA       0x20
+#define GDT_TSS             0x28
+#define GDT_PERCPU          0x30
+#define GDT_ENTRIES         7
+
+#define RPL_USER            3
+
+struct gdt_entry {
+    unsigned short limit_low;
+    unsigned short base_low;
+    unsigned char base_middle;
+    unsigned char access;
+    unsigned char granularity;
+    unsigned char base_high;
+} __attribute__((packed));
+
+struct gdt_ptr {
+    unsigned short limit;
+    unsigned int base;
+} __attribute__((packed));
+
+// 32 bit task state segment. we never hardware task switch, the cpu only
+// reads ss0:esp0 from it when an interrupt arrives from a lower privilege level
+struct tss_entry {
+    uint32_t prev_tss;
+    uint32_t esp0;
+    uint32_t ss0;
+    uint32_t esp1;
+    uint32_t ss1;
+    uint32_t esp2;
+    uint32_t ss2;
+    uint32_t cr3;
+    uint32_t eip;
+    uint32_t eflags;
+    uint32_t eax, ecx, edx, ebx;
+    uint32_t esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed));
+
+struct cpu;
+void gdt_set_gate(struct gdt_entry *gdt, int num, unsigned long base, unsigned long limit, unsigned char access, unsigned char gran);
+void gdt_install_cpu(struct cpu *c);
+
+#endif
@@ -4,6 +4,10 @@
 *
 *  Notes: No warranty expressed or implied. Use at own risk. */
 #include "../include/system.h"
+#include "low_level.h"
+#include "sched.h"
+#include "trace.h"
+#include "printk.h"
 
 /* These are own ISRs that point to our special IRQ handler
 *  instead of the regular 'fault_handler' function */
@@ -24,24 +28,81 @@ extern void irq13();
 extern void irq14();
 extern void irq15();
 
-/* This array is actually an array of function pointers. We use
-*  this to handle custom IRQ handlers for a given IRQ */
-void *irq_routines[16] =
+#define IRQ_LINES       16
+#define IRQ_MAX_ACTIONS 32
+
+/* The handlers of each IRQ line, in the order they were installed.
+*  PCI devices on INTx may share a line, so a line holds a chain and
+*  every handler on it runs; a handler on a shared line checks its own
+*  device before doing anything. Chains only change with interrupts off,
+*  and IRQs only arrive on the BSP */
+struct irq_action
 {
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0
+    irq_handler_t handler;
+    struct irq_action *next;
 };
 
-/* This installs a custom IRQ handler for the given IRQ */
-void irq_install_handler(int irq, void (*handler)(struct regs *r))
+static struct irq_action irq_actions[IRQ_MAX_ACTIONS];
+static struct irq_action *irq_chains[IRQ_LINES];
+static unsigned int spurious_irqs[2];  // IRQ7 and IRQ15
+
+/* This adds a custom IRQ handler for the given IRQ */
+void irq_install_handler(int irq, irq_handler_t handler)
 {
-    irq_routines[irq] = handler;
+    unsigned int flags = interrupts_save();
+    struct irq_action **link = &irq_chains[irq];
+    struct irq_action *action = 0;
+
+    for (int i = 0; i < IRQ_MAX_ACTIONS; i++)
+    {
+        if (irq_actions[i].handler == 0)
+        {
+            action = &irq_actions[i];
+            break;
+        }
+    }
+    if (action == 0)
+    {
+        interrupts_restore(flags);
+        printk_level(LOG_ERROR, "irq: no room for another handler on IRQ%d\n", irq);
+        return;
+    }
+    action->handler = handler;
+    action->next = 0;
+    while (*link)
+        link = &(*link)->next;
+    *link = action;
+    interrupts_restore(flags);
+}
+
+/* This takes one handler off the given IRQ */
+void irq_remove_handler(int irq, irq_handler_t handler)
+{
+    unsigned int flags = interrupts_save();
+    struct irq_action **link = &irq_chains[irq];
+
+    while (*link && (*link)->handler != handler)
+        link = &(*link)->next;
+    if (*link)
+    {
+        struct irq_action *action = *link;
+        *link = action->next;
+        action->handler = 0;
+    }
+    interrupts_restore(flags);
 }
 
-/* This clears the handler for a given IRQ */
+/* This clears all handlers for a given IRQ */
 void irq_uninstall_handler(int irq)
 {
-    irq_routines[irq] = 0;
+    unsigned int flags = interrupts_save();
+
+    while (irq_chains[irq])
+    {
+        irq_chains[irq]->handler = 0;
+        irq_chains[irq] = irq_chains[irq]->next;
+    }
+    interrupts_restore(flags);
 }
 
 /* Normally, IRQs 0 to 7 are mapped to entries 8 to 15. This
@@ -96,6 +157,23 @@ void irq_install()
     idt_set_gate(47, (unsigned)irq15, 0x08, 0x8E);
 }
 
+/* A PIC raises IRQ7 (IRQ15 on the slave) when a line drops again
+*  before the cpu acknowledges it. Such an IRQ has no bit in the
+*  in-service register and must not get an EOI from that PIC, but a
+*  spurious IRQ15 did go through the master as IRQ2, which needs one */
+static int irq_spurious(int irq)
+{
+    unsigned short port = irq == 7 ? 0x20 : 0xA0;
+
+    port_byte_out(port, 0x0B);          /* OCW3: read the ISR next */
+    if (port_byte_in(port) & 0x80)
+        return 0;
+    if (irq == 15)
+        port_byte_out(0x20, 0x20);
+    spurious_irqs[irq == 15]++;
+    return 1;
+}
+
 /* Each of the IRQ ISRs point to this function, rather than
 *  the 'fault_handler' in 'isrs.c'. The IRQ Controllers need
 *  to be told when you are done servicing them, so you need
@@ -108,15 +186,21 @@ void irq_install()
 *  an EOI, you won't raise any more IRQs */
 void irq_handler(struct regs *r)
 {
-    /* This is a blank function pointer */
-    void (*handler)(struct regs *r);
+    int irq = r->int_no - 32;
+    struct irq_action *action;
+
+    trace(TRACE_IRQ_ENTRY, r->int_no);
+
+    if ((irq == 7 || irq == 15) && irq_spurious(irq))
+    {
+        trace(TRACE_IRQ_EXIT, r->int_no);
+        return;
+    }
 
-    /* Find out if we have a custom handler to run for this
-    *  IRQ, and then finally, run it */
-    handler = irq_routines[r->int_no - 32];
-    if (handler)
+    /* Run every handler installed for this IRQ */
+    for (action = irq_chains[irq]; action; action = action->next)
     {
-        handler(r);
+        action->handler(r);
     }
 
     /* If the IDT entry that was invoked was greater than 40
@@ -130,4 +214,82 @@ void irq_handler(struct regs *r)
     /* In either case, we need to send an EOI to the master
     *  interrupt controller too */
     port_byte_out(0x20, 0x20);
+    trace(TRACE_IRQ_EXIT, r->int_no);
+
+    /* The handler may have woken a more urgent thread or used up
+    *  the running thread's time slice. Only switch now that the
+    *  PIC has its EOI, so IRQs keep coming for the next thread */
+    sched_preempt();
+}
+
+/* Cycles from an interrupt to its handler and from the handler back to
+*  the interrupted code, through the full IRQ path: a software interrupt
+*  on the vector of an otherwise unused line, with the PICs' EOI and all */
+#define BENCH_IRQ       3               /* COM2 */
+#define BENCH_ROUNDS    10000
+
+static volatile unsigned long long bench_entry;
+
+struct irq_timing
+{
+    unsigned int entry_min, entry_avg;
+    unsigned int exit_min, exit_avg;
+};
+
+static void bench_handler(struct regs *r)
+{
+    bench_entry = rdtsc();
+}
+
+static void irq_measure(struct irq_timing *t)
+{
+    unsigned long long start, end, entry_total = 0, exit_total = 0;
+    unsigned int entry_min = ~0u, exit_min = ~0u;
+    unsigned int flags;
+
+    flags = interrupts_save();
+    irq_install_handler(BENCH_IRQ, bench_handler);
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        unsigned int entry, exit;
+
+        start = rdtsc();
+        __asm__ __volatile__("int %0" : : "i"(32 + BENCH_IRQ) : "memory");
+        end = rdtsc();
+        entry = (unsigned int)(bench_entry - start);
+        exit = (unsigned int)(end - bench_entry);
+        entry_total += entry;
+        exit_total += exit;
+        if (entry < entry_min)
+            entry_min = entry;
+        if (exit < exit_min)
+            exit_min = exit;
+    }
+    irq_remove_handler(BENCH_IRQ, bench_handler);
+    interrupts_restore(flags);
+
+    t->entry_min = entry_min;
+    t->entry_avg = (unsigned int)divide64(entry_total, BENCH_ROUNDS, 0);
+    t->exit_min = exit_min;
+    t->exit_avg = (unsigned int)divide64(exit_total, BENCH_ROUNDS, 0);
+}
+
+/* Average cycles from 'int' to the handler and back, for the
+*  benchmark suite */
+unsigned int irq_round_trip()
+{
+    struct irq_timing t;
+
+    irq_measure(&t);
+    return t.entry_avg + t.exit_avg;
+}
+
+void irq_benchmark()
+{
+    struct irq_timing t;
+
+    irq_measure(&t);
+    printk("irq entry: %u cycles min, %u avg\n", t.entry_min, t.entry_avg);
+    printk("irq exit: %u cycles min, %u avg\n", t.exit_min, t.exit_avg);
+    printk("spurious: %u IRQ7, %u IRQ15\n", spurious_irqs[0], spurious_irqs[1]);
 }
@@ -4,6 +4,10 @@
 *
 *  Notes: No warranty expressed or implied. Use at own risk. */
 #include "../include/system.h"
+#include "paging.h"
+#include "process.h"
+#include "printk.h"
+#include "trace.h"
 
 /* These are function prototypes for all of the exception
 *  handlers: The first 32 entries in the IDT are reserved
@@ -140,9 +144,28 @@ unsigned char *exception_messages[] =
 *  happening and messing up kernel data structures */
 void fault_handler(struct regs *r)
 {
+    /* Page faults are mostly user pages that are mapped on
+    *  first touch. The instruction simply runs again */
+    trace(TRACE_FAULT_ENTRY, r->int_no);
+    if (r->int_no == 14 && paging_fault(r))
+    {
+        trace(TRACE_FAULT_EXIT, r->int_no);
+        return;
+    }
+
+    /* A fault on behalf of a user program only takes down
+    *  that program, not the whole system */
+    if (thread_current() && thread_current()->process && ((r->cs & 3) == 3 || r->int_no == 14))
+    {
+        printk_level(LOG_ERROR, "%s at eip %p, process killed\n", exception_messages[r->int_no], r->eip);
+        process_exit(-1);
+    }
+
     if (r->int_no < 32)
     {
-        printf(exception_messages[r->int_no], -1, -1);
+        printk_level(LOG_ERROR, "%s at eip %p, error code %x, system halted\n",
+                     exception_messages[r->int_no], r->eip, r->err_code);
+        printk_flush();
         for (;;);
     }
 }
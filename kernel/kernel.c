@@ -1,30 +1,76 @@
 #include "low_level.h"
+#include "../include/system.h"
 #include "../drivers/screen.h"
 #include <float.h>
 #include <cpuid.h>
 #include "../include/conversion.h"
 #include "../drivers/keyboard.h"
+#include "../tools/terminal.h"
+#include "../drivers/mouse.h"
 #include "../fonts/fonts_handler.h"
 #include "../drivers/vesa_vbe/vbe.h"
+#include "../drivers/timer.h"
+#include "sched.h"
+#include "smp.h"
+#include "syscall.h"
+#include "pci.h"
+#include "../drivers/virtio_blk.h"
+#include "../drivers/virtio_net.h"
+#include "../drivers/block.h"
+#include "../drivers/serial.h"
+#include "printk.h"
+#include "memory.h"
+#include "paging.h"
+#include "../fs/initrd.h"
+#include "../fs/bcache.h"
+#include "../fs/fat.h"
+#include "bench.h"
 
 extern void loadIDT(void);
+extern char _bss_start, _bss_end;
 unsigned char *vbe_addr = 0x3000;
 
 int main() {
+    // the bootloader only loads the initialised part of the image
+    for(char *p = &_bss_start; p < &_bss_end; p++)
+        *p = 0;
+
+    a20_enable();
+    gdt_install();
     idt_install();
     isrs_install();
     irq_install();
-    clear_screen();
-    // keyboard_install();
-    // terminal_init();
+    serial_init();
+    printk_init();
+    syscall_install();
     load_vbe_data_structures();
+    initrd_init();
+    memory_init();
+    memory_reserve(INITRD_BASE, INITRD_BASE + initrd_size);
+    paging_init();
+    sched_init();
+    timer_install();
+    smp_init();
+    pci_init();
+    virtio_blk_init();
+    virtio_net_init();
+    bcache_init();
+    printk_start();
+    fat_mount(block_get(0));
+    clear_screen();
     vbe_software_support();
     get_vbe_mode_info();
+    mouse_install();
+    // the keyboard thread feeds the terminal once interrupts are on
+    keyboard_install();
+    terminal_init();
 
-    unsigned int *lfb = (unsigned int*)&vbe_mode->framebuffer;
-	
-    int offset = 0;				// draw the first pixel
-    lfb[offset] = 0xFF0000;			// red
+#ifdef BENCH
+    // the benchmark build (make bench) runs the suite and powers QEMU off
+    thread_create("bench", bench_thread, 0, PRIORITY_NORMAL);
+#endif
 
-    while(1);
+    __asm__ __volatile__("sti");
+    // from here on the other threads and the idle thread own the cpu
+    thread_exit();
 }
@@ -12,9 +12,59 @@ void port_byte_out(unsigned short port, unsigned char data) {
 
 unsigned short port_word_in(unsigned short port) {
     unsigned short result;
-    __asm__("in %%dx, %%al" : "=a"(result) : "d"(port));
+    __asm__ __volatile__("in %%dx, %%ax" : "=a"(result) : "d"(port));
+    return result;
 }
 
 void port_word_out(unsigned short port, unsigned short data) {
-    __asm__("out %%al, %%dx" : : "a"(data), "d"(port));
-}
\ No newline at end of file
+    __asm__ __volatile__("out %%ax, %%dx" : : "a"(data), "d"(port));
+}
+
+unsigned int port_dword_in(unsigned short port) {
+    unsigned int result;
+    __asm__ __volatile__("in %%dx, %%eax" : "=a"(result) : "d"(port));
+    return result;
+}
+
+void port_dword_out(unsigned short port, unsigned int data) {
+    __asm__ __volatile__("out %%eax, %%dx" : : "a"(data), "d"(port));
+}
+
+// read the time stamp counter, used to measure short code paths in cycles
+unsigned long long rdtsc() {
+    unsigned int lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+// disable interrupts and return the previous eflags so the caller can
+// put the interrupt flag back the way it found it
+unsigned int interrupts_save() {
+    unsigned int flags;
+    __asm__ __volatile__("pushf\n\tpop %0\n\tcli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+void interrupts_restore(unsigned int flags) {
+    if(flags & 0x200)
+        __asm__ __volatile__("sti" : : : "memory");
+}
+
+
+// fast A20 gate through the system control port, so odd megabytes above
+// 1 MB (ACPI tables, device memory) stop wrapping around to low memory
+void a20_enable() {
+    unsigned char value = port_byte_in(0x92);
+    if(!(value & 0x02))
+        port_byte_out(0x92, (value | 0x02) & ~0x01);
+}
+
+void wrmsr(unsigned int msr, unsigned long long value) {
+    __asm__ __volatile__("wrmsr" : : "c"(msr), "a"((unsigned int)value), "d"((unsigned int)(value >> 32)));
+}
+
+unsigned long long rdmsr(unsigned int msr) {
+    unsigned int lo, hi;
+    __asm__ __volatile__("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((unsigned long long)hi << 32) | lo;
+}
@@ -4,5 +4,25 @@ unsigned char port_byte_in(unsigned short port);
 void port_byte_out(unsigned short port, unsigned char data);
 unsigned short port_word_in(unsigned short port);
 void port_word_out(unsigned short port, unsigned short data);
+unsigned int port_dword_in(unsigned short port);
+void port_dword_out(unsigned short port, unsigned int data);
+unsigned long long rdtsc();
+unsigned int interrupts_save();
+void interrupts_restore(unsigned int flags);
+void a20_enable();
+void wrmsr(unsigned int msr, unsigned long long value);
+unsigned long long rdmsr(unsigned int msr);
+
+/* 64 by 32 bit division with two divl, the kernel is not linked against
+*  libgcc. Cycle counts are divided whole with it and only the quotient
+*  is cut to 32 bits */
+static inline unsigned long long divide64(unsigned long long n, unsigned int d, unsigned int *remainder) {
+    unsigned int high = n >> 32, quotient_high = high / d, quotient_low, r = high % d;
+
+    __asm__("divl %4" : "=a"(quotient_low), "=d"(r) : "a"((unsigned int)n), "d"(r), "rm"(d));
+    if(remainder)
+        *remainder = r;
+    return ((unsigned long long)quotient_high << 32) | quotient_low;
+}
 
 #endif
\ No newline at end of file
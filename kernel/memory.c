@@ -0,0 +1,139 @@
+#include "memory.h"
+#include "low_level.h"
+#include "spinlock.h"
+
+uint32_t memory_size;
+
+// one bit per 4 KB frame, set = in use
+static uint32_t frame_bitmap[MAX_MEMORY / PAGE_SIZE / 32];
+static uint32_t frame_count;
+static uint32_t next_free;          // where the next search starts
+static uint32_t free_count;
+static struct spinlock frame_lock = SPINLOCK_INIT;
+
+static uint8_t cmos_read(uint8_t reg) {
+    port_byte_out(0x70, reg);
+    return port_byte_in(0x71);
+}
+
+// the BIOS leaves the extended memory size in the CMOS: KB above 1 MB
+// (up to 64 MB) and 64 KB blocks above 16 MB for bigger machines
+static uint32_t memory_detect() {
+    uint32_t above_1m = cmos_read(0x30) | (cmos_read(0x31) << 8);
+    uint32_t above_16m = cmos_read(0x34) | (cmos_read(0x35) << 8);
+
+    if(above_16m)
+        return 0x1000000 + above_16m * 0x10000;
+    return 0x100000 + above_1m * 1024;
+}
+
+static inline void frame_set(uint32_t index) {
+    frame_bitmap[index / 32] |= 1 << (index % 32);
+}
+
+static inline void frame_clear(uint32_t index) {
+    frame_bitmap[index / 32] &= ~(1 << (index % 32));
+}
+
+void memory_init() {
+    uint32_t i;
+
+    memory_size = memory_detect();
+    if(memory_size > MAX_MEMORY)
+        memory_size = MAX_MEMORY;
+    frame_count = memory_size / PAGE_SIZE;
+
+    for(i = 0; i < FRAMES_START / PAGE_SIZE; i++)
+        frame_set(i);
+    for(; i < frame_count; i++)
+        free_count++;
+    next_free = FRAMES_START / PAGE_SIZE;
+}
+
+// takes a physical range out of the allocator, e.g. the initrd
+void memory_reserve(uint32_t start, uint32_t end) {
+    for(uint32_t i = start / PAGE_SIZE; i < PAGE_ALIGN_UP(end) / PAGE_SIZE && i < frame_count; i++) {
+        if(!(frame_bitmap[i / 32] & (1 << (i % 32)))) {
+            frame_set(i);
+            free_count--;
+        }
+    }
+}
+
+// returns the physical address of a free frame, or 0 when memory is exhausted
+uint32_t frame_alloc() {
+    unsigned int flags = spin_lock_irqsave(&frame_lock);
+    uint32_t index = next_free;
+
+    for(uint32_t scanned = 0; scanned < frame_count; scanned += 32) {
+        uint32_t word = frame_bitmap[index / 32];
+        if(word != 0xFFFFFFFF) {
+            // first clear bit of the word, the same bsf trick as the run queue
+            uint32_t bit;
+            __asm__("bsf %1, %0" : "=r"(bit) : "rm"(~word));
+            index = (index & ~31) + bit;
+            if(index < frame_count) {
+                frame_set(index);
+                free_count--;
+                next_free = index;
+                spin_unlock_irqrestore(&frame_lock, flags);
+                return index * PAGE_SIZE;
+            }
+        }
+        index = (index & ~31) + 32;
+        if(index >= frame_count)
+            index = FRAMES_START / PAGE_SIZE;
+    }
+
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return 0;
+}
+
+static inline int frame_used(uint32_t index) {
+    return frame_bitmap[index / 32] & (1 << (index % 32));
+}
+
+// count physically contiguous frames for buffers the kernel addresses
+// directly, e.g. window surfaces. first fit, returns 0 if no run is long enough
+uint32_t frame_alloc_contiguous(uint32_t count) {
+    unsigned int flags = spin_lock_irqsave(&frame_lock);
+    uint32_t start = FRAMES_START / PAGE_SIZE;
+    uint32_t run = 0;
+
+    for(uint32_t index = start; index < frame_count && count > 0; index++) {
+        if(frame_used(index)) {
+            run = 0;
+            start = index + 1;
+            continue;
+        }
+        if(++run == count) {
+            for(uint32_t i = start; i < start + count; i++)
+                frame_set(i);
+            free_count -= count;
+            spin_unlock_irqrestore(&frame_lock, flags);
+            return start * PAGE_SIZE;
+        }
+    }
+
+    spin_unlock_irqrestore(&frame_lock, flags);
+    return 0;
+}
+
+void frame_free_contiguous(uint32_t start, uint32_t count) {
+    unsigned int flags = spin_lock_irqsave(&frame_lock);
+    for(uint32_t i = start / PAGE_SIZE; i < start / PAGE_SIZE + count; i++)
+        frame_clear(i);
+    free_count += count;
+    spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+void frame_free(uint32_t frame) {
+    unsigned int flags = spin_lock_irqsave(&frame_lock);
+    frame_clear(frame / PAGE_SIZE);
+    free_count++;
+    spin_unlock_irqrestore(&frame_lock, flags);
+}
+
+uint32_t frames_free() {
+    return free_count;
+}
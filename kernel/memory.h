@@ -0,0 +1,27 @@
+#ifndef _MEMORY_H_
+#define _MEMORY_H_
+
+#include "../include/types.h"
+
+#define PAGE_SIZE       4096
+#define PAGE_SHIFT      12
+
+// everything below 1 MB belongs to the kernel image, its stacks and the BIOS
+#define FRAMES_START    0x100000
+// physical memory is identity mapped below the user address space
+#define MAX_MEMORY      0x40000000
+
+#define PAGE_ALIGN_DOWN(x)  ((x) & ~(PAGE_SIZE - 1))
+#define PAGE_ALIGN_UP(x)    (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+extern uint32_t memory_size;
+
+void memory_init();
+void memory_reserve(uint32_t start, uint32_t end);
+uint32_t frame_alloc();
+void frame_free(uint32_t frame);
+uint32_t frame_alloc_contiguous(uint32_t count);
+void frame_free_contiguous(uint32_t start, uint32_t count);
+uint32_t frames_free();
+
+#endif
@@ -0,0 +1,142 @@
+#include "paging.h"
+#include "memory.h"
+#include "process.h"
+#include "sched.h"
+#include "printk.h"
+#include "../include/system.h"
+#include "../drivers/vesa_vbe/vbe.h"
+
+/* Kernel space is identity mapped with 4 MB pages, so the kernel never
+*  needs page tables of its own and every physical frame is reachable
+*  at its own address. Only user space below USER_END uses 4 KB pages. */
+uint32_t kernel_directory[1024] __attribute__((aligned(4096)));
+
+static inline uint32_t read_cr2() {
+    uint32_t value;
+    __asm__ __volatile__("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static inline uint32_t read_cr3() {
+    uint32_t value;
+    __asm__ __volatile__("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+/* Only the kernel's part of the address space can be identity mapped:
+*  every process directory has a user half of its own, where a mapping
+*  in kernel_directory would be missing, or pages of the process in its
+*  place. Returns -1 without mapping anything for a range that reaches
+*  into USER_BASE..USER_END */
+static int identity_map(uint32_t phys, uint32_t size, uint32_t flags) {
+    uint32_t start = phys & ~(LARGE_PAGE_SIZE - 1);
+    uint32_t end = phys + size;
+
+    if(size == 0)
+        return 0;
+    if(phys < USER_END && (end > USER_BASE || end < phys))
+        return -1;
+    for(uint32_t addr = start; addr < end && addr >= start; addr += LARGE_PAGE_SIZE) {
+        if(!(kernel_directory[PDE_INDEX(addr)] & PAGE_PRESENT))
+            kernel_directory[PDE_INDEX(addr)] = addr | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE | flags;
+    }
+    return 0;
+}
+
+// device memory, mapped uncached. directories created earlier pick the
+// new entry up lazily in paging_fault. -1 if it lies in the user range
+int paging_map_mmio(uint32_t phys, uint32_t size) {
+    return identity_map(phys, size, PAGE_NO_CACHE | PAGE_WRITE_THROUGH);
+}
+
+// loads the kernel directory and turns on 4 MB pages and paging on the calling cpu
+void paging_init_cpu() {
+    uint32_t value;
+
+    __asm__ __volatile__("mov %%cr4, %0" : "=r"(value));
+    value |= 0x10;                          // CR4.PSE
+    __asm__ __volatile__("mov %0, %%cr4" : : "r"(value));
+
+    __asm__ __volatile__("mov %0, %%cr3" : : "r"(kernel_directory));
+
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(value));
+    value |= 0x80000000;                    // CR0.PG
+    __asm__ __volatile__("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+void paging_init() {
+    identity_map(0, memory_size, 0);
+    if(paging_map_mmio(vbe_mode->framebuffer, vbe_mode->pitch * vbe_mode->height) < 0)
+        printk_level(LOG_WARN, "framebuffer at %x is in the user range, not mapped\n", vbe_mode->framebuffer);
+    paging_init_cpu();
+}
+
+// a new address space: empty user half, kernel half shared with kernel_directory
+uint32_t *paging_new_directory() {
+    uint32_t *directory = (uint32_t*)frame_alloc();
+
+    if(directory == 0)
+        return 0;
+    for(int i = 0; i < 1024; i++) {
+        if(i >= PDE_INDEX(USER_BASE) && i < PDE_INDEX(USER_END))
+            directory[i] = 0;
+        else
+            directory[i] = kernel_directory[i];
+    }
+    return directory;
+}
+
+// frees the page tables of the user half. the pages they point to are
+// owned by the process and released by it beforehand
+void paging_free_directory(uint32_t *directory) {
+    for(int i = PDE_INDEX(USER_BASE); i < PDE_INDEX(USER_END); i++) {
+        if(directory[i] & PAGE_PRESENT)
+            frame_free(directory[i] & PAGE_FRAME);
+    }
+    frame_free((uint32_t)directory);
+}
+
+uint32_t *paging_get_pte(uint32_t *directory, uint32_t addr, int create) {
+    uint32_t *pde = &directory[PDE_INDEX(addr)];
+    uint32_t *table;
+
+    if(!(*pde & PAGE_PRESENT)) {
+        if(!create)
+            return 0;
+        table = (uint32_t*)frame_alloc();
+        if(table == 0)
+            return 0;
+        for(int i = 0; i < 1024; i++)
+            table[i] = 0;
+        *pde = (uint32_t)table | PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
+    }
+    table = (uint32_t*)(*pde & PAGE_FRAME);
+    return &table[PTE_INDEX(addr)];
+}
+
+// kernel threads borrow whatever address space is loaded, the kernel half
+// is the same everywhere. only switch when the directory really changes
+void paging_switch(uint32_t *directory) {
+    if(read_cr3() != (uint32_t)directory)
+        __asm__ __volatile__("mov %0, %%cr3" : : "r"(directory) : "memory");
+}
+
+// returns 1 when the fault was resolved and the instruction can be retried
+int paging_fault(struct regs *r) {
+    uint32_t addr = read_cr2();
+    uint32_t *directory = (uint32_t*)read_cr3();
+    struct process *p = thread_current()->process;
+
+    // a kernel mapping added after this directory was copied
+    if(addr < USER_BASE || addr >= USER_END) {
+        if((r->err_code & FAULT_USER) || !(kernel_directory[PDE_INDEX(addr)] & PAGE_PRESENT))
+            return 0;
+        directory[PDE_INDEX(addr)] = kernel_directory[PDE_INDEX(addr)];
+        return 1;
+    }
+
+    // a present page means a protection fault, e.g. a write to shared text
+    if(p == 0 || (r->err_code & FAULT_PRESENT))
+        return 0;
+    return process_map_page(p, PAGE_ALIGN_DOWN(addr), r->err_code & FAULT_WRITE);
+}
@@ -0,0 +1,44 @@
+#ifndef _PAGING_H_
+#define _PAGING_H_
+
+#include "../include/types.h"
+
+#define PAGE_PRESENT        0x001
+#define PAGE_WRITE          0x002
+#define PAGE_USER           0x004
+#define PAGE_WRITE_THROUGH  0x008
+#define PAGE_NO_CACHE       0x010
+#define PAGE_LARGE          0x080       // 4 MB page in a directory entry
+#define PAGE_FRAME          0xFFFFF000
+
+#define LARGE_PAGE_SIZE     0x400000
+
+// page fault error code bits
+#define FAULT_PRESENT       0x1
+#define FAULT_WRITE         0x2
+#define FAULT_USER          0x4
+
+// the user half lives between these, everything else is the kernel's
+// identity map, shared by every address space
+#define USER_BASE           0x40000000
+#define USER_END            0xC0000000
+#define USER_STACK_TOP      USER_END
+#define USER_STACK_SIZE     0x40000
+
+#define PDE_INDEX(addr)     ((addr) >> 22)
+#define PTE_INDEX(addr)     (((addr) >> 12) & 0x3FF)
+
+struct regs;
+
+extern uint32_t kernel_directory[1024];
+
+void paging_init();
+void paging_init_cpu();
+int paging_map_mmio(uint32_t phys, uint32_t size);
+uint32_t *paging_new_directory();
+void paging_free_directory(uint32_t *directory);
+uint32_t *paging_get_pte(uint32_t *directory, uint32_t addr, int create);
+void paging_switch(uint32_t *directory);
+int paging_fault(struct regs *r);
+
+#endif
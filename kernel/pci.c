@@ -0,0 +1,386 @@
+#include "pci.h"
+#include "acpi.h"
+#include "apic.h"
+#include "paging.h"
+#include "sched.h"
+#include "spinlock.h"
+#include "trace.h"
+#include "low_level.h"
+#include "../include/system.h"
+#include "../drivers/screen.h"
+#include "../include/conversion.h"
+
+/* PCI bus enumeration. pci_init walks the buses once, through the
+*  memory mapped ECAM window when ACPI has an MCFG table and through
+*  the 0xCF8/0xCFC ports otherwise, and keeps what it finds in
+*  pci_devices. Drivers look their device up there and never touch
+*  configuration space just to find it. */
+struct pci_device pci_devices[MAX_PCI_DEVICES];
+int pci_device_count;
+
+// physical base of bus 0 in the ECAM window, 0 when only the ports work
+static uint32_t ecam_base;
+static int ecam_start_bus, ecam_end_bus;
+
+// the ports are an address/data pair, two cpus must not interleave them
+static struct spinlock config_lock = SPINLOCK_INIT;
+
+// the stubs in boot/msi.asm and the handler behind each vector
+extern uint32_t msi_stubs[MSI_VECTORS];
+static void (*msi_routines[MSI_VECTORS])(struct regs *r);
+
+static inline int use_ecam(int bus) {
+    return ecam_base && bus >= ecam_start_bus && bus <= ecam_end_bus;
+}
+
+static inline uint32_t ecam_address(int bus, int slot, int function, int offset) {
+    return ecam_base + ((bus << 20) | (slot << 15) | (function << 12) | offset);
+}
+
+static inline uint32_t port_address(int bus, int slot, int function, int offset) {
+    return 0x80000000 | (bus << 16) | (slot << 11) | (function << 8) | (offset & 0xFC);
+}
+
+static uint32_t config_read(int bus, int slot, int function, int offset, int size) {
+    unsigned int flags;
+    uint32_t value;
+
+    if(use_ecam(bus)) {
+        uint32_t address = ecam_address(bus, slot, function, offset);
+        if(size == 4)
+            return *(volatile uint32_t*)address;
+        if(size == 2)
+            return *(volatile uint16_t*)address;
+        return *(volatile uint8_t*)address;
+    }
+
+    flags = spin_lock_irqsave(&config_lock);
+    port_dword_out(PCI_CONFIG_ADDRESS, port_address(bus, slot, function, offset));
+    if(size == 4)
+        value = port_dword_in(PCI_CONFIG_DATA);
+    else if(size == 2)
+        value = port_word_in(PCI_CONFIG_DATA + (offset & 2));
+    else
+        value = port_byte_in(PCI_CONFIG_DATA + (offset & 3));
+    spin_unlock_irqrestore(&config_lock, flags);
+    return value;
+}
+
+// writes at the register's own width, a wider read-modify-write would
+// write back and clear the status register's write-one-to-clear bits
+static void config_write(int bus, int slot, int function, int offset, int size, uint32_t value) {
+    unsigned int flags;
+
+    if(use_ecam(bus)) {
+        uint32_t address = ecam_address(bus, slot, function, offset);
+        if(size == 4)
+            *(volatile uint32_t*)address = value;
+        else
+            *(volatile uint16_t*)address = value;
+        return;
+    }
+
+    flags = spin_lock_irqsave(&config_lock);
+    port_dword_out(PCI_CONFIG_ADDRESS, port_address(bus, slot, function, offset));
+    if(size == 4)
+        port_dword_out(PCI_CONFIG_DATA, value);
+    else
+        port_word_out(PCI_CONFIG_DATA + (offset & 2), value);
+    spin_unlock_irqrestore(&config_lock, flags);
+}
+
+uint32_t pci_read32(struct pci_device *dev, int offset) {
+    return config_read(dev->bus, dev->slot, dev->function, offset, 4);
+}
+
+uint16_t pci_read16(struct pci_device *dev, int offset) {
+    return config_read(dev->bus, dev->slot, dev->function, offset, 2);
+}
+
+uint8_t pci_read8(struct pci_device *dev, int offset) {
+    return config_read(dev->bus, dev->slot, dev->function, offset, 1);
+}
+
+void pci_write32(struct pci_device *dev, int offset, uint32_t value) {
+    config_write(dev->bus, dev->slot, dev->function, offset, 4, value);
+}
+
+void pci_write16(struct pci_device *dev, int offset, uint16_t value) {
+    config_write(dev->bus, dev->slot, dev->function, offset, 2, value);
+}
+
+// sizes the BARs by writing all ones and reading back which bits stick
+static void read_bars(struct pci_device *dev) {
+    uint16_t command = pci_read16(dev, PCI_COMMAND);
+
+    // no decoding while a BAR briefly holds all ones
+    pci_write16(dev, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+    for(int i = 0; i < 6; i++) {
+        int offset = PCI_BAR0 + i * 4;
+        uint32_t original = pci_read32(dev, offset);
+        uint32_t mask;
+
+        pci_write32(dev, offset, 0xFFFFFFFF);
+        mask = pci_read32(dev, offset);
+        pci_write32(dev, offset, original);
+        if(mask == 0)
+            continue;
+
+        if(original & PCI_BAR_IO) {
+            dev->bar_is_io[i] = 1;
+            dev->bar[i] = original & ~0x3;
+            dev->bar_size[i] = (~(mask & ~0x3) + 1) & 0xFFFF;
+        } else {
+            dev->bar[i] = original & ~0xF;
+            dev->bar_size[i] = ~(mask & ~0xF) + 1;
+            // the upper half of a 64 bit BAR takes the next slot, we can only
+            // use the BAR if the firmware placed it below 4 GB
+            if(original & PCI_BAR_64BIT) {
+                if(i < 5 && pci_read32(dev, offset + 4) != 0)
+                    dev->bar[i] = dev->bar_size[i] = 0;
+                i++;
+            }
+        }
+    }
+    pci_write16(dev, PCI_COMMAND, command);
+}
+
+static void scan_bus(int bus);
+
+static void scan_function(int bus, int slot, int function) {
+    struct pci_device *dev;
+    uint32_t id = config_read(bus, slot, function, PCI_VENDOR_ID, 4);
+    uint8_t header_type;
+
+    if((id & 0xFFFF) == 0xFFFF || pci_device_count == MAX_PCI_DEVICES)
+        return;
+
+    dev = &pci_devices[pci_device_count++];
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->function = function;
+    dev->vendor = id & 0xFFFF;
+    dev->device = id >> 16;
+    dev->revision = pci_read8(dev, PCI_REVISION);
+    dev->prog_if = pci_read8(dev, PCI_PROG_IF);
+    dev->subclass = pci_read8(dev, PCI_SUBCLASS);
+    dev->class_code = pci_read8(dev, PCI_CLASS);
+    dev->irq_line = pci_read8(dev, PCI_INTERRUPT_LINE);
+    dev->irq_pin = pci_read8(dev, PCI_INTERRUPT_PIN);
+    dev->msi_cap = pci_find_capability(dev, PCI_CAP_MSI, 0);
+    dev->msix_cap = pci_find_capability(dev, PCI_CAP_MSIX, 0);
+    header_type = pci_read8(dev, PCI_HEADER_TYPE) & ~PCI_HEADER_MULTIFUNCTION;
+
+    if(header_type == 0)
+        read_bars(dev);
+    else if(dev->class_code == PCI_CLASS_BRIDGE && dev->subclass == PCI_SUBCLASS_PCI_BRIDGE)
+        scan_bus(pci_read8(dev, PCI_SECONDARY_BUS));
+}
+
+static void scan_bus(int bus) {
+    for(int slot = 0; slot < 32; slot++) {
+        if((config_read(bus, slot, 0, PCI_VENDOR_ID, 2) & 0xFFFF) == 0xFFFF)
+            continue;
+        scan_function(bus, slot, 0);
+        if(config_read(bus, slot, 0, PCI_HEADER_TYPE, 1) & PCI_HEADER_MULTIFUNCTION)
+            for(int function = 1; function < 8; function++)
+                scan_function(bus, slot, function);
+    }
+}
+
+// segment group 0 is all we look at, a PC with more is not going to boot this
+static void ecam_init() {
+    struct mcfg *mcfg;
+    struct mcfg_entry *entry;
+
+    if(!acpi_init())
+        return;
+    mcfg = (struct mcfg*)acpi_find_table("MCFG");
+    if(mcfg == 0 || mcfg->header.length < sizeof(struct mcfg) + sizeof(struct mcfg_entry))
+        return;
+    entry = (struct mcfg_entry*)(mcfg + 1);
+    if(entry->segment != 0 || (entry->base >> 32) != 0)
+        return;
+
+    // config space stays on the ports if ECAM can't be mapped
+    if(paging_map_mmio((uint32_t)entry->base + (entry->start_bus << 20),
+                       (entry->end_bus - entry->start_bus + 1) << 20) < 0)
+        return;
+    ecam_base = (uint32_t)entry->base;
+    ecam_start_bus = entry->start_bus;
+    ecam_end_bus = entry->end_bus;
+}
+
+void pci_init() {
+    ecam_init();
+
+    for(int i = 0; i < MSI_VECTORS; i++)
+        idt_set_gate(MSI_VECTOR_BASE + i, msi_stubs[i], 0x08, 0x8E);
+
+    // a multifunction host bridge means one host controller, and bus, per function
+    if(config_read(0, 0, 0, PCI_HEADER_TYPE, 1) & PCI_HEADER_MULTIFUNCTION) {
+        for(int function = 0; function < 8; function++)
+            if((config_read(0, 0, function, PCI_VENDOR_ID, 2) & 0xFFFF) != 0xFFFF)
+                scan_bus(function);
+    } else {
+        scan_bus(0);
+    }
+}
+
+// the index'th device with this vendor and device id, or 0
+struct pci_device *pci_find_device(uint16_t vendor, uint16_t device, int index) {
+    for(int i = 0; i < pci_device_count; i++)
+        if(pci_devices[i].vendor == vendor && pci_devices[i].device == device && index-- == 0)
+            return &pci_devices[i];
+    return 0;
+}
+
+struct pci_device *pci_find_class(uint8_t class_code, uint8_t subclass, int index) {
+    for(int i = 0; i < pci_device_count; i++)
+        if(pci_devices[i].class_code == class_code && pci_devices[i].subclass == subclass && index-- == 0)
+            return &pci_devices[i];
+    return 0;
+}
+
+// offset of the first capability with this id after start (0 to begin), or 0
+int pci_find_capability(struct pci_device *dev, uint8_t id, int start) {
+    int offset;
+    int hops = 0;
+
+    if(!(pci_read16(dev, PCI_STATUS) & PCI_STATUS_CAPABILITIES))
+        return 0;
+    offset = start ? pci_read8(dev, start + 1) : pci_read8(dev, PCI_CAPABILITIES);
+    // the list lives above the header, 48 entries at most, guard against loops
+    while(offset >= 0x40 && hops++ < 48) {
+        offset &= 0xFC;
+        if(pci_read8(dev, offset) == id)
+            return offset;
+        offset = pci_read8(dev, offset + 1);
+    }
+    return 0;
+}
+
+/* Turns on decoding and bus mastering and maps the memory BARs. -1,
+*  with the device left off, if a BAR lies where it can't be mapped */
+int pci_enable(struct pci_device *dev) {
+    uint16_t command = pci_read16(dev, PCI_COMMAND);
+
+    for(int i = 0; i < 6; i++)
+        if(!dev->bar_is_io[i] && dev->bar_size[i] && paging_map_mmio(dev->bar[i], dev->bar_size[i]) < 0)
+            return -1;
+    pci_write16(dev, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+    return 0;
+}
+
+// claims a free vector for handler, returns its index from MSI_VECTOR_BASE or -1
+static int msi_allocate(void (*handler)(struct regs *r)) {
+    unsigned int flags = interrupts_save();
+    int slot = -1;
+
+    for(int i = 0; i < MSI_VECTORS; i++) {
+        if(msi_routines[i] == 0) {
+            msi_routines[i] = handler;
+            slot = i;
+            break;
+        }
+    }
+    interrupts_restore(flags);
+    return slot;
+}
+
+/* Gives the device a vector of its own: it will write the vector to the
+*  calling cpu's local APIC instead of raising a shared INTx line. The
+*  handler runs like an IRQ handler. Returns the vector, or -1 if the
+*  device has no MSI, the local APIC is off or the vectors are used up */
+int pci_enable_msi(struct pci_device *dev, void (*handler)(struct regs *r)) {
+    int cap = dev->msi_cap;
+    int slot;
+    uint16_t control;
+
+    if(cap == 0 || !lapic_enabled)
+        return -1;
+    slot = msi_allocate(handler);
+    if(slot < 0)
+        return -1;
+
+    // fixed delivery, edge triggered, one message
+    control = pci_read16(dev, cap + MSI_CONTROL);
+    pci_write32(dev, cap + MSI_ADDRESS, MSI_ADDRESS_BASE | (lapic_id() << 12));
+    if(control & MSI_CONTROL_64BIT) {
+        pci_write32(dev, cap + MSI_ADDRESS + 4, 0);
+        pci_write16(dev, cap + 12, MSI_VECTOR_BASE + slot);
+    } else {
+        pci_write16(dev, cap + 8, MSI_VECTOR_BASE + slot);
+    }
+    control &= ~0x0070;                 // multiple message enable: 1 vector
+    pci_write16(dev, cap + MSI_CONTROL, control | MSI_CONTROL_ENABLE);
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) | PCI_COMMAND_INTX_OFF);
+    return MSI_VECTOR_BASE + slot;
+}
+
+/* The same through MSI-X, which devices like virtio offer instead of MSI.
+*  Fills in table entry 'entry' and returns its vector, or -1 */
+int pci_enable_msix(struct pci_device *dev, int entry, void (*handler)(struct regs *r)) {
+    int cap = dev->msix_cap;
+    int slot, bir;
+    uint16_t control;
+    uint32_t table;
+    volatile uint32_t *vector_entry;
+
+    if(cap == 0 || !lapic_enabled)
+        return -1;
+    control = pci_read16(dev, cap + MSIX_CONTROL);
+    table = pci_read32(dev, cap + MSIX_TABLE);
+    bir = table & 0x7;
+    if(entry > (control & MSIX_TABLE_SIZE) || bir > 5 || dev->bar_is_io[bir] || dev->bar_size[bir] == 0)
+        return -1;
+    if(paging_map_mmio(dev->bar[bir], dev->bar_size[bir]) < 0)
+        return -1;
+    slot = msi_allocate(handler);
+    if(slot < 0)
+        return -1;
+
+    vector_entry = (volatile uint32_t*)(dev->bar[bir] + (table & ~0x7) + entry * MSIX_ENTRY_SIZE);
+    vector_entry[0] = MSI_ADDRESS_BASE | (lapic_id() << 12);
+    vector_entry[1] = 0;
+    vector_entry[2] = MSI_VECTOR_BASE + slot;
+    vector_entry[3] = 0;                // unmasked
+
+    control |= MSIX_CONTROL_ENABLE;
+    control &= ~MSIX_CONTROL_MASK_ALL;
+    pci_write16(dev, cap + MSIX_CONTROL, control);
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) | PCI_COMMAND_INTX_OFF);
+    return MSI_VECTOR_BASE + slot;
+}
+
+/* Every stub in boot/msi.asm ends up here */
+void msi_handler(struct regs *r) {
+    void (*handler)(struct regs *r) = msi_routines[r->int_no - MSI_VECTOR_BASE];
+
+    trace(TRACE_IRQ_ENTRY, r->int_no);
+    if(handler)
+        handler(r);
+    lapic_eoi();
+    trace(TRACE_IRQ_EXIT, r->int_no);
+    sched_preempt();
+}
+
+void pci_list() {
+    for(int i = 0; i < pci_device_count; i++) {
+        struct pci_device *dev = &pci_devices[i];
+        printf(itoa(dev->bus), -1, -1);
+        printf(":", -1, -1);
+        printf(itoa(dev->slot), -1, -1);
+        printf(".", -1, -1);
+        printf(itoa(dev->function), -1, -1);
+        printf(" vendor ", -1, -1);
+        print_hex(dev->vendor);
+        printf(" device ", -1, -1);
+        print_hex(dev->device);
+        printf(" class ", -1, -1);
+        print_hex(dev->class_code);
+        printf(" subclass ", -1, -1);
+        print_hex(dev->subclass);
+        printf(dev->msix_cap ? " msi-x\n" : dev->msi_cap ? " msi\n" : "\n", -1, -1);
+    }
+}
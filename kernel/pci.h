@@ -0,0 +1,101 @@
+#ifndef _PCI_H_
+#define _PCI_H_
+
+#include "../include/types.h"
+
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+#define MAX_PCI_DEVICES     64
+
+// configuration space header offsets
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_REVISION        0x08
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_SECONDARY_BUS   0x19        // type 1 (bridge) headers
+#define PCI_CAPABILITIES    0x34
+#define PCI_INTERRUPT_LINE  0x3C
+#define PCI_INTERRUPT_PIN   0x3D
+
+#define PCI_COMMAND_IO          0x0001
+#define PCI_COMMAND_MEMORY      0x0002
+#define PCI_COMMAND_MASTER      0x0004
+#define PCI_COMMAND_INTX_OFF    0x0400
+
+#define PCI_STATUS_CAPABILITIES 0x0010
+
+#define PCI_HEADER_MULTIFUNCTION 0x80
+
+#define PCI_CLASS_BRIDGE        0x06
+#define PCI_SUBCLASS_PCI_BRIDGE 0x04
+
+#define PCI_BAR_IO              0x1
+#define PCI_BAR_64BIT           0x4
+
+// capability ids
+#define PCI_CAP_MSI             0x05
+#define PCI_CAP_VENDOR          0x09
+#define PCI_CAP_MSIX            0x11
+
+// MSI capability layout, offsets from the capability
+#define MSI_CONTROL             0x02
+#define MSI_ADDRESS             0x04
+#define MSI_CONTROL_ENABLE      0x0001
+#define MSI_CONTROL_64BIT       0x0080
+#define MSI_ADDRESS_BASE        0xFEE00000
+
+// MSI-X capability, the vector table itself lives in one of the BARs
+#define MSIX_CONTROL            0x02
+#define MSIX_TABLE              0x04
+#define MSIX_CONTROL_ENABLE     0x8000
+#define MSIX_CONTROL_MASK_ALL   0x4000
+#define MSIX_TABLE_SIZE         0x07FF
+#define MSIX_ENTRY_SIZE         16
+
+// everything a driver needs, read once by pci_init
+typedef struct pci_device {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+    uint16_t vendor;
+    uint16_t device;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+    uint8_t irq_line;
+    uint8_t irq_pin;
+    uint8_t msi_cap;            // offset of the MSI capability, 0 if there is none
+    uint8_t msix_cap;           // the same for MSI-X
+    uint32_t bar[6];            // base addresses with the flag bits masked off
+    uint32_t bar_size[6];
+    uint8_t bar_is_io[6];
+} pci_device;
+
+struct regs;
+
+extern struct pci_device pci_devices[MAX_PCI_DEVICES];
+extern int pci_device_count;
+
+void pci_init();
+uint32_t pci_read32(struct pci_device *dev, int offset);
+uint16_t pci_read16(struct pci_device *dev, int offset);
+uint8_t pci_read8(struct pci_device *dev, int offset);
+void pci_write32(struct pci_device *dev, int offset, uint32_t value);
+void pci_write16(struct pci_device *dev, int offset, uint16_t value);
+struct pci_device *pci_find_device(uint16_t vendor, uint16_t device, int index);
+struct pci_device *pci_find_class(uint8_t class_code, uint8_t subclass, int index);
+int pci_find_capability(struct pci_device *dev, uint8_t id, int start);
+int pci_enable(struct pci_device *dev);
+int pci_enable_msi(struct pci_device *dev, void (*handler)(struct regs *r));
+int pci_enable_msix(struct pci_device *dev, int entry, void (*handler)(struct regs *r));
+void pci_list();
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _PERCPU_H_
+#define _PERCPU_H_
+
+#include "../include/types.h"
+#include "gdt.h"
+
+#define MAX_CPUS        8
+#define AP_STACK_SIZE   4096
+
+struct thread;
+
+// everything a cpu owns. gs points at the running cpu's entry,
+// with self first so cpu_self() is a single gs relative load
+typedef struct cpu {
+    struct cpu *self;
+    int id;                     // index into cpus[]
+    int apic_id;
+    volatile int online;
+    struct thread *current;     // thread running on this cpu
+    struct gdt_entry gdt[GDT_ENTRIES];
+    struct gdt_ptr gdtp;
+    struct tss_entry tss;
+} cpu;
+
+extern struct cpu cpus[MAX_CPUS];
+extern int cpu_count;
+
+static inline struct cpu *cpu_self() {
+    struct cpu *c;
+    __asm__ __volatile__("movl %%gs:0, %0" : "=r"(c));
+    return c;
+}
+
+#endif
@@ -0,0 +1,372 @@
+#include "printk.h"
+#include "low_level.h"
+#include "spinlock.h"
+#include "sched.h"
+#include "../drivers/screen.h"
+#include "../drivers/serial.h"
+#include "../drivers/timer.h"
+
+/* Formatted kernel logging. printk formats straight into a record of the
+*  log ring and returns, it never touches a console, so it is cheap enough
+*  for IRQ handlers and hot paths and safe on any cpu. The drain thread
+*  later copies the records to the consoles (the sinks), each of which
+*  only takes records up to its own level.
+*
+*  The ring is a bounded multi-producer queue without locks. Each record
+*  has a sequence number: it equals the position the record is free for,
+*  that position + 1 once the text is in, and the position one lap later
+*  once drained. A producer claims a position with a compare-and-swap on
+*  the head and publishes the record by storing its sequence. A full ring
+*  drops the new message and counts it. The timer tick wakes the drain
+*  thread, producers never do, so printk doesn't depend on the scheduler. */
+struct log_record {
+    volatile uint32_t sequence;
+    uint8_t level;
+    uint8_t reserved;
+    uint16_t length;
+    unsigned long long timestamp;   // TSC
+    char text[LOG_LINE_MAX];
+};
+
+static struct log_record records[LOG_RECORDS];
+static volatile uint32_t log_head;      // next position producers claim
+static uint32_t log_tail;               // next position to drain, under drain_lock
+static volatile uint32_t log_dropped;
+static struct spinlock drain_lock = SPINLOCK_INIT;
+
+static struct log_sink sinks[LOG_MAX_SINKS];
+static int sink_count;
+
+static struct thread *drainer;
+static struct wait_queue log_waiters;
+
+/* --- formatting --- */
+
+struct format_output {
+    char *buffer;
+    uint32_t size;
+    uint32_t length;
+};
+
+static inline void emit(struct format_output *out, char c) {
+    if(out->length + 1 < out->size)
+        out->buffer[out->length++] = c;
+}
+
+static void emit_padding(struct format_output *out, char c, int count) {
+    while(count-- > 0)
+        emit(out, c);
+}
+
+static void emit_number(struct format_output *out, uint32_t value, int base, int upper,
+                        int negative, int width, int zero, int left) {
+    const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char reversed[12];
+    int count = 0, length;
+
+    do {
+        reversed[count++] = digits[value % base];
+        value /= base;
+    } while(value);
+    length = count + negative;
+
+    if(!left && !zero)
+        emit_padding(out, ' ', width - length);
+    if(negative)
+        emit(out, '-');
+    if(!left && zero)
+        emit_padding(out, '0', width - length);
+    while(count)
+        emit(out, reversed[--count]);
+    if(left)
+        emit_padding(out, ' ', width - length);
+}
+
+/* Formats into buffer, which always ends up 0 terminated. Knows %d %i %u
+*  %x %X %p %s %c and %%, the flags '-' and '0', a width and, for %s, a
+*  precision. Returns the number of characters stored */
+int vsnprintk(char *buffer, uint32_t size, const char *format, va_list args) {
+    struct format_output out = { buffer, size, 0 };
+
+    if(size == 0)
+        return 0;
+    for(; *format; format++) {
+        int left = 0, zero = 0, width = 0, precision = -1;
+
+        if(*format != '%') {
+            emit(&out, *format);
+            continue;
+        }
+        format++;
+        for(;; format++) {
+            if(*format == '-')
+                left = 1;
+            else if(*format == '0')
+                zero = 1;
+            else
+                break;
+        }
+        while(*format >= '0' && *format <= '9')
+            width = width * 10 + *format++ - '0';
+        if(*format == '.') {
+            precision = 0;
+            for(format++; *format >= '0' && *format <= '9'; format++)
+                precision = precision * 10 + *format - '0';
+        }
+        while(*format == 'l' || *format == 'h')     // int and long are the same size here
+            format++;
+
+        switch(*format) {
+        case 'd':
+        case 'i': {
+            int value = va_arg(args, int);
+            emit_number(&out, value < 0 ? -(uint32_t)value : (uint32_t)value, 10, 0, value < 0, width, zero, left);
+            break;
+        }
+        case 'u':
+            emit_number(&out, va_arg(args, uint32_t), 10, 0, 0, width, zero, left);
+            break;
+        case 'x':
+        case 'X':
+            emit_number(&out, va_arg(args, uint32_t), 16, *format == 'X', 0, width, zero, left);
+            break;
+        case 'p':
+            emit(&out, '0');
+            emit(&out, 'x');
+            emit_number(&out, (uint32_t)va_arg(args, void*), 16, 0, 0, 8, 1, 0);
+            break;
+        case 'c':
+            if(!left)
+                emit_padding(&out, ' ', width - 1);
+            emit(&out, (char)va_arg(args, int));
+            if(left)
+                emit_padding(&out, ' ', width - 1);
+            break;
+        case 's': {
+            const char *s = va_arg(args, const char*);
+            int length = 0;
+            if(s == 0)
+                s = "(null)";
+            while(s[length] && (precision < 0 || length < precision))
+                length++;
+            if(!left)
+                emit_padding(&out, ' ', width - length);
+            for(int i = 0; i < length; i++)
+                emit(&out, s[i]);
+            if(left)
+                emit_padding(&out, ' ', width - length);
+            break;
+        }
+        case '%':
+            emit(&out, '%');
+            break;
+        case 0:
+            format--;                   // a lone '%' at the end
+            break;
+        default:
+            emit(&out, '%');
+            emit(&out, *format);
+            break;
+        }
+    }
+    buffer[out.length] = 0;
+    return out.length;
+}
+
+int snprintk(char *buffer, uint32_t size, const char *format, ...) {
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = vsnprintk(buffer, size, format, args);
+    va_end(args);
+    return length;
+}
+
+/* --- the log ring --- */
+
+static void log_write(int level, const char *format, va_list args) {
+    uint32_t position = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+    struct log_record *r;
+
+    while(1) {
+        int lag;
+
+        r = &records[position & (LOG_RECORDS - 1)];
+        lag = (int)(__atomic_load_n(&r->sequence, __ATOMIC_ACQUIRE) - position);
+        if(lag == 0) {
+            // on failure position becomes the current head
+            if(__atomic_compare_exchange_n(&log_head, &position, position + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if(lag < 0) {
+            // the record from the last lap is still waiting for the drain
+            __atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            position = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    r->timestamp = rdtsc();
+    r->level = level;
+    r->length = vsnprintk(r->text, LOG_LINE_MAX, format, args);
+    __atomic_store_n(&r->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+void printk(const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    log_write(LOG_INFO, format, args);
+    va_end(args);
+}
+
+void printk_level(int level, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    log_write(level, format, args);
+    va_end(args);
+}
+
+static inline int log_pending() {
+    return records[log_tail & (LOG_RECORDS - 1)].sequence == log_tail + 1;
+}
+
+/* Takes the oldest record off the ring as a line with a timestamp in
+*  front and a newline at the end. Returns its length, or -1 if there is
+*  nothing to take */
+static int log_take(char *line, uint32_t size, int *level) {
+    struct log_record *r;
+    uint32_t seconds, micros;
+    unsigned int flags;
+    int length;
+
+    flags = spin_lock_irqsave(&drain_lock);
+    if(!log_pending()) {
+        spin_unlock_irqrestore(&drain_lock, flags);
+        return -1;
+    }
+    r = &records[log_tail & (LOG_RECORDS - 1)];
+    seconds = (uint32_t)divide64(divide64(r->timestamp, tsc_per_us, 0), 1000000, &micros);
+    length = snprintk(line, size, "[%5u.%06u] %s", seconds, micros, r->text);
+    if(length == size - 1)
+        length--;                       // cut short, make room for the newline
+    if(length == 0 || line[length - 1] != '\n') {
+        line[length++] = '\n';
+        line[length] = 0;
+    }
+    *level = r->level;
+    __atomic_store_n(&r->sequence, log_tail + LOG_RECORDS, __ATOMIC_RELEASE);
+    log_tail++;
+    spin_unlock_irqrestore(&drain_lock, flags);
+    return length;
+}
+
+static void sinks_write(const char *line, uint32_t length, int level) {
+    for(int i = 0; i < sink_count; i++)
+        if(level <= sinks[i].level)
+            sinks[i].write(line, length);
+}
+
+static void printk_drain() {
+    char line[LOG_LINE_MAX + 32];       // timestamp, text, newline
+    uint32_t dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+    int length, level;
+
+    if(dropped) {
+        length = snprintk(line, sizeof(line), "printk: %u messages dropped\n", dropped);
+        sinks_write(line, length, LOG_WARN);
+    }
+    while((length = log_take(line, sizeof(line), &level)) >= 0)
+        sinks_write(line, length, level);
+}
+
+static void drain_thread(void *arg) {
+    unsigned int flags;
+
+    while(1) {
+        flags = interrupts_save();
+        while(!log_pending() && log_dropped == 0)
+            wait_queue_sleep(&log_waiters);
+        interrupts_restore(flags);
+        printk_drain();
+    }
+}
+
+// from the timer interrupt: records are on the consoles at most a tick late
+void printk_tick() {
+    if(drainer && (log_pending() || log_dropped))
+        wait_queue_wake_one(&log_waiters);
+}
+
+/* Writes out everything logged so far from the caller, for when the drain
+*  thread won't run again: with interrupts off or before halting */
+void printk_flush() {
+    printk_drain();
+    serial_flush();
+}
+
+/* --- consoles --- */
+
+static void vga_write(const char *text, uint32_t length) {
+    for(uint32_t i = 0; i < length; i++)
+        print_char(text[i], -1, -1, 0);
+}
+
+int printk_register_sink(void (*write)(const char *text, uint32_t length), int level) {
+    unsigned int flags = spin_lock_irqsave(&drain_lock);
+
+    if(sink_count == LOG_MAX_SINKS) {
+        spin_unlock_irqrestore(&drain_lock, flags);
+        return -1;
+    }
+    sinks[sink_count].write = write;
+    sinks[sink_count].level = level;
+    sink_count++;
+    spin_unlock_irqrestore(&drain_lock, flags);
+    return 0;
+}
+
+/* Empties the ring and registers the text screen and the serial line,
+*  which takes debug messages as well. A framebuffer console would
+*  register itself the same way. Must run before the first printk */
+void printk_init() {
+    for(uint32_t i = 0; i < LOG_RECORDS; i++)
+        records[i].sequence = i;
+    printk_register_sink(vga_write, LOG_INFO);
+    printk_register_sink(serial_write, LOG_DEBUG);
+}
+
+// starts the drain thread, until then records just pile up
+void printk_start() {
+    drainer = thread_create("printk", drain_thread, 0, PRIORITY_NORMAL);
+}
+
+/* cost of a formatted message to printk against building the same line
+*  and printing it to the consoles straight away */
+#define BENCH_MESSAGES  64
+#define BENCH_DIRECT    16
+#define BENCH_FORMAT    "logbench %d: %08x %s\n"
+
+void printk_benchmark() {
+    char line[LOG_LINE_MAX];
+    unsigned long long start;
+    uint32_t logged, direct;
+
+    printk_flush();
+    start = rdtsc();
+    for(int i = 0; i < BENCH_MESSAGES; i++)
+        printk_level(LOG_DEBUG, BENCH_FORMAT, i, i * 0x9E3779B9u, "hot path");
+    logged = (uint32_t)divide64(rdtsc() - start, BENCH_MESSAGES, 0);
+
+    start = rdtsc();
+    for(int i = 0; i < BENCH_DIRECT; i++) {
+        snprintk(line, sizeof(line), BENCH_FORMAT, i, i * 0x9E3779B9u, "direct");
+        printf(line, -1, -1);
+    }
+    direct = (uint32_t)divide64(rdtsc() - start, BENCH_DIRECT, 0);
+
+    snprintk(line, sizeof(line), "printk: %u cycles per message, printf: %u cycles per line\n", logged, direct);
+    printf(line, -1, -1);
+}
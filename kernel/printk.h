@@ -0,0 +1,36 @@
+#ifndef _PRINTK_H_
+#define _PRINTK_H_
+
+#include <stdarg.h>
+#include "../include/types.h"
+
+// log levels, lower is more severe
+#define LOG_ERROR       0
+#define LOG_WARN        1
+#define LOG_INFO        2
+#define LOG_DEBUG       3
+
+// the log ring: LOG_RECORDS records of up to LOG_LINE_MAX - 1 characters
+#define LOG_RECORDS     256
+#define LOG_LINE_MAX    112
+#define LOG_MAX_SINKS   4
+
+// a console the drain thread writes to, it gets records up to level
+typedef struct log_sink {
+    void (*write)(const char *text, uint32_t length);
+    int level;
+} log_sink;
+
+int vsnprintk(char *buffer, uint32_t size, const char *format, va_list args);
+int snprintk(char *buffer, uint32_t size, const char *format, ...);
+void printk(const char *format, ...);
+void printk_level(int level, const char *format, ...);
+
+void printk_init();
+void printk_start();
+int printk_register_sink(void (*write)(const char *text, uint32_t length), int level);
+void printk_tick();
+void printk_flush();
+void printk_benchmark();
+
+#endif
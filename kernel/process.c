@@ -0,0 +1,290 @@
+#include "process.h"
+#include "elf.h"
+#include "paging.h"
+#include "memory.h"
+#include "low_level.h"
+#include "../fs/vfs.h"
+
+extern void enter_user_mode(uint32_t eip, uint32_t esp);
+
+static struct process processes[MAX_PROCESSES];
+static int next_pid = 1;
+
+/* Read only pages are shared between every instance of a program. A
+*  page is identified by the archive bytes it was built from, so a
+*  second instance finds the frame the first one already filled. */
+#define SHARED_PAGES    256
+#define SHARED_BUCKETS  64
+
+typedef struct shared_page {
+    uint8_t *source;                // first file byte in the page
+    uint32_t offset;                // where in the page that byte goes
+    uint32_t length;                // file bytes in the page, the rest is zero
+    uint32_t frame;
+    int refs;
+    struct shared_page *next_source;
+    struct shared_page *next_frame;
+} shared_page;
+
+static struct shared_page shared_pool[SHARED_PAGES];
+static struct shared_page *by_source[SHARED_BUCKETS];
+static struct shared_page *by_frame[SHARED_BUCKETS];
+
+static inline int source_bucket(uint8_t *source) {
+    return ((uint32_t)source >> 4) % SHARED_BUCKETS;
+}
+
+static inline int frame_bucket(uint32_t frame) {
+    return (frame >> 12) % SHARED_BUCKETS;
+}
+
+static void fill_page(uint32_t frame, uint8_t *source, uint32_t offset, uint32_t length) {
+    uint8_t *page = (uint8_t*)frame;
+    uint32_t i;
+
+    for(i = 0; i < offset; i++)
+        page[i] = 0;
+    for(; i < offset + length; i++)
+        page[i] = source[i - offset];
+    for(; i < PAGE_SIZE; i++)
+        page[i] = 0;
+}
+
+static uint32_t shared_get(uint8_t *source, uint32_t offset, uint32_t length) {
+    struct shared_page *s;
+    int i;
+
+    for(s = by_source[source_bucket(source)]; s; s = s->next_source) {
+        if(s->source == source && s->offset == offset && s->length == length) {
+            s->refs++;
+            return s->frame;
+        }
+    }
+
+    for(i = 0; i < SHARED_PAGES && shared_pool[i].refs; i++);
+    if(i == SHARED_PAGES)
+        return 0;
+    s = &shared_pool[i];
+    s->frame = frame_alloc();
+    if(s->frame == 0)
+        return 0;
+    fill_page(s->frame, source, offset, length);
+    s->source = source;
+    s->offset = offset;
+    s->length = length;
+    s->refs = 1;
+    s->next_source = by_source[source_bucket(source)];
+    by_source[source_bucket(source)] = s;
+    s->next_frame = by_frame[frame_bucket(s->frame)];
+    by_frame[frame_bucket(s->frame)] = s;
+    return s->frame;
+}
+
+static void shared_put(uint32_t frame) {
+    struct shared_page **link, *s;
+
+    for(link = &by_frame[frame_bucket(frame)]; *link; link = &(*link)->next_frame)
+        if((*link)->frame == frame)
+            break;
+    s = *link;
+    if(s == 0 || --s->refs > 0)
+        return;
+
+    *link = s->next_frame;
+    for(link = &by_source[source_bucket(s->source)]; *link != s; link = &(*link)->next_source);
+    *link = s->next_source;
+    frame_free(s->frame);
+}
+
+int process_add_region(struct process *p, uint32_t start, uint32_t end, uint8_t *file_data, uint32_t file_size, int writable) {
+    struct vm_region *r;
+
+    if(p->region_count == MAX_REGIONS)
+        return 0;
+    r = &p->regions[p->region_count++];
+    r->start = PAGE_ALIGN_DOWN(start);
+    r->end = PAGE_ALIGN_UP(end);
+    r->file_vaddr = start;
+    r->file_data = file_data;
+    r->file_size = file_size;
+    r->writable = writable;
+    return 1;
+}
+
+static struct vm_region *find_region(struct process *p, uint32_t addr) {
+    for(int i = 0; i < p->region_count; i++)
+        if(addr >= p->regions[i].start && addr < p->regions[i].end)
+            return &p->regions[i];
+    return 0;
+}
+
+// called from the page fault handler for a not present user page
+int process_map_page(struct process *p, uint32_t page, int write) {
+    struct vm_region *r = find_region(p, page);
+    uint32_t *pte, frame, from, to, offset = 0, length = 0;
+    uint8_t *source = 0;
+
+    if(r == 0 || (write && !r->writable))
+        return 0;
+    pte = paging_get_pte(p->directory, page, 1);
+    if(pte == 0)
+        return 0;
+
+    // the part of the page that comes from the file
+    from = page > r->file_vaddr ? page : r->file_vaddr;
+    to = page + PAGE_SIZE < r->file_vaddr + r->file_size ? page + PAGE_SIZE : r->file_vaddr + r->file_size;
+    if(to > from) {
+        source = r->file_data + (from - r->file_vaddr);
+        offset = from - page;
+        length = to - from;
+    }
+
+    if(!r->writable && length) {
+        // a whole, aligned page of the archive is mapped as it is, no copy at all
+        if(offset == 0 && length == PAGE_SIZE && ((uint32_t)source & (PAGE_SIZE - 1)) == 0) {
+            *pte = (uint32_t)source | PAGE_PRESENT | PAGE_USER | PTE_INITRD;
+            return 1;
+        }
+        frame = shared_get(source, offset, length);
+        if(frame == 0)
+            return 0;
+        *pte = frame | PAGE_PRESENT | PAGE_USER | PTE_SHARED;
+        return 1;
+    }
+
+    // data, bss and stack pages are private
+    frame = frame_alloc();
+    if(frame == 0)
+        return 0;
+    fill_page(frame, source, offset, length);
+    *pte = frame | PAGE_PRESENT | PAGE_USER | (r->writable ? PAGE_WRITE : 0);
+    return 1;
+}
+
+static void release_memory(struct process *p) {
+    uint32_t *table;
+
+    for(int i = PDE_INDEX(USER_BASE); i < PDE_INDEX(USER_END); i++) {
+        if(!(p->directory[i] & PAGE_PRESENT))
+            continue;
+        table = (uint32_t*)(p->directory[i] & PAGE_FRAME);
+        for(int j = 0; j < 1024; j++) {
+            if(!(table[j] & PAGE_PRESENT) || (table[j] & PTE_INITRD))
+                continue;
+            if(table[j] & PTE_SHARED)
+                shared_put(table[j] & PAGE_FRAME);
+            else
+                frame_free(table[j] & PAGE_FRAME);
+        }
+    }
+    paging_free_directory(p->directory);
+    p->directory = 0;
+}
+
+static void process_start(void *arg) {
+    struct process *p = (struct process*)arg;
+    enter_user_mode(p->entry, USER_STACK_TOP);
+}
+
+static void set_name(struct process *p, char *path) {
+    char *base = path;
+    int i;
+
+    for(char *c = path; *c; c++)
+        if(*c == '/')
+            base = c + 1;
+    for(i = 0; i < PROCESS_NAME_LEN - 1 && base[i]; i++)
+        p->name[i] = base[i];
+    p->name[i] = 0;
+}
+
+// starts the ELF program at path in the initrd. returns 0 if it can't be run
+struct process *process_spawn(char *path) {
+    struct process *p = 0;
+    struct thread *t;
+    uint8_t *image;
+    uint32_t size;
+    unsigned int flags;
+    int fd;
+
+    fd = vfs_open(path);
+    if(fd < 0)
+        return 0;
+    // the mapping outlives the descriptor, text pages are mapped from it directly
+    image = (uint8_t*)vfs_mmap(fd, &size);
+    vfs_close(fd);
+    if(image == 0)
+        return 0;
+
+    flags = interrupts_save();
+    for(int i = 0; i < MAX_PROCESSES; i++) {
+        if(processes[i].state == PROCESS_UNUSED) {
+            p = &processes[i];
+            p->state = PROCESS_RUNNING;
+            break;
+        }
+    }
+    interrupts_restore(flags);
+    if(p == 0)
+        return 0;
+
+    p->pid = next_pid++;
+    p->region_count = 0;
+    p->exit_waiters.head = p->exit_waiters.tail = 0;
+    set_name(p, path);
+    p->directory = paging_new_directory();
+    if(p->directory == 0) {
+        p->state = PROCESS_UNUSED;
+        return 0;
+    }
+
+    if(!elf_load(p, image, size)
+       || !process_add_region(p, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_TOP, 0, 0, 1)) {
+        release_memory(p);
+        p->state = PROCESS_UNUSED;
+        return 0;
+    }
+
+    // the scheduler must see the address space before the thread first runs
+    flags = interrupts_save();
+    t = thread_create(p->name, process_start, p, PRIORITY_NORMAL);
+    if(t)
+        t->process = p;
+    interrupts_restore(flags);
+    if(t == 0) {
+        release_memory(p);
+        p->state = PROCESS_UNUSED;
+        return 0;
+    }
+    p->thread = t;
+    return p;
+}
+
+// blocks until p exits, frees its slot and returns its exit code
+int process_wait(struct process *p) {
+    unsigned int flags = interrupts_save();
+    int code;
+
+    while(p->state != PROCESS_ZOMBIE)
+        wait_queue_sleep(&p->exit_waiters);
+    code = p->exit_code;
+    p->state = PROCESS_UNUSED;
+    interrupts_restore(flags);
+    return code;
+}
+
+// ends the calling thread's process, never returns
+void process_exit(int code) {
+    struct thread *t = thread_current();
+    struct process *p = t->process;
+
+    interrupts_save();
+    // stop using the address space before tearing it down
+    paging_switch(kernel_directory);
+    release_memory(p);
+    t->process = 0;
+    p->exit_code = code;
+    p->state = PROCESS_ZOMBIE;
+    wait_queue_wake_all(&p->exit_waiters);
+    thread_exit();
+}
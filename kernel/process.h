@@ -0,0 +1,51 @@
+#ifndef _PROCESS_H_
+#define _PROCESS_H_
+
+#include "../include/types.h"
+#include "sched.h"
+
+#define MAX_PROCESSES       8
+#define MAX_REGIONS         8
+#define PROCESS_NAME_LEN    16
+
+// page table entry bits the cpu leaves to the OS
+#define PTE_SHARED          0x200       // frame belongs to the shared text cache
+#define PTE_INITRD          0x400       // frame is part of the initrd archive itself
+
+// a range of user addresses and where its contents come from. bytes in
+// [file_vaddr, file_vaddr + file_size) are read from file_data, the rest is zero
+typedef struct vm_region {
+    uint32_t start;
+    uint32_t end;
+    uint32_t file_vaddr;
+    uint8_t *file_data;
+    uint32_t file_size;
+    int writable;
+} vm_region;
+
+enum process_state {
+    PROCESS_UNUSED = 0,
+    PROCESS_RUNNING,
+    PROCESS_ZOMBIE          // exited, waiting for process_wait to collect the exit code
+};
+
+typedef struct process {
+    int pid;
+    int state;
+    char name[PROCESS_NAME_LEN];
+    uint32_t *directory;
+    struct vm_region regions[MAX_REGIONS];
+    int region_count;
+    uint32_t entry;
+    struct thread *thread;
+    int exit_code;
+    struct wait_queue exit_waiters;
+} process;
+
+struct process *process_spawn(char *path);
+int process_wait(struct process *p);
+void process_exit(int code);
+int process_add_region(struct process *p, uint32_t start, uint32_t end, uint8_t *file_data, uint32_t file_size, int writable);
+int process_map_page(struct process *p, uint32_t page, int write);
+
+#endif
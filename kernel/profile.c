@@ -0,0 +1,216 @@
+#include "profile.h"
+#include "apic.h"
+#include "percpu.h"
+#include "memory.h"
+#include "sched.h"
+#include "printk.h"
+#include "../drivers/serial.h"
+#include "../drivers/timer.h"
+
+/* Sampling profiler. A timer interrupts every cpu hz times a second and
+*  the interrupted eip, plus the return addresses found by following the
+*  saved ebp chain of a kernel stack, goes into a hash table of distinct
+*  stacks of the running cpu, each with a count. Only the cpu owning a
+*  table writes it, from its timer interrupt, so there is no locking.
+*
+*  With a local APIC each cpu runs its own periodic timer on
+*  PROFILE_VECTOR and the BSP starts and stops the others with an IPI.
+*  Without one the PIT is sped up and timer_handler samples the BSP,
+*  still ticking the scheduler TIMER_HZ times a second. Code running
+*  with interrupts off is only seen once it enables them again, NMI
+*  sampling would need the performance counters set up.
+*
+*  profile_dump writes the tables to the serial line for
+*  scripts/profile.py to symbolize. */
+struct profile_buffer {
+    struct profile_entry *entries;
+    uint32_t samples;
+    uint32_t dropped;                   // the stack had no free slot
+};
+
+#define PROFILE_PAGES   (PROFILE_SLOTS * sizeof(struct profile_entry) / PAGE_SIZE)
+
+volatile int profile_pit;
+static volatile int profile_running;
+static volatile uint32_t profile_rate;  // hz of the running timers, 0 when stopped
+static uint32_t sampled_hz;             // rate of the last run, for the dump
+static struct profile_buffer buffers[MAX_CPUS];
+
+extern void profile_timer();            // boot/profile.asm
+extern void profile_ipi();
+
+static inline int profiled_cpus() {
+    return cpu_count > 0 ? cpu_count : 1;
+}
+
+/* Fills pc with the interrupted eip and the return addresses of its
+*  callers. The kernel keeps frame pointers, the walk stops at the
+*  zero ebp thread_start begins with or at anything that doesn't look
+*  like a frame further up the same stack. Returns the depth */
+static int profile_backtrace(struct regs *r, uint32_t *pc) {
+    // an interrupt from ring 0 doesn't switch stacks, the frame sits on the interrupted one
+    uint32_t bottom = (uint32_t)&r->useresp;
+    uint32_t top = bottom + THREAD_STACK_SIZE;
+    uint32_t *frame = (uint32_t*)r->ebp;
+    int depth = 0;
+
+    pc[depth++] = r->eip;
+    if(r->cs & 3)
+        return depth;                   // the program's stack is its own business
+    while(depth < PROFILE_DEPTH) {
+        uint32_t address = (uint32_t)frame;
+        if(address < bottom || address + 8 > top || (address & 3))
+            break;
+        pc[depth++] = frame[1];
+        bottom = address + 8;           // callers' frames are further up
+        frame = (uint32_t*)frame[0];
+    }
+    return depth;
+}
+
+// from the timer interrupt of the cpu being sampled
+void profile_sample(struct regs *r) {
+    struct profile_buffer *b = &buffers[cpu_self()->id];
+    uint32_t pc[PROFILE_DEPTH];
+    uint32_t hash = 2166136261u;
+    int depth, i;
+
+    if(!profile_running || b->entries == 0)
+        return;
+    depth = profile_backtrace(r, pc);
+    for(i = 0; i < depth; i++)
+        hash = (hash ^ pc[i]) * 16777619u;
+
+    b->samples++;
+    for(int probe = 0; probe < PROFILE_PROBES; probe++) {
+        struct profile_entry *e = &b->entries[(hash + probe) & (PROFILE_SLOTS - 1)];
+
+        if(e->count == 0) {
+            for(i = 0; i < depth; i++)
+                e->pc[i] = pc[i];
+            e->depth = depth;
+            e->user = r->cs & 3 ? 1 : 0;
+            e->count = 1;
+            return;
+        }
+        if(e->depth != depth)
+            continue;
+        for(i = 0; i < depth && e->pc[i] == pc[i]; i++);
+        if(i == depth) {
+            e->count++;
+            return;
+        }
+    }
+    b->dropped++;
+}
+
+/* Both stubs in boot/profile.asm end up here. The IPI makes the other
+*  cpus follow the BSP's timer setting */
+void profile_interrupt(struct regs *r) {
+    if(r->int_no == PROFILE_VECTOR) {
+        profile_sample(r);
+    } else {
+        if(profile_rate)
+            lapic_timer_periodic(PROFILE_VECTOR, profile_rate);
+        else
+            lapic_timer_stop();
+    }
+    lapic_eoi();
+}
+
+static void profile_timers(uint32_t hz) {
+    profile_rate = hz;
+    if(hz)
+        lapic_timer_periodic(PROFILE_VECTOR, hz);
+    else
+        lapic_timer_stop();
+    if(profiled_cpus() > 1)
+        lapic_send_ipi_others(PROFILE_IPI_VECTOR);
+}
+
+/* Empties the tables and starts sampling hz times a second, or the
+*  nearest rate the PIT fallback can do. -1 without memory for the tables */
+int profile_start(int hz) {
+    static int gates_set;
+
+    profile_stop();
+    if(hz < TIMER_HZ)
+        hz = TIMER_HZ;
+    if(hz > PROFILE_MAX_HZ)
+        hz = PROFILE_MAX_HZ;
+
+    for(int cpu = 0; cpu < profiled_cpus(); cpu++) {
+        struct profile_buffer *b = &buffers[cpu];
+        if(b->entries == 0) {
+            b->entries = (struct profile_entry*)frame_alloc_contiguous(PROFILE_PAGES);
+            if(b->entries == 0)
+                return -1;
+        }
+        for(int i = 0; i < PROFILE_SLOTS; i++)
+            b->entries[i].count = 0;
+        b->samples = 0;
+        b->dropped = 0;
+    }
+    profile_running = 1;
+
+    if(lapic_enabled) {
+        if(!gates_set) {
+            idt_set_gate(PROFILE_VECTOR, (unsigned)profile_timer, 0x08, 0x8E);
+            idt_set_gate(PROFILE_IPI_VECTOR, (unsigned)profile_ipi, 0x08, 0x8E);
+            lapic_timer_calibrate();
+            gates_set = 1;
+        }
+        profile_timers(hz);
+    } else {
+        hz -= hz % TIMER_HZ;
+        profile_rate = hz;
+        profile_pit = 1;
+        timer_set_rate(hz);
+    }
+    sampled_hz = hz;
+    return hz;
+}
+
+void profile_stop() {
+    if(!profile_running)
+        return;
+    profile_running = 0;
+    if(profile_pit) {
+        profile_pit = 0;
+        profile_rate = 0;
+        timer_set_rate(TIMER_HZ);
+    } else {
+        profile_timers(0);
+    }
+}
+
+/* Stops sampling and writes the tables out on the serial line:
+*    profile begin <hz> <cpus>
+*    S <cpu> <samples> <dropped>
+*    P <cpu> <count> <k|u> <eip> <return addresses>...   (hex, innermost first)
+*    profile end */
+void profile_dump() {
+    char line[32 + PROFILE_DEPTH * 9];
+    int length;
+
+    profile_stop();
+    length = snprintk(line, sizeof(line), "profile begin %u %d\n", sampled_hz, profiled_cpus());
+    serial_write(line, length);
+    for(int cpu = 0; cpu < profiled_cpus(); cpu++) {
+        struct profile_buffer *b = &buffers[cpu];
+
+        length = snprintk(line, sizeof(line), "S %d %u %u\n", cpu, b->samples, b->dropped);
+        serial_write(line, length);
+        for(int i = 0; b->entries && i < PROFILE_SLOTS; i++) {
+            struct profile_entry *e = &b->entries[i];
+            if(e->count == 0)
+                continue;
+            length = snprintk(line, sizeof(line), "P %d %u %c", cpu, e->count, e->user ? 'u' : 'k');
+            for(int j = 0; j < e->depth; j++)
+                length += snprintk(line + length, sizeof(line) - length, " %x", e->pc[j]);
+            line[length++] = '\n';
+            serial_write(line, length);
+        }
+    }
+    serial_write("profile end\n", 12);
+}
@@ -0,0 +1,30 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include "../include/types.h"
+#include "../include/system.h"
+
+#define PROFILE_HZ          1000        // default sampling rate
+#define PROFILE_MAX_HZ      10000
+#define PROFILE_DEPTH       8           // frames kept per sample, the interrupted eip first
+#define PROFILE_SLOTS       2048        // distinct stacks per cpu, a power of two
+#define PROFILE_PROBES      16          // slots looked at before a sample is dropped
+
+// one distinct stack and how often it was sampled
+typedef struct profile_entry {
+    uint32_t count;
+    uint16_t depth;
+    uint16_t user;                      // sampled in ring 3, pc[0] is a program address
+    uint32_t pc[PROFILE_DEPTH];
+} profile_entry;
+
+// set while the PIT takes the samples, see timer_handler
+extern volatile int profile_pit;
+
+void profile_sample(struct regs *r);
+void profile_interrupt(struct regs *r);
+int profile_start(int hz);
+void profile_stop();
+void profile_dump();
+
+#endif
@@ -0,0 +1,340 @@
+#include "sched.h"
+#include "low_level.h"
+#include "percpu.h"
+#include "paging.h"
+#include "process.h"
+#include "trace.h"
+#include "../drivers/screen.h"
+#include "../include/conversion.h"
+
+// implemented in boot/switch_context.asm. saves the callee saved registers
+// on the current stack, stores esp in *old_esp and resumes the stack at new_esp
+extern void switch_context(uint32_t *old_esp, uint32_t new_esp);
+
+struct thread threads[MAX_THREADS];
+uint8_t thread_stacks[MAX_THREADS][THREAD_STACK_SIZE] __attribute__((aligned(16)));
+
+// the thread running on this cpu. only the BSP runs threads, the
+// application processors serve the work pool (kernel/workpool.c)
+#define current (cpu_self()->current)
+static struct thread *idle_thread;
+
+// one fifo per priority level plus a bitmap of the non-empty levels
+static struct thread *run_head[SCHED_PRIORITIES];
+static struct thread *run_tail[SCHED_PRIORITIES];
+static uint32_t run_bitmap;
+
+// threads waiting for the timer, sorted by wake_tick so a tick only looks at the head
+static struct thread *sleep_head;
+
+static volatile uint32_t ticks;
+static volatile int need_resched;
+static int next_thread_id;
+
+static inline int find_first_set(uint32_t bits) {
+    int index;
+    __asm__("bsf %1, %0" : "=r"(index) : "rm"(bits));
+    return index;
+}
+
+// tick comparison that keeps working when the counter wraps around
+static inline int tick_reached(uint32_t now, uint32_t deadline) {
+    return (int)(now - deadline) >= 0;
+}
+
+static void runqueue_push(struct thread *t) {
+    t->next = 0;
+    t->state = THREAD_READY;
+    if(run_tail[t->priority])
+        run_tail[t->priority]->next = t;
+    else
+        run_head[t->priority] = t;
+    run_tail[t->priority] = t;
+    run_bitmap |= 1 << t->priority;
+}
+
+static struct thread *runqueue_pop() {
+    int priority = find_first_set(run_bitmap);
+    struct thread *t = run_head[priority];
+
+    run_head[priority] = t->next;
+    if(run_head[priority] == 0) {
+        run_tail[priority] = 0;
+        run_bitmap &= ~(1 << priority);
+    }
+    t->next = 0;
+    return t;
+}
+
+static void copy_name(char *dest, char *src) {
+    int i;
+    for(i = 0; i < THREAD_NAME_LEN - 1 && src[i] != 0; i++)
+        dest[i] = src[i];
+    dest[i] = 0;
+}
+
+// every new thread starts here, switch_context "returns" into it
+static void thread_start() {
+    __asm__ __volatile__("sti");
+    current->entry(current->arg);
+    thread_exit();
+}
+
+static void idle(void *arg) {
+    while(1)
+        __asm__ __volatile__("hlt");
+}
+
+// turns the boot flow of control into the first thread and starts the idle thread
+void sched_init() {
+    struct thread *boot = &threads[0];
+
+    boot->id = next_thread_id++;
+    boot->priority = PRIORITY_NORMAL;
+    boot->state = THREAD_RUNNING;
+    boot->timeslice = SCHED_TIMESLICE;
+    boot->stack = 0;                    // keeps running on the stack set up by the bootloader
+    copy_name(boot->name, "main");
+    current = boot;
+
+    idle_thread = thread_create("idle", idle, 0, PRIORITY_IDLE);
+}
+
+struct thread *thread_create(char *name, void (*entry)(void *arg), void *arg, int priority) {
+    struct thread *t = 0;
+    uint32_t *stack;
+    unsigned int flags = interrupts_save();
+    int i;
+
+    // slot 0 is the boot thread, it has no stack of its own to hand out
+    for(i = 1; i < MAX_THREADS; i++) {
+        if((threads[i].state == THREAD_UNUSED || threads[i].state == THREAD_DEAD) && &threads[i] != current) {
+            t = &threads[i];
+            break;
+        }
+    }
+    if(t == 0) {
+        interrupts_restore(flags);
+        return 0;
+    }
+
+    t->id = next_thread_id++;
+    t->priority = priority;
+    t->timeslice = SCHED_TIMESLICE;
+    t->entry = entry;
+    t->arg = arg;
+    t->stack = thread_stacks[i];
+    t->process = 0;
+    copy_name(t->name, name);
+
+    // build the frame switch_context pops: edi, esi, ebx, ebp and the return address
+    stack = (uint32_t*)(t->stack + THREAD_STACK_SIZE);
+    *--stack = 0;                       // fake return address for thread_start
+    *--stack = (uint32_t)thread_start;
+    *--stack = 0;                       // ebp
+    *--stack = 0;                       // ebx
+    *--stack = 0;                       // esi
+    *--stack = 0;                       // edi
+    t->esp = (uint32_t)stack;
+
+    runqueue_push(t);
+    if(priority < current->priority)
+        need_resched = 1;
+    interrupts_restore(flags);
+    return t;
+}
+
+struct thread *thread_current() {
+    return current;
+}
+
+// pick the most urgent ready thread and switch to it. the current thread
+// goes back on the run queue unless it is blocking, sleeping or exiting
+void schedule() {
+    unsigned int flags = interrupts_save();
+    struct thread *prev = current;
+    struct thread *next;
+
+    need_resched = 0;
+    if(prev->state == THREAD_RUNNING)
+        runqueue_push(prev);
+
+    next = runqueue_pop();
+    next->state = THREAD_RUNNING;
+    if(next->timeslice <= 0)
+        next->timeslice = SCHED_TIMESLICE;
+
+    if(next != prev) {
+        current = next;
+        // where the cpu switches to when the thread enters the kernel from ring 3
+        if(next->stack)
+            cpu_self()->tss.esp0 = (uint32_t)(next->stack + THREAD_STACK_SIZE);
+        // kernel threads run in whatever address space is loaded
+        if(next->process)
+            paging_switch(next->process->directory);
+        trace(TRACE_SWITCH, prev->id << 16 | next->id);
+        switch_context(&prev->esp, next->esp);
+    }
+    interrupts_restore(flags);
+}
+
+void thread_yield() {
+    current->timeslice = 0;
+    schedule();
+}
+
+void thread_sleep(uint32_t ticks_to_sleep) {
+    unsigned int flags = interrupts_save();
+    struct thread **link = &sleep_head;
+
+    current->wake_tick = ticks + ticks_to_sleep;
+    current->state = THREAD_SLEEPING;
+    while(*link && tick_reached(current->wake_tick, (*link)->wake_tick))
+        link = &(*link)->next;
+    current->next = *link;
+    *link = current;
+
+    schedule();
+    interrupts_restore(flags);
+}
+
+void thread_exit() {
+    interrupts_save();
+    current->state = THREAD_DEAD;
+    schedule();
+    // a dead thread is never picked again
+    for(;;);
+}
+
+// makes a sleeping or blocked thread runnable again. safe to call from an IRQ handler
+void thread_wake(struct thread *t) {
+    unsigned int flags = interrupts_save();
+    struct thread **link;
+
+    if(t->state == THREAD_SLEEPING) {
+        for(link = &sleep_head; *link; link = &(*link)->next) {
+            if(*link == t) {
+                *link = t->next;
+                break;
+            }
+        }
+    }
+    if(t->state == THREAD_SLEEPING || t->state == THREAD_BLOCKED) {
+        runqueue_push(t);
+        if(t->priority < current->priority)
+            need_resched = 1;
+    }
+    interrupts_restore(flags);
+}
+
+// blocks the current thread on wq. callers check their condition with
+// interrupts disabled and call this in a loop, so a wake up from an IRQ
+// handler can't slip in between the check and the sleep
+void wait_queue_sleep(struct wait_queue *wq) {
+    unsigned int flags = interrupts_save();
+
+    current->state = THREAD_BLOCKED;
+    current->next = 0;
+    if(wq->tail)
+        wq->tail->next = current;
+    else
+        wq->head = current;
+    wq->tail = current;
+
+    schedule();
+    interrupts_restore(flags);
+}
+
+void wait_queue_wake_one(struct wait_queue *wq) {
+    unsigned int flags = interrupts_save();
+    struct thread *t = wq->head;
+
+    if(t) {
+        wq->head = t->next;
+        if(wq->head == 0)
+            wq->tail = 0;
+        thread_wake(t);
+    }
+    interrupts_restore(flags);
+}
+
+void wait_queue_wake_all(struct wait_queue *wq) {
+    unsigned int flags = interrupts_save();
+
+    while(wq->head)
+        wait_queue_wake_one(wq);
+    interrupts_restore(flags);
+}
+
+// called from the timer IRQ: wakes expired sleepers and charges the running thread
+void sched_tick() {
+    struct thread *t;
+
+    ticks++;
+    while(sleep_head && tick_reached(ticks, sleep_head->wake_tick)) {
+        t = sleep_head;
+        sleep_head = t->next;
+        runqueue_push(t);
+        if(t->priority < current->priority)
+            need_resched = 1;
+    }
+
+    if(--current->timeslice <= 0)
+        need_resched = 1;
+}
+
+// called at the end of every IRQ once the PIC has been acknowledged
+void sched_preempt() {
+    if(need_resched)
+        schedule();
+}
+
+uint32_t sched_ticks() {
+    return ticks;
+}
+
+/* context switch benchmark: two threads of the same priority hand the cpu
+*  back and forth with thread_yield, every yield is one full switch */
+#define BENCH_SWITCHES 10000
+
+static volatile int bench_finished;
+static struct wait_queue bench_waiters;
+static unsigned long long bench_start, bench_end;
+
+static void bench_pingpong(void *arg) {
+    int i;
+
+    if(arg == 0)
+        bench_start = rdtsc();
+    for(i = 0; i < BENCH_SWITCHES; i++)
+        thread_yield();
+
+    if(++bench_finished == 2) {
+        bench_end = rdtsc();
+        wait_queue_wake_one(&bench_waiters);
+    }
+}
+
+// cycles per switch, must be called from a thread
+uint32_t sched_switch_cycles() {
+    unsigned int flags;
+
+    bench_finished = 0;
+    thread_create("bench-a", bench_pingpong, (void*)0, PRIORITY_HIGH);
+    thread_create("bench-b", bench_pingpong, (void*)1, PRIORITY_HIGH);
+
+    flags = interrupts_save();
+    while(bench_finished != 2)
+        wait_queue_sleep(&bench_waiters);
+    interrupts_restore(flags);
+
+    return (uint32_t)divide64(bench_end - bench_start, 2 * BENCH_SWITCHES, 0);
+}
+
+void sched_benchmark() {
+    uint32_t cycles = sched_switch_cycles();
+
+    printf("context switch: ", -1, -1);
+    printf(itoa(cycles), -1, -1);
+    printf(" cycles\n", -1, -1);
+}
@@ -0,0 +1,72 @@
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include "../include/types.h"
+
+struct process;
+
+#define MAX_THREADS         16
+#define THREAD_STACK_SIZE   4096
+#define THREAD_NAME_LEN     16
+
+// 32 priority levels, 0 is the most urgent. one bit per level in the run
+// queue bitmap, so picking the next thread is a single bsf instruction.
+#define SCHED_PRIORITIES    32
+#define PRIORITY_HIGH       4
+#define PRIORITY_NORMAL     16
+#define PRIORITY_IDLE       (SCHED_PRIORITIES - 1)
+
+// timer ticks a thread may run before a thread of the same priority gets the cpu
+#define SCHED_TIMESLICE     5
+
+enum thread_state {
+    THREAD_UNUSED = 0,
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_SLEEPING,
+    THREAD_BLOCKED,
+    THREAD_DEAD
+};
+
+typedef struct thread {
+    uint32_t esp;               // saved stack pointer, switch_context relies on this being first
+    int id;
+    int priority;
+    int state;
+    int timeslice;
+    uint32_t wake_tick;         // timer tick to wake up at while THREAD_SLEEPING
+    struct thread *next;        // run queue, sleep queue or wait queue link
+    void (*entry)(void *arg);
+    void *arg;
+    char name[THREAD_NAME_LEN];
+    uint8_t *stack;
+    struct process *process;    // user address space, 0 for kernel threads
+} thread;
+
+// a list of threads blocked until some event, e.g. a key press
+typedef struct wait_queue {
+    struct thread *head;
+    struct thread *tail;
+} wait_queue;
+
+void sched_init();
+struct thread *thread_create(char *name, void (*entry)(void *arg), void *arg, int priority);
+struct thread *thread_current();
+void thread_yield();
+void thread_sleep(uint32_t ticks);
+void thread_exit();
+void thread_wake(struct thread *t);
+
+void wait_queue_sleep(struct wait_queue *wq);
+void wait_queue_wake_one(struct wait_queue *wq);
+void wait_queue_wake_all(struct wait_queue *wq);
+
+void sched_tick();
+void sched_preempt();
+void schedule();
+uint32_t sched_ticks();
+
+uint32_t sched_switch_cycles();
+void sched_benchmark();
+
+#endif
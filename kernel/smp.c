@@ -0,0 +1,106 @@
+#include "smp.h"
+#include "acpi.h"
+#include "apic.h"
+#include "percpu.h"
+#include "workpool.h"
+#include "syscall.h"
+#include "paging.h"
+#include "../include/system.h"
+#include "../drivers/timer.h"
+#include "../tools/utils.h"
+
+extern char ap_trampoline_start, ap_trampoline_end;
+extern void ipi_wakeup();
+extern void lapic_spurious();
+extern void idt_load();
+
+uint8_t ap_stacks[MAX_CPUS][AP_STACK_SIZE] __attribute__((aligned(16)));
+
+// read by the trampoline and ap_main of the AP currently starting
+volatile uint32_t ap_boot_esp;
+volatile int ap_boot_cpu;
+
+// fills cpus[] from the MADT, the BSP stays cpus[0]
+static int madt_enumerate(struct madt *madt) {
+    uint8_t *p = (uint8_t*)(madt + 1);
+    uint8_t *end = (uint8_t*)madt + madt->header.length;
+    int bsp_apic_id;
+
+    lapic_base = madt->lapic_address;
+    for(; p < end; p += ((struct madt_entry*)p)->length) {
+        struct madt_entry *entry = (struct madt_entry*)p;
+        if(entry->type == MADT_LAPIC_OVERRIDE)
+            lapic_base = (uint32_t)((struct madt_lapic_override*)entry)->address;
+    }
+
+    bsp_apic_id = lapic_id();
+    cpus[0].apic_id = bsp_apic_id;
+    for(p = (uint8_t*)(madt + 1); p < end; p += ((struct madt_entry*)p)->length) {
+        struct madt_lapic *lapic = (struct madt_lapic*)p;
+        if(lapic->entry.type != MADT_LAPIC || !(lapic->flags & MADT_LAPIC_ENABLED))
+            continue;
+        if(lapic->apic_id == bsp_apic_id || cpu_count == MAX_CPUS)
+            continue;
+        cpus[cpu_count].id = cpu_count;
+        cpus[cpu_count].apic_id = lapic->apic_id;
+        cpu_count++;
+    }
+    return cpu_count;
+}
+
+// first C code on an AP, running on the stack from ap_stacks
+void ap_main() {
+    struct cpu *c = &cpus[ap_boot_cpu];
+
+    gdt_install_cpu(c);
+    paging_init_cpu();
+    idt_load();
+    syscall_init_cpu(c);
+    lapic_enable();
+    c->online = 1;
+
+    __asm__ __volatile__("sti");
+    pool_worker();
+}
+
+// INIT-SIPI-SIPI, then wait up to 100 ms for the AP to check in
+static int start_ap(struct cpu *c) {
+    int waited;
+
+    ap_boot_cpu = c->id;
+    ap_boot_esp = (uint32_t)(ap_stacks[c->id] + AP_STACK_SIZE);
+
+    lapic_send_init(c->apic_id);
+    udelay(10000);
+    lapic_send_startup(c->apic_id, AP_TRAMPOLINE);
+    udelay(200);
+    if(!c->online)
+        lapic_send_startup(c->apic_id, AP_TRAMPOLINE);
+
+    for(waited = 0; !c->online && waited < 100; waited++)
+        udelay(1000);
+    return c->online;
+}
+
+// brings up every enabled cpu the MADT lists. returns the number of cpus online
+int smp_init() {
+    struct madt *madt;
+    int online = 1;
+
+    if(!acpi_init())
+        return 1;
+    madt = (struct madt*)acpi_find_table("APIC");
+    if(madt == 0)
+        return 1;
+
+    madt_enumerate(madt);
+    paging_map_mmio(lapic_base, 4096);
+    lapic_enable();
+    idt_set_gate(IPI_WAKEUP_VECTOR, (unsigned)ipi_wakeup, 0x08, 0x8E);
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, (unsigned)lapic_spurious, 0x08, 0x8E);
+
+    memory_copy(&ap_trampoline_start, (char*)AP_TRAMPOLINE, &ap_trampoline_end - &ap_trampoline_start);
+    for(int i = 1; i < cpu_count; i++)
+        online += start_ap(&cpus[i]);
+    return online;
+}
@@ -0,0 +1,8 @@
+#ifndef _SMP_H_
+#define _SMP_H_
+
+#define AP_TRAMPOLINE       0x8000      // must match boot/smp.asm
+
+int smp_init();
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _SPINLOCK_H_
+#define _SPINLOCK_H_
+
+#include "../include/types.h"
+#include "low_level.h"
+
+// ticket lock: cpus take a ticket and are served in order, so no cpu can
+// starve under contention. the irqsave variants also keep the local cpu's
+// IRQ handlers out, which any lock shared with an IRQ handler needs.
+typedef struct spinlock {
+    volatile uint16_t next;
+    volatile uint16_t owner;
+} spinlock;
+
+#define SPINLOCK_INIT { 0, 0 }
+
+static inline void spin_lock(struct spinlock *lock) {
+    uint16_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    while(__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket)
+        __asm__ __volatile__("pause");
+}
+
+static inline void spin_unlock(struct spinlock *lock) {
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+static inline unsigned int spin_lock_irqsave(struct spinlock *lock) {
+    unsigned int flags = interrupts_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(struct spinlock *lock, unsigned int flags) {
+    spin_unlock(lock);
+    interrupts_restore(flags);
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include "syscall.h"
+#include "gdt.h"
+#include "percpu.h"
+#include "sched.h"
+#include "low_level.h"
+#include "paging.h"
+#include "process.h"
+#include "trace.h"
+#include "../include/system.h"
+#include "../drivers/screen.h"
+#include <cpuid.h>
+
+extern void isr128();
+extern void sysenter_entry();
+
+typedef int (*syscall_fn)(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+static int sys_exit(uint32_t code, uint32_t unused1, uint32_t unused2) {
+    if(thread_current()->process)
+        process_exit(code);
+    thread_exit();
+    return 0;
+}
+
+static int sys_write(uint32_t buffer, uint32_t length, uint32_t unused) {
+    char *text = (char*)buffer;
+    if(buffer < USER_BASE || buffer + length > USER_END || buffer + length < buffer)
+        return -1;
+    for(uint32_t i = 0; i < length; i++)
+        print_char(text[i], -1, -1, 0);
+    return length;
+}
+
+static int sys_yield(uint32_t unused1, uint32_t unused2, uint32_t unused3) {
+    thread_yield();
+    return 0;
+}
+
+static int sys_sleep(uint32_t ticks, uint32_t unused1, uint32_t unused2) {
+    thread_sleep(ticks);
+    return 0;
+}
+
+static int sys_getpid(uint32_t unused1, uint32_t unused2, uint32_t unused3) {
+    return thread_current()->id;
+}
+
+static syscall_fn syscall_table[SYSCALL_COUNT] =
+{
+    sys_exit,
+    sys_write,
+    sys_yield,
+    sys_sleep,
+    sys_getpid
+};
+
+/* Both entry paths in boot/syscall.asm end up here */
+void syscall_handler(struct regs *r) {
+    if(r->eax >= SYSCALL_COUNT) {
+        r->eax = -1;
+        return;
+    }
+    trace(TRACE_SYSCALL_ENTRY, r->eax);
+    r->eax = syscall_table[r->eax](r->ebx, r->esi, r->edi);
+    trace(TRACE_SYSCALL_EXIT, r->eax);
+}
+
+int sysenter_supported() {
+    unsigned int eax, ebx, ecx, edx;
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (edx & CPUID_EDX_SEP) != 0;
+}
+
+/* The sysenter MSRs are per cpu. SYSENTER_ESP points at the cpu's
+*  tss.esp0, which the scheduler keeps at the running thread's kernel
+*  stack, so sysenter_entry finds that stack with a single load */
+void syscall_init_cpu(struct cpu *c) {
+    if(!sysenter_supported())
+        return;
+    wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)&c->tss.esp0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
+void syscall_install() {
+    /* DPL 3 gate so user code may raise it */
+    idt_set_gate(SYSCALL_VECTOR, (unsigned)isr128, 0x08, 0xEE);
+    syscall_init_cpu(cpu_self());
+}
@@ -0,0 +1,29 @@
+#ifndef _SYSCALL_H_
+#define _SYSCALL_H_
+
+#include "../include/types.h"
+
+/* System call ABI, the same for 'sysenter' and 'int 0x80':
+*  eax = call number, ebx, esi, edi = arguments, result in eax.
+*  sysenter callers also pass their return address in edx and their
+*  stack pointer in ecx, so those two never carry arguments. */
+#define SYS_EXIT        0
+#define SYS_WRITE       1
+#define SYS_YIELD       2
+#define SYS_SLEEP       3
+#define SYS_GETPID      4
+#define SYSCALL_COUNT   5
+
+#define SYSCALL_VECTOR  0x80
+#define CPUID_EDX_SEP   (1 << 11)   // sysenter/sysexit present
+
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
+struct cpu;
+void syscall_install();
+void syscall_init_cpu(struct cpu *c);
+int sysenter_supported();
+
+#endif
@@ -0,0 +1,119 @@
+#include "trace.h"
+#include "percpu.h"
+#include "memory.h"
+#include "low_level.h"
+#include "printk.h"
+#include "../drivers/serial.h"
+#include "../drivers/timer.h"
+
+/* Event tracing. Tracepoints in the interrupt, exception and syscall
+*  paths, the scheduler and the block drivers record a TSC timestamp, an
+*  event id and a 32 bit payload into a ring of the running cpu. A cpu
+*  only writes its own ring, so recording is a slot claimed with one
+*  atomic add (an interrupt may nest into a tracepoint) and three stores.
+*  The rings are allocated when tracing starts; while it is off every
+*  tracepoint is a load and a branch.
+*  trace_dump writes the rings to the serial line as text, one event per
+*  line, for scripts/trace2json.py to turn into the Chrome trace format
+*  that chrome://tracing and Perfetto load. */
+struct trace_buffer {
+    struct trace_event *events;
+    volatile uint32_t head;             // free running, the next slot to claim
+};
+
+#define TRACE_PAGES     (TRACE_EVENTS * sizeof(struct trace_event) / PAGE_SIZE)
+
+volatile int trace_enabled;
+static struct trace_buffer buffers[MAX_CPUS];
+
+void trace_record(uint32_t id, uint32_t payload) {
+    struct trace_buffer *b = &buffers[cpu_self()->id];
+    struct trace_event *e;
+
+    if(b->events == 0)
+        return;
+    e = &b->events[__atomic_fetch_add(&b->head, 1, __ATOMIC_RELAXED) & (TRACE_EVENTS - 1)];
+    e->timestamp = rdtsc();
+    e->id = id;
+    e->payload = payload;
+}
+
+static inline int traced_cpus() {
+    return cpu_count > 0 ? cpu_count : 1;
+}
+
+// empties the rings and turns the tracepoints on. -1 without memory for the rings
+int trace_start() {
+    trace_enabled = 0;
+    for(int i = 0; i < traced_cpus(); i++) {
+        if(buffers[i].events == 0) {
+            buffers[i].events = (struct trace_event*)frame_alloc_contiguous(TRACE_PAGES);
+            if(buffers[i].events == 0)
+                return -1;
+        }
+        buffers[i].head = 0;
+    }
+    trace_enabled = 1;
+    return 0;
+}
+
+void trace_stop() {
+    trace_enabled = 0;
+}
+
+/* Stops tracing and writes the rings out on the serial line, oldest
+*  event first:
+*    trace begin <tsc_per_us> <cpus>
+*    T <cpu> <timestamp, 16 hex digits> <id> <payload in hex>
+*    trace end */
+void trace_dump() {
+    char line[64];
+    int length;
+
+    trace_stop();
+    length = snprintk(line, sizeof(line), "trace begin %u %d\n", tsc_per_us, traced_cpus());
+    serial_write(line, length);
+    for(int cpu = 0; cpu < traced_cpus(); cpu++) {
+        struct trace_buffer *b = &buffers[cpu];
+        uint32_t first = b->head > TRACE_EVENTS ? b->head - TRACE_EVENTS : 0;
+
+        for(uint32_t i = first; b->events && i != b->head; i++) {
+            struct trace_event *e = &b->events[i & (TRACE_EVENTS - 1)];
+            length = snprintk(line, sizeof(line), "T %d %08x%08x %u %x\n", cpu,
+                              (uint32_t)(e->timestamp >> 32), (uint32_t)e->timestamp, e->id, e->payload);
+            serial_write(line, length);
+        }
+    }
+    serial_write("trace end\n", 10);
+}
+
+/* cost of a tracepoint while tracing is off and while it records */
+#define BENCH_CALLS     100000
+
+static uint32_t bench_tracepoints() {
+    unsigned long long start = rdtsc();
+
+    for(int i = 0; i < BENCH_CALLS; i++) {
+        trace(TRACE_BCACHE_MISS, i);
+        __asm__ __volatile__("" ::: "memory");     // keep the loop
+    }
+    return (uint32_t)divide64(rdtsc() - start, BENCH_CALLS / 100, 0);
+}
+
+void trace_benchmark() {
+    uint32_t off, on;
+    int was_enabled = trace_enabled;
+
+    trace_stop();
+    off = bench_tracepoints();
+    if(trace_start() < 0) {
+        printk("not enough memory for the trace buffers\n");
+        return;
+    }
+    on = bench_tracepoints();
+    if(!was_enabled)
+        trace_stop();
+
+    printk("tracepoint: %u.%02u cycles off, %u.%02u cycles on\n",
+           off / 100, off % 100, on / 100, on % 100);
+}
@@ -0,0 +1,43 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "../include/types.h"
+
+// events per cpu, a power of two. the oldest are overwritten
+#define TRACE_EVENTS        4096
+
+// event ids, scripts/trace2json.py knows them by number
+#define TRACE_IRQ_ENTRY     1           // payload: vector
+#define TRACE_IRQ_EXIT      2
+#define TRACE_FAULT_ENTRY   3           // payload: exception number
+#define TRACE_FAULT_EXIT    4
+#define TRACE_SWITCH        5           // payload: previous thread id << 16 | next thread id
+#define TRACE_BLOCK_SUBMIT  6           // payload: sector
+#define TRACE_BLOCK_DONE    7           // payload: sector
+#define TRACE_BCACHE_MISS   8           // payload: block
+#define TRACE_SYSCALL_ENTRY 9           // payload: syscall number
+#define TRACE_SYSCALL_EXIT  10
+
+typedef struct trace_event {
+    unsigned long long timestamp;       // TSC
+    uint32_t id;
+    uint32_t payload;
+} trace_event;
+
+extern volatile int trace_enabled;
+
+void trace_record(uint32_t id, uint32_t payload);
+
+/* A tracepoint. While tracing is off it costs a load and a branch that
+*  is predicted not taken */
+static inline void trace(uint32_t id, uint32_t payload) {
+    if(__builtin_expect(trace_enabled, 0))
+        trace_record(id, payload);
+}
+
+int trace_start();
+void trace_stop();
+void trace_dump();
+void trace_benchmark();
+
+#endif
@@ -0,0 +1,208 @@
+#include "workpool.h"
+#include "percpu.h"
+#include "apic.h"
+#include "sched.h"
+#include "low_level.h"
+#include "../drivers/screen.h"
+#include "../drivers/vesa_vbe/vbe.h"
+#include "../include/conversion.h"
+
+typedef struct pool_job {
+    pool_fn fn;
+    void *arg;
+    volatile int remaining;
+} pool_job;
+
+static struct pool_deque deques[MAX_CPUS];
+
+// parallel_for pushes onto the calling cpu's deque, which only one thread may own at a time
+static volatile int pool_busy;
+
+static int deque_push(struct pool_deque *d, struct pool_task *task) {
+    int bottom = d->bottom;
+    int top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+    if(bottom - top >= POOL_DEQUE_SIZE)
+        return 0;
+    d->tasks[bottom & (POOL_DEQUE_SIZE - 1)] = task;
+    __atomic_store_n(&d->bottom, bottom + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static struct pool_task *deque_pop(struct pool_deque *d) {
+    int bottom = d->bottom - 1;
+    int top;
+    struct pool_task *task;
+
+    d->bottom = bottom;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    top = d->top;
+    if(top > bottom) {
+        d->bottom = bottom + 1;
+        return 0;
+    }
+
+    task = d->tasks[bottom & (POOL_DEQUE_SIZE - 1)];
+    if(top == bottom) {
+        // last task, a thief may be taking it right now
+        if(!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            task = 0;
+        d->bottom = bottom + 1;
+    }
+    return task;
+}
+
+static struct pool_task *deque_steal(struct pool_deque *d) {
+    int top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    int bottom;
+    struct pool_task *task;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bottom = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if(top >= bottom)
+        return 0;
+
+    task = d->tasks[top & (POOL_DEQUE_SIZE - 1)];
+    if(!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return 0;
+    return task;
+}
+
+static void task_run(struct pool_task *task) {
+    task->job->fn(task->job->arg, task->begin, task->end);
+    __atomic_fetch_sub(&task->job->remaining, 1, __ATOMIC_RELEASE);
+}
+
+// tries every other cpu's deque once, starting with the next one along
+static struct pool_task *steal_any(int self) {
+    struct pool_task *task;
+
+    for(int i = 1; i < cpu_count; i++) {
+        task = deque_steal(&deques[(self + i) % cpu_count]);
+        if(task)
+            return task;
+    }
+    return 0;
+}
+
+static int work_available() {
+    for(int i = 0; i < cpu_count; i++)
+        if(deques[i].top < deques[i].bottom)
+            return 1;
+    return 0;
+}
+
+// splits [begin, end) into chunks of at least grain items, runs fn on
+// every chunk using every online cpu and returns once all are done
+void parallel_for(int begin, int end, int grain, pool_fn fn, void *arg) {
+    struct pool_task tasks[POOL_MAX_TASKS];
+    struct pool_job job;
+    struct pool_deque *own;
+    struct pool_task *task;
+    int count, chunk, i;
+
+    if(end <= begin)
+        return;
+    if(grain < 1)
+        grain = 1;
+    count = (end - begin + grain - 1) / grain;
+    if(count > POOL_MAX_TASKS)
+        count = POOL_MAX_TASKS;
+    chunk = (end - begin + count - 1) / count;
+
+    while(__atomic_exchange_n(&pool_busy, 1, __ATOMIC_ACQUIRE))
+        thread_yield();
+    own = &deques[cpu_self()->id];
+
+    job.fn = fn;
+    job.arg = arg;
+    job.remaining = 0;
+    for(i = 0; begin < end; i++) {
+        tasks[i].job = &job;
+        tasks[i].begin = begin;
+        tasks[i].end = begin + chunk < end ? begin + chunk : end;
+        begin = tasks[i].end;
+        __atomic_fetch_add(&job.remaining, 1, __ATOMIC_RELAXED);
+        if(!deque_push(own, &tasks[i]))
+            task_run(&tasks[i]);
+    }
+    if(cpu_count > 1)
+        lapic_send_ipi_others(IPI_WAKEUP_VECTOR);
+
+    // help out until the last chunk, possibly running on another cpu, is done
+    while(__atomic_load_n(&job.remaining, __ATOMIC_ACQUIRE) > 0) {
+        task = deque_pop(own);
+        if(task)
+            task_run(task);
+        else
+            __asm__ __volatile__("pause");
+    }
+
+    __atomic_store_n(&pool_busy, 0, __ATOMIC_RELEASE);
+}
+
+// main loop of every application processor
+void pool_worker() {
+    int self = cpu_self()->id;
+    int spins = 0;
+    struct pool_task *task;
+
+    while(1) {
+        task = steal_any(self);
+        if(task) {
+            task_run(task);
+            spins = 0;
+        } else if(++spins < POOL_IDLE_SPINS) {
+            __asm__ __volatile__("pause");
+        } else {
+            // sti only takes effect after hlt, so a wake up IPI can't slip in between
+            __asm__ __volatile__("cli");
+            if(work_available())
+                __asm__ __volatile__("sti");
+            else
+                __asm__ __volatile__("sti\n\thlt");
+            spins = 0;
+        }
+    }
+}
+
+/* parallel blit benchmark: fills the whole framebuffer with a gradient,
+*  first on the BSP alone and then split across all cpus */
+#define BENCH_ROUNDS 10
+#define BENCH_ROWS_PER_TASK 16
+
+static void blit_rows(void *arg, int begin, int end) {
+    uint32_t color = (uint32_t)arg;
+    uint8_t *fb = (uint8_t*)(uintptr_t)vbe_mode->framebuffer;
+    int words = vbe_mode->pitch / 4;
+
+    for(int y = begin; y < end; y++) {
+        uint32_t *row = (uint32_t*)(fb + y * vbe_mode->pitch);
+        uint32_t pixel = color + (y << 8);
+        for(int x = 0; x < words; x++)
+            row[x] = pixel;
+    }
+}
+
+void pool_benchmark() {
+    unsigned long long start, serial, parallel;
+    int round;
+
+    start = rdtsc();
+    for(round = 0; round < BENCH_ROUNDS; round++)
+        blit_rows((void*)round, 0, vbe_mode->height);
+    serial = rdtsc() - start;
+
+    start = rdtsc();
+    for(round = 0; round < BENCH_ROUNDS; round++)
+        parallel_for(0, vbe_mode->height, BENCH_ROWS_PER_TASK, blit_rows, (void*)round);
+    parallel = rdtsc() - start;
+
+    printf("cpus: ", -1, -1);
+    printf(itoa(cpu_count), -1, -1);
+    printf("\nblit 1 cpu: ", -1, -1);
+    printf(itoa((uint32_t)divide64(serial, BENCH_ROUNDS, 0)), -1, -1);
+    printf(" cycles\nblit all cpus: ", -1, -1);
+    printf(itoa((uint32_t)divide64(parallel, BENCH_ROUNDS, 0)), -1, -1);
+    printf(" cycles\n", -1, -1);
+}
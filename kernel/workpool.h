@@ -0,0 +1,34 @@
+#ifndef _WORKPOOL_H_
+#define _WORKPOOL_H_
+
+#include "../include/types.h"
+
+#define POOL_DEQUE_SIZE     256         // power of two
+#define POOL_MAX_TASKS      64          // chunks a single parallel_for is split into
+#define POOL_IDLE_SPINS     10000       // steal attempts before an idle cpu halts
+
+struct pool_job;
+
+// one chunk [begin, end) of a parallel_for
+typedef struct pool_task {
+    struct pool_job *job;
+    int begin;
+    int end;
+} pool_task;
+
+// Chase-Lev work stealing deque. the owning cpu pushes and pops at the
+// bottom without atomics in the common case, thieves take from the top
+// with a compare and swap
+typedef struct pool_deque {
+    volatile int top;
+    volatile int bottom;
+    struct pool_task *tasks[POOL_DEQUE_SIZE];
+} pool_deque;
+
+typedef void (*pool_fn)(void *arg, int begin, int end);
+
+void parallel_for(int begin, int end, int grain, pool_fn fn, void *arg);
+void pool_worker();
+void pool_benchmark();
+
+#endif
@@ -0,0 +1,78 @@
+#include "net.h"
+#include "udp.h"
+
+/* IPv4 and ICMP. Only packets for NET_ADDRESS or the broadcast address
+*  are taken in, fragments are dropped and nothing is forwarded. ICMP
+*  answers echo requests, the reply goes out in the request's buffer */
+
+static uint16_t next_id;
+
+void ip_receive(struct netbuf *b) {
+    struct ip_header *ip = (struct ip_header*)b->data;
+    uint32_t header_length, total_length;
+
+    if(b->length < sizeof(struct ip_header) || (ip->version_length >> 4) != 4)
+        goto drop;
+    header_length = (ip->version_length & 0x0F) * 4;
+    total_length = net16(ip->total_length);
+    if(header_length < sizeof(struct ip_header) || total_length < header_length || total_length > b->length)
+        goto drop;
+    if(net_checksum_finish(net_checksum_add(0, ip, header_length)) != 0)
+        goto drop;
+    if(ip->dest != NET_ADDRESS && ip->dest != NET_BROADCAST)
+        goto drop;
+    if(ip->fragment & net16(IP_FLAG_MF | IP_FRAGMENT_OFFSET))
+        goto drop;
+
+    // Ethernet pads short frames, the IP length is the real one
+    b->length = total_length;
+    b->ip = ip->source;
+    b->dest = ip->dest;
+    netbuf_pull(b, header_length);
+    if(ip->protocol == IP_PROTO_UDP)
+        udp_receive(b);
+    else if(ip->protocol == IP_PROTO_ICMP)
+        icmp_receive(b);
+    else
+        netbuf_free(b);
+    return;
+
+drop:
+    net_get()->rx_dropped++;
+    netbuf_free(b);
+}
+
+/* Puts an IP header in front of the payload in b and sends it to dest.
+*  b is the stack's from here on, whether it gets out or not */
+int ip_send(struct netbuf *b, uint32_t dest, uint8_t protocol) {
+    struct ip_header *ip = (struct ip_header*)netbuf_push(b, sizeof(struct ip_header));
+
+    ip->version_length = 0x45;
+    ip->tos = 0;
+    ip->total_length = net16(b->length);
+    ip->id = net16(__atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED));
+    ip->fragment = 0;
+    ip->ttl = IP_TTL;
+    ip->protocol = protocol;
+    ip->checksum = 0;
+    ip->source = NET_ADDRESS;
+    ip->dest = dest;
+    ip->checksum = net_checksum_finish(net_checksum_add(0, ip, sizeof(struct ip_header)));
+    return net_send(b, ip_next_hop(dest));
+}
+
+void icmp_receive(struct netbuf *b) {
+    struct icmp_header *icmp = (struct icmp_header*)b->data;
+    uint16_t before;
+
+    if(b->length < sizeof(struct icmp_header) || icmp->type != ICMP_ECHO_REQUEST
+       || net_checksum_finish(net_checksum_add(0, b->data, b->length)) != 0) {
+        netbuf_free(b);
+        return;
+    }
+    // only the type changes, the checksum is updated for that word (RFC 1624)
+    before = *(uint16_t*)icmp;
+    icmp->type = ICMP_ECHO_REPLY;
+    icmp->checksum = net_checksum_finish((uint16_t)~icmp->checksum + (uint16_t)~before + *(uint16_t*)icmp);
+    ip_send(b, b->ip, IP_PROTO_ICMP);
+}
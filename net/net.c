@@ -0,0 +1,454 @@
+#include "net.h"
+#include "udp.h"
+#include "../include/system.h"
+#include "../kernel/memory.h"
+#include "../kernel/sched.h"
+#include "../kernel/spinlock.h"
+#include "../kernel/printk.h"
+#include "../kernel/low_level.h"
+#include "../drivers/timer.h"
+
+/* The network stack: packet buffers, Ethernet and ARP here, IPv4 and
+*  ICMP in ip.c, UDP sockets in udp.c. There is one device and one
+*  static address (the ones QEMU's user mode networking expects), no
+*  fragments and no routing beyond the gateway.
+*  Packets are never copied inside the stack. The driver hands up the
+*  buffer the device wrote into, each layer pulls its header off, and a
+*  UDP socket queues the very same buffer for the reader. Replies go out
+*  in the buffer of the request. All receive processing runs in the net
+*  thread, which the driver's interrupt wakes. */
+
+static struct netbuf netbufs[NETBUF_COUNT];
+static struct netbuf *free_list;
+static uint32_t free_count;
+static struct spinlock pool_lock = SPINLOCK_INIT;
+
+static struct net_device *netdev;
+static struct wait_queue net_waiters;
+static volatile int net_pending;
+
+struct arp_entry {
+    uint32_t ip;                // 0 while the entry is unused
+    uint8_t mac[ETH_ALEN];
+    int resolved;
+    uint32_t asked;             // sched_ticks() of the last request
+    struct netbuf *pending;     // the last packet sent before the reply came
+};
+
+static struct arp_entry arp_table[ARP_ENTRIES];
+static int arp_next;            // the entry a new address takes when the table is full
+static struct spinlock arp_lock = SPINLOCK_INIT;
+
+static const uint8_t broadcast_mac[ETH_ALEN] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+static inline void mac_copy(uint8_t *dest, const uint8_t *source) {
+    for(int i = 0; i < ETH_ALEN; i++)
+        dest[i] = source[i];
+}
+
+/* --- packet buffers --- */
+
+// an empty buffer with NET_HEADROOM in front of data, 0 if the pool ran dry
+struct netbuf *netbuf_alloc() {
+    unsigned int flags = spin_lock_irqsave(&pool_lock);
+    struct netbuf *b = free_list;
+
+    if(b) {
+        free_list = b->next;
+        free_count--;
+    }
+    spin_unlock_irqrestore(&pool_lock, flags);
+    if(b == 0)
+        return 0;
+    b->data = b->head + NET_HEADROOM;
+    b->length = 0;
+    b->checksum_ok = 0;
+    b->checksum_start = 0;
+    b->next = 0;
+    return b;
+}
+
+void netbuf_free(struct netbuf *b) {
+    unsigned int flags = spin_lock_irqsave(&pool_lock);
+
+    b->next = free_list;
+    free_list = b;
+    free_count++;
+    spin_unlock_irqrestore(&pool_lock, flags);
+    // a socket reader gave back what the receive ring is waiting for
+    if(netdev && netdev->rx_short)
+        net_wake();
+}
+
+uint32_t netbufs_free() {
+    return free_count;
+}
+
+static int pool_init() {
+    for(int i = 0; i < NETBUF_COUNT; i += PAGE_SIZE / NETBUF_SIZE) {
+        uint8_t *page = (uint8_t*)frame_alloc();
+        if(page == 0)
+            return -1;
+        for(int n = 0; n < PAGE_SIZE / NETBUF_SIZE; n++) {
+            netbufs[i + n].head = page + n * NETBUF_SIZE;
+            netbuf_free(&netbufs[i + n]);
+        }
+    }
+    return 0;
+}
+
+/* --- checksums --- */
+
+/* Adds length bytes to a ones' complement sum, 32 bits at a time. Every
+*  piece of a checksum but the last must have an even length */
+uint32_t net_checksum_add(uint32_t sum, const void *data, uint32_t length) {
+    const uint8_t *p = data;
+    uint64_t wide = sum;
+
+    for(; length >= 4; p += 4, length -= 4)
+        wide += *(const uint32_t*)p;
+    if(length >= 2) {
+        wide += *(const uint16_t*)p;
+        p += 2;
+        length -= 2;
+    }
+    if(length)
+        wide += *p;
+    wide = (wide & 0xFFFFFFFF) + (wide >> 32);
+    wide = (wide & 0xFFFFFFFF) + (wide >> 32);
+    return (uint32_t)wide;
+}
+
+// folds the sum to 16 bits and complements it, ready for the header
+uint16_t net_checksum_finish(uint32_t sum) {
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum;
+}
+
+/* --- the device --- */
+
+static void net_thread(void *arg) {
+    unsigned int flags;
+
+    while(1) {
+        flags = interrupts_save();
+        while(!net_pending)
+            wait_queue_sleep(&net_waiters);
+        net_pending = 0;
+        interrupts_restore(flags);
+        netdev->poll(netdev);
+    }
+}
+
+// from the driver's interrupt handler, or when the receive ring can be refilled
+void net_wake() {
+    net_pending = 1;
+    wait_queue_wake_one(&net_waiters);
+}
+
+/* Makes dev the network device and sets up the buffer pool, the net
+*  thread and the UDP echo service. Returns -1 if there is a device
+*  already or not enough memory */
+int net_register(struct net_device *dev) {
+    if(netdev || pool_init() < 0)
+        return -1;
+    dev->rx_packets = dev->rx_dropped = dev->tx_packets = dev->tx_dropped = 0;
+    dev->rx_short = 0;
+    netdev = dev;
+    thread_create("net", net_thread, 0, PRIORITY_HIGH);
+    thread_create("udpecho", udp_echo_thread, 0, PRIORITY_NORMAL);
+    return 0;
+}
+
+struct net_device *net_get() {
+    return netdev;
+}
+
+static int eth_transmit(struct netbuf *b, const uint8_t *mac, uint16_t type) {
+    struct eth_header *eth = (struct eth_header*)netbuf_push(b, sizeof(struct eth_header));
+
+    mac_copy(eth->dest, mac);
+    mac_copy(eth->source, netdev->mac);
+    eth->type = net16(type);
+    if(netdev->transmit(netdev, b) < 0) {
+        netdev->tx_dropped++;
+        netbuf_free(b);
+        return -1;
+    }
+    netdev->tx_packets++;
+    return 0;
+}
+
+/* --- ARP --- */
+
+// the entry for ip, 0 if there is none. arp_lock held
+static struct arp_entry *arp_find(uint32_t ip) {
+    for(int i = 0; i < ARP_ENTRIES; i++)
+        if(arp_table[i].ip == ip)
+            return &arp_table[i];
+    return 0;
+}
+
+// the entry for ip, taking over the oldest one if needed. arp_lock held
+static struct arp_entry *arp_claim(uint32_t ip, struct netbuf **dropped) {
+    struct arp_entry *e = arp_find(ip);
+
+    if(e)
+        return e;
+    e = &arp_table[arp_next];
+    arp_next = (arp_next + 1) % ARP_ENTRIES;
+    *dropped = e->pending;
+    e->ip = ip;
+    e->resolved = 0;
+    e->asked = 0;
+    e->pending = 0;
+    return e;
+}
+
+static void arp_request(uint32_t ip) {
+    struct netbuf *b = netbuf_alloc();
+    struct arp_packet *arp;
+
+    if(b == 0)
+        return;
+    arp = (struct arp_packet*)b->data;
+    b->length = sizeof(struct arp_packet);
+    arp->hardware_type = net16(1);
+    arp->protocol_type = net16(ETH_TYPE_IP);
+    arp->hardware_length = ETH_ALEN;
+    arp->protocol_length = 4;
+    arp->operation = net16(ARP_REQUEST);
+    mac_copy(arp->sender_mac, netdev->mac);
+    arp->sender_ip = NET_ADDRESS;
+    for(int i = 0; i < ETH_ALEN; i++)
+        arp->target_mac[i] = 0;
+    arp->target_ip = ip;
+    eth_transmit(b, broadcast_mac, ETH_TYPE_ARP);
+}
+
+static void arp_receive(struct netbuf *b) {
+    struct arp_packet *arp = (struct arp_packet*)b->data;
+    struct arp_entry *e;
+    struct netbuf *pending = 0, *dropped = 0;
+    uint8_t mac[ETH_ALEN];
+    unsigned int flags;
+
+    if(b->length < sizeof(struct arp_packet) || arp->hardware_type != net16(1)
+       || arp->protocol_type != net16(ETH_TYPE_IP)) {
+        netbuf_free(b);
+        return;
+    }
+
+    flags = spin_lock_irqsave(&arp_lock);
+    e = arp_find(arp->sender_ip);
+    // a host asking for us is about to talk to us, learn it as well
+    if(e == 0 && arp->target_ip == NET_ADDRESS)
+        e = arp_claim(arp->sender_ip, &dropped);
+    if(e) {
+        mac_copy(e->mac, arp->sender_mac);
+        mac_copy(mac, arp->sender_mac);
+        e->resolved = 1;
+        pending = e->pending;
+        e->pending = 0;
+    }
+    spin_unlock_irqrestore(&arp_lock, flags);
+    if(dropped)
+        netbuf_free(dropped);
+    if(pending)
+        eth_transmit(pending, mac, ETH_TYPE_IP);
+
+    if(arp->operation == net16(ARP_REQUEST) && arp->target_ip == NET_ADDRESS) {
+        // the request becomes the reply, in place
+        arp->operation = net16(ARP_REPLY);
+        mac_copy(arp->target_mac, arp->sender_mac);
+        arp->target_ip = arp->sender_ip;
+        mac_copy(arp->sender_mac, netdev->mac);
+        arp->sender_ip = NET_ADDRESS;
+        b->length = sizeof(struct arp_packet);
+        eth_transmit(b, arp->target_mac, ETH_TYPE_ARP);
+        return;
+    }
+    netbuf_free(b);
+}
+
+// a received frame, from the net thread. b is the stack's from here on
+void net_receive(struct net_device *dev, struct netbuf *b) {
+    struct eth_header *eth;
+
+    dev->rx_packets++;
+    if(b->length < sizeof(struct eth_header)) {
+        dev->rx_dropped++;
+        netbuf_free(b);
+        return;
+    }
+    eth = (struct eth_header*)netbuf_pull(b, sizeof(struct eth_header));
+    if(eth->type == net16(ETH_TYPE_IP))
+        ip_receive(b);
+    else if(eth->type == net16(ETH_TYPE_ARP))
+        arp_receive(b);
+    else
+        netbuf_free(b);
+}
+
+/* Sends the IP packet in b to next_hop on the local network. Without
+*  its MAC address the packet waits for the ARP reply, in place of any
+*  older one waiting for the same host */
+int net_send(struct netbuf *b, uint32_t next_hop) {
+    struct arp_entry *e;
+    struct netbuf *dropped = 0;
+    uint8_t mac[ETH_ALEN];
+    unsigned int flags;
+    int ask;
+
+    if(netdev == 0) {
+        netbuf_free(b);
+        return -1;
+    }
+    if(next_hop == NET_BROADCAST)
+        return eth_transmit(b, broadcast_mac, ETH_TYPE_IP);
+
+    flags = spin_lock_irqsave(&arp_lock);
+    e = arp_find(next_hop);
+    if(e && e->resolved) {
+        mac_copy(mac, e->mac);
+        spin_unlock_irqrestore(&arp_lock, flags);
+        return eth_transmit(b, mac, ETH_TYPE_IP);
+    }
+    e = arp_claim(next_hop, &dropped);
+    if(e->pending)
+        dropped = e->pending;
+    e->pending = b;
+    // one request a second, the packets in between ride on it
+    ask = e->asked == 0 || sched_ticks() - e->asked >= TIMER_HZ;
+    if(ask)
+        e->asked = sched_ticks() | 1;
+    spin_unlock_irqrestore(&arp_lock, flags);
+    if(dropped) {
+        netdev->tx_dropped++;
+        netbuf_free(dropped);
+    }
+    if(ask)
+        arp_request(next_hop);
+    return 0;
+}
+
+/* Waits up to ticks timer ticks until the first hop towards ip is
+*  known, asking once a second. Returns -1 if it didn't answer */
+int net_resolve(uint32_t ip, uint32_t ticks) {
+    uint32_t next_hop = ip_next_hop(ip);
+    struct arp_entry *e;
+    unsigned int flags;
+    int resolved;
+
+    if(next_hop == NET_BROADCAST)
+        return 0;
+    for(uint32_t waited = 0; netdev; waited++) {
+        flags = spin_lock_irqsave(&arp_lock);
+        e = arp_find(next_hop);
+        resolved = e && e->resolved;
+        spin_unlock_irqrestore(&arp_lock, flags);
+        if(resolved)
+            return 0;
+        if(waited >= ticks)
+            break;
+        if(waited % TIMER_HZ == 0)
+            arp_request(next_hop);
+        thread_sleep(1);
+    }
+    return -1;
+}
+
+/* --- logging over UDP --- */
+
+static int log_socket = -1;
+
+// a printk console, every line goes out as a datagram of its own
+void net_log_write(const char *text, uint32_t length) {
+    if(log_socket >= 0)
+        udp_sendto(log_socket, NET_LOG_HOST, NET_LOG_PORT, text, length);
+}
+
+/* Sends the log, and the results of the benchmark suite, to
+*  NET_LOG_HOST:NET_LOG_PORT from now on. -1 without a network device */
+int net_log_start() {
+    int socket;
+
+    if(log_socket >= 0)
+        return 0;
+    if(netdev == 0 || (socket = udp_bind(0)) < 0)
+        return -1;
+    net_resolve(NET_LOG_HOST, TIMER_HZ);
+    log_socket = socket;
+    return printk_register_sink(net_log_write, LOG_DEBUG);
+}
+
+/* --- netinfo and netbench --- */
+
+static int format_ip(char *line, uint32_t size, uint32_t ip) {
+    return snprintk(line, size, "%u.%u.%u.%u", ip & 0xFF, ip >> 8 & 0xFF, ip >> 16 & 0xFF, ip >> 24);
+}
+
+void net_info() {
+    char address[16], gateway[16];
+
+    if(netdev == 0) {
+        printk("no network device\n");
+        return;
+    }
+    format_ip(address, sizeof(address), NET_ADDRESS);
+    format_ip(gateway, sizeof(gateway), NET_GATEWAY);
+    printk("%s %02x:%02x:%02x:%02x:%02x:%02x %s gateway %s\n", netdev->name,
+           netdev->mac[0], netdev->mac[1], netdev->mac[2], netdev->mac[3], netdev->mac[4], netdev->mac[5],
+           address, gateway);
+    printk("rx %u packets %u dropped, tx %u packets %u dropped, %u buffers free\n",
+           netdev->rx_packets, netdev->rx_dropped, netdev->tx_packets, netdev->tx_dropped, netbufs_free());
+}
+
+#define BENCH_PAYLOAD       1024
+#define BENCH_DATAGRAMS     256
+
+static int bench_socket = -1;
+static uint8_t bench_data[BENCH_PAYLOAD];
+
+/* cycles to send a BENCH_PAYLOAD datagram to the gateway's discard port,
+*  written straight into a packet buffer or copied in by udp_sendto.
+*  0 if there is no network to send to */
+uint32_t net_send_cycles(int zero_copy) {
+    unsigned long long start;
+    struct netbuf *b;
+
+    if(bench_socket < 0)
+        bench_socket = udp_bind(0);
+    if(bench_socket < 0 || net_resolve(NET_GATEWAY, TIMER_HZ) < 0)
+        return 0;
+    start = rdtsc();
+    for(int i = 0; i < BENCH_DATAGRAMS; i++) {
+        if(!zero_copy) {
+            udp_sendto(bench_socket, NET_GATEWAY, UDP_DISCARD_PORT, bench_data, BENCH_PAYLOAD);
+            continue;
+        }
+        b = netbuf_alloc();
+        if(b == 0)
+            continue;
+        b->length = BENCH_PAYLOAD;
+        udp_send(bench_socket, NET_GATEWAY, UDP_DISCARD_PORT, b);
+    }
+    return (uint32_t)divide64(rdtsc() - start, BENCH_DATAGRAMS, 0);
+}
+
+void net_benchmark() {
+    uint32_t dropped = netdev ? netdev->tx_dropped : 0;
+    uint32_t zero_copy = net_send_cycles(1);
+    uint32_t copied = net_send_cycles(0);
+
+    if(zero_copy == 0 || copied == 0) {
+        printk("no network, or the gateway doesn't answer\n");
+        return;
+    }
+    printk("udp_send: %u cycles per %u byte datagram, %u MB/s\n",
+           zero_copy, BENCH_PAYLOAD, BENCH_PAYLOAD * tsc_per_us / zero_copy);
+    printk("udp_sendto: %u cycles per datagram, %u MB/s\n",
+           copied, BENCH_PAYLOAD * tsc_per_us / copied);
+    printk("%u datagrams dropped\n", netdev->tx_dropped - dropped);
+}
@@ -0,0 +1,173 @@
+#ifndef _NET_H_
+#define _NET_H_
+
+#include "../include/types.h"
+
+// IPv4 addresses are kept in network byte order, as they are on the wire
+#define NET_IP(a, b, c, d)  ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+// the addresses QEMU's user mode networking (-netdev user) hands out
+#define NET_ADDRESS         NET_IP(10, 0, 2, 15)
+#define NET_GATEWAY         NET_IP(10, 0, 2, 2)     // the host, as far as the guest sees it
+#define NET_NETMASK         NET_IP(255, 255, 255, 0)
+#define NET_BROADCAST       NET_IP(255, 255, 255, 255)
+
+/* Packet buffers: NETBUF_SIZE bytes each, two to a page. The receive
+*  ring holds NET_RX_BUFFERS of them and every UDP socket up to
+*  UDP_QUEUE_MAX, which leaves the rest of the pool for sending */
+#define NETBUF_SIZE         2048
+#define NETBUF_COUNT        512
+#define NET_RX_BUFFERS      128
+#define NET_HEADROOM        64          // room in front of a packet for every header down to the device's
+#define NET_MTU             1500
+
+#define ETH_ALEN            6
+#define ETH_TYPE_IP         0x0800
+#define ETH_TYPE_ARP        0x0806
+
+#define ARP_ENTRIES         16
+#define ARP_REQUEST         1
+#define ARP_REPLY           2
+
+#define IP_PROTO_ICMP       1
+#define IP_PROTO_UDP        17
+#define IP_TTL              64
+#define IP_FLAG_MF          0x2000
+#define IP_FRAGMENT_OFFSET  0x1FFF
+
+#define ICMP_ECHO_REPLY     0
+#define ICMP_ECHO_REQUEST   8
+
+// printk and benchmark lines go here once the netlog command ran, see nc -ul 5140
+#define NET_LOG_HOST        NET_GATEWAY
+#define NET_LOG_PORT        5140
+
+struct eth_header {
+    uint8_t dest[ETH_ALEN];
+    uint8_t source[ETH_ALEN];
+    uint16_t type;
+} __attribute__((packed));
+
+struct arp_packet {
+    uint16_t hardware_type;
+    uint16_t protocol_type;
+    uint8_t hardware_length;
+    uint8_t protocol_length;
+    uint16_t operation;
+    uint8_t sender_mac[ETH_ALEN];
+    uint32_t sender_ip;
+    uint8_t target_mac[ETH_ALEN];
+    uint32_t target_ip;
+} __attribute__((packed));
+
+struct ip_header {
+    uint8_t version_length;     // version 4 in the high nibble, header length in words below
+    uint8_t tos;
+    uint16_t total_length;
+    uint16_t id;
+    uint16_t fragment;
+    uint8_t ttl;
+    uint8_t protocol;
+    uint16_t checksum;
+    uint32_t source;
+    uint32_t dest;
+} __attribute__((packed));
+
+struct icmp_header {
+    uint8_t type;
+    uint8_t code;
+    uint16_t checksum;
+    uint16_t id;
+    uint16_t sequence;
+} __attribute__((packed));
+
+struct udp_header {
+    uint16_t source_port;
+    uint16_t dest_port;
+    uint16_t length;
+    uint16_t checksum;
+} __attribute__((packed));
+
+/* One packet. data and length cover the layer that currently owns it:
+*  the receive path pulls each header off before handing the buffer up,
+*  the send path pushes them on in front. The same buffer goes from the
+*  receive ring to a socket and, for a reply, back out to the device */
+typedef struct netbuf {
+    uint8_t *head;              // start of the NETBUF_SIZE bytes
+    uint8_t *data;
+    uint32_t length;
+    uint32_t ip;                // received: the sender's address
+    uint32_t dest;              // the address it was sent to
+    uint16_t port;              // the sender's port, in host order
+    uint8_t checksum_ok;        // the device checked the payload's checksum already
+    uint8_t *checksum_start;    // sending: the device fills in the checksum of
+    uint16_t checksum_offset;   // everything from checksum_start on at this offset
+    struct netbuf *next;        // free list, socket queue or driver list link
+} netbuf;
+
+typedef struct net_device {
+    char name[8];
+    uint8_t mac[ETH_ALEN];
+    int checksum_offload;       // transmit honours checksum_start
+    // queues b for sending and owns it from then on, -1 if the queue is full
+    int (*transmit)(struct net_device *dev, struct netbuf *b);
+    // from the net thread: takes in what the device received and sent
+    void (*poll)(struct net_device *dev);
+    volatile int rx_short;      // the receive ring wants buffers the pool didn't have
+    void *driver;
+    uint32_t rx_packets, rx_dropped, tx_packets, tx_dropped;
+} net_device;
+
+static inline uint16_t net16(uint16_t value) {
+    return value << 8 | value >> 8;
+}
+
+static inline uint32_t net32(uint32_t value) {
+    return __builtin_bswap32(value);
+}
+
+// where a packet for dest goes first: dest itself on the local subnet, else the gateway
+static inline uint32_t ip_next_hop(uint32_t dest) {
+    if(dest == NET_BROADCAST || (dest & NET_NETMASK) == (NET_ADDRESS & NET_NETMASK))
+        return dest;
+    return NET_GATEWAY;
+}
+
+static inline uint8_t *netbuf_push(struct netbuf *b, uint32_t length) {
+    b->data -= length;
+    b->length += length;
+    return b->data;
+}
+
+static inline uint8_t *netbuf_pull(struct netbuf *b, uint32_t length) {
+    uint8_t *header = b->data;
+    b->data += length;
+    b->length -= length;
+    return header;
+}
+
+struct netbuf *netbuf_alloc();
+void netbuf_free(struct netbuf *b);
+uint32_t netbufs_free();
+
+uint32_t net_checksum_add(uint32_t sum, const void *data, uint32_t length);
+uint16_t net_checksum_finish(uint32_t sum);
+
+int net_register(struct net_device *dev);
+struct net_device *net_get();
+void net_wake();
+void net_receive(struct net_device *dev, struct netbuf *b);
+int net_send(struct netbuf *b, uint32_t next_hop);
+int net_resolve(uint32_t ip, uint32_t ticks);
+
+void ip_receive(struct netbuf *b);
+int ip_send(struct netbuf *b, uint32_t dest, uint8_t protocol);
+void icmp_receive(struct netbuf *b);
+
+int net_log_start();
+void net_log_write(const char *text, uint32_t length);
+void net_info();
+uint32_t net_send_cycles(int zero_copy);
+void net_benchmark();
+
+#endif
@@ -0,0 +1,198 @@
+#include "udp.h"
+#include "../kernel/sched.h"
+#include "../kernel/spinlock.h"
+#include "../tools/utils.h"
+
+/* UDP sockets. A datagram reaches its socket in the buffer the device
+*  received it into, udp_recv hands that buffer to the reader with data
+*  at the payload, and the reader either frees it or sends it back out
+*  with udp_send, which only puts the headers in front again. Sending
+*  new data works the same way: netbuf_alloc, fill in data, udp_send.
+*  udp_sendto is the convenience that copies. */
+
+typedef struct udp_socket {
+    uint16_t port;              // 0 while the socket is free
+    int count;
+    struct netbuf *head;        // datagrams waiting for udp_recv
+    struct netbuf *tail;
+    struct wait_queue waiters;
+} udp_socket;
+
+static struct udp_socket sockets[UDP_SOCKETS];
+static uint16_t next_ephemeral = UDP_EPHEMERAL;
+static struct spinlock socket_lock = SPINLOCK_INIT;
+
+// sum of the pseudo header the checksum covers besides the datagram
+static uint32_t pseudo_header(uint32_t source, uint32_t dest, uint16_t length) {
+    return (source & 0xFFFF) + (source >> 16) + (dest & 0xFFFF) + (dest >> 16)
+         + net16(IP_PROTO_UDP) + net16(length);
+}
+
+// from ip_receive, b->data is at the UDP header
+void udp_receive(struct netbuf *b) {
+    struct udp_header *udp = (struct udp_header*)b->data;
+    struct udp_socket *s = 0;
+    uint32_t length;
+    unsigned int flags;
+
+    if(b->length < sizeof(struct udp_header))
+        goto drop;
+    length = net16(udp->length);
+    if(length < sizeof(struct udp_header) || length > b->length)
+        goto drop;
+    b->length = length;
+    // a zero checksum means the sender didn't compute one
+    if(udp->checksum && !b->checksum_ok
+       && net_checksum_finish(net_checksum_add(pseudo_header(b->ip, b->dest, length), udp, length)) != 0)
+        goto drop;
+    b->port = net16(udp->source_port);
+    netbuf_pull(b, sizeof(struct udp_header));
+
+    flags = spin_lock_irqsave(&socket_lock);
+    for(int i = 0; i < UDP_SOCKETS; i++)
+        if(sockets[i].port && sockets[i].port == net16(udp->dest_port))
+            s = &sockets[i];
+    // a reader that falls behind must not tie up the whole pool
+    if(s == 0 || s->count == UDP_QUEUE_MAX) {
+        spin_unlock_irqrestore(&socket_lock, flags);
+        goto drop;
+    }
+    b->next = 0;
+    if(s->tail)
+        s->tail->next = b;
+    else
+        s->head = b;
+    s->tail = b;
+    s->count++;
+    spin_unlock_irqrestore(&socket_lock, flags);
+    wait_queue_wake_one(&s->waiters);
+    return;
+
+drop:
+    net_get()->rx_dropped++;
+    netbuf_free(b);
+}
+
+/* A socket receiving on port, or on a free port from UDP_EPHEMERAL up
+*  when port is 0. Returns -1 if the port is taken or no socket is left */
+int udp_bind(uint16_t port) {
+    unsigned int flags = spin_lock_irqsave(&socket_lock);
+    int socket = -1;
+
+    for(int tries = 0; port == 0 && tries < UDP_SOCKETS + 1; tries++) {
+        port = next_ephemeral++;
+        if(next_ephemeral == 0)
+            next_ephemeral = UDP_EPHEMERAL;
+        for(int i = 0; i < UDP_SOCKETS; i++)
+            if(sockets[i].port == port)
+                port = 0;
+    }
+    for(int i = 0; i < UDP_SOCKETS && port; i++) {
+        if(sockets[i].port == port) {
+            socket = -1;
+            break;
+        }
+        if(sockets[i].port == 0 && socket < 0)
+            socket = i;
+    }
+    if(socket >= 0) {
+        sockets[socket].port = port;
+        sockets[socket].count = 0;
+        sockets[socket].head = sockets[socket].tail = 0;
+    }
+    spin_unlock_irqrestore(&socket_lock, flags);
+    return socket;
+}
+
+void udp_close(int socket) {
+    struct udp_socket *s = &sockets[socket];
+    unsigned int flags = spin_lock_irqsave(&socket_lock);
+    struct netbuf *b = s->head;
+
+    s->port = 0;
+    s->head = s->tail = 0;
+    s->count = 0;
+    spin_unlock_irqrestore(&socket_lock, flags);
+    while(b) {
+        struct netbuf *next = b->next;
+        netbuf_free(b);
+        b = next;
+    }
+}
+
+/* Waits for the next datagram on socket. data and length of the buffer
+*  are the payload, ip and port the sender. Free it when done, or give
+*  it back to udp_send */
+struct netbuf *udp_recv(int socket) {
+    struct udp_socket *s = &sockets[socket];
+    unsigned int flags = spin_lock_irqsave(&socket_lock);
+    struct netbuf *b;
+
+    while(s->head == 0) {
+        spin_unlock(&socket_lock);
+        wait_queue_sleep(&s->waiters);
+        spin_lock(&socket_lock);
+    }
+    b = s->head;
+    s->head = b->next;
+    if(s->head == 0)
+        s->tail = 0;
+    s->count--;
+    spin_unlock_irqrestore(&socket_lock, flags);
+    return b;
+}
+
+/* Sends the payload b->data holds from socket to ip:port, without
+*  copying it. b is the stack's from here on. -1 if it won't go out */
+int udp_send(int socket, uint32_t ip, uint16_t port, struct netbuf *b) {
+    struct net_device *dev = net_get();
+    struct udp_header *udp;
+    uint32_t length, sum;
+
+    if(dev == 0 || b->length > UDP_MAX_PAYLOAD) {
+        netbuf_free(b);
+        return -1;
+    }
+    udp = (struct udp_header*)netbuf_push(b, sizeof(struct udp_header));
+    length = b->length;
+    udp->source_port = net16(sockets[socket].port);
+    udp->dest_port = net16(port);
+    udp->length = net16(length);
+    udp->checksum = 0;
+    sum = pseudo_header(NET_ADDRESS, ip, length);
+    if(dev->checksum_offload) {
+        // the device adds the datagram to the pseudo header's sum
+        udp->checksum = ~net_checksum_finish(sum);
+        b->checksum_start = (uint8_t*)udp;
+        b->checksum_offset = 6;         // of udp_header.checksum
+    } else {
+        udp->checksum = net_checksum_finish(net_checksum_add(sum, udp, length));
+        if(udp->checksum == 0)
+            udp->checksum = 0xFFFF;         // 0 would mean there is none
+    }
+    return ip_send(b, ip, IP_PROTO_UDP);
+}
+
+// udp_send of a copy of length bytes at data
+int udp_sendto(int socket, uint32_t ip, uint16_t port, const void *data, uint32_t length) {
+    struct netbuf *b;
+
+    if(length > UDP_MAX_PAYLOAD || (b = netbuf_alloc()) == 0)
+        return -1;
+    memory_copy((char*)data, (char*)b->data, length);
+    b->length = length;
+    return udp_send(socket, ip, port, b);
+}
+
+// the echo service (RFC 862), every datagram goes back in its own buffer
+void udp_echo_thread(void *arg) {
+    int socket = udp_bind(UDP_ECHO_PORT);
+    struct netbuf *b;
+
+    if(socket < 0)
+        thread_exit();
+    while(1) {
+        b = udp_recv(socket);
+        udp_send(socket, b->ip, b->port, b);
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef _UDP_H_
+#define _UDP_H_
+
+#include "net.h"
+
+#define UDP_SOCKETS         8
+#define UDP_QUEUE_MAX       32          // datagrams waiting on a socket, later ones are dropped
+#define UDP_EPHEMERAL       49152       // first port udp_bind(0) picks
+#define UDP_ECHO_PORT       7           // echoes whatever arrives, make qemu forwards host port 5555 here
+#define UDP_DISCARD_PORT    9
+#define UDP_MAX_PAYLOAD     (NET_MTU - sizeof(struct ip_header) - sizeof(struct udp_header))
+
+void udp_receive(struct netbuf *b);
+int udp_bind(uint16_t port);
+void udp_close(int socket);
+struct netbuf *udp_recv(int socket);
+int udp_send(int socket, uint32_t ip, uint16_t port, struct netbuf *b);
+int udp_sendto(int socket, uint32_t ip, uint16_t port, const void *data, uint32_t length);
+void udp_echo_thread(void *arg);
+
+#endif
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Compares the results of the kernel's benchmark suite with a baseline.
+
+    make bench                    # runs the suite, then this script
+    make bench-baseline           # runs the suite, then this script with --save
+    scripts/benchdiff.py bench.log bench-baseline.txt
+    scripts/benchdiff.py --save bench.log bench-baseline.txt
+
+Both files hold the suite's output as kernel/bench.c prints it, with or
+without printk's timestamps in front, the baseline is just the lines of
+a saved run. Skipped benchmarks (udp_send without a network card) are
+listed but not compared. No baseline is checked in,
+the numbers depend on the host: make bench-baseline records one, and
+records it again after an intended slowdown. Every benchmark's median
+is compared, lower is better. Exits with status 1 when one got slower
+by more than the threshold (10%, change it with --threshold 15) or
+failed to run.
+
+The makefile passes QEMU's exit status with --status, it is reported
+after the results so a run that failed still shows what it measured.
+"""
+import os
+import re
+import sys
+
+# printk's "[    1.234567] " in front of every line
+TIMESTAMP = re.compile(r"^\[\s*\d+\.\d+\]\s*")
+SKIPPED = "skipped"
+
+
+def parse(lines):
+    """{name: (min, median, unit)} of the last run in the log, None for a
+    benchmark that failed, SKIPPED for one that was skipped. None if the
+    log has no complete run"""
+    results = None
+    complete = None
+    for line in lines:
+        fields = TIMESTAMP.sub("", line).split()
+        if fields[:2] == ["bench", "begin"]:
+            results = {}
+        elif fields[:2] == ["bench", "end"] and results is not None:
+            complete, results = results, None
+        elif results is not None and len(fields) == 5 and fields[0] == "B":
+            results[fields[1]] = (int(fields[2]), int(fields[3]), fields[4])
+        elif results is not None and len(fields) == 3 and fields[0] == "bench" and fields[2] == "failed":
+            results[fields[1]] = None
+        elif results is not None and len(fields) == 3 and fields[0] == "bench" and fields[2] == SKIPPED:
+            results[fields[1]] = SKIPPED
+    return complete
+
+
+# QEMU's exit status: isa-debug-exit makes it (code << 1) | 1, see kernel/bench.h
+STATUS_SUCCESS = 1
+STATUS_FAILURE = 3
+STATUS_TIMEOUT = 124
+
+
+def describe_status(status):
+    """what QEMU's exit status says about the run, None if it went well"""
+    if status is None or status == STATUS_SUCCESS:
+        return None
+    if status == STATUS_FAILURE:
+        return "the kernel reported failed benchmarks (qemu exit status %d)" % status
+    if status == STATUS_TIMEOUT:
+        return "qemu timed out before the suite finished (exit status %d)" % status
+    return "qemu exited with status %d, not through isa-debug-exit" % status
+
+
+def failures(results):
+    for name, result in sorted(results.items()):
+        if result is None:
+            print("%s failed to run" % name)
+
+
+def save(results, path):
+    with open(path, "w") as out:
+        out.write("bench begin 0 0\n")
+        for name, result in sorted(results.items()):
+            if result is not None and result != SKIPPED:
+                out.write("B %s %d %d %s\n" % (name, result[0], result[1], result[2]))
+        out.write("bench end\n")
+
+
+def compare(current, baseline, threshold):
+    regressions = 0
+    print("%-18s %12s %12s %8s" % ("benchmark", "baseline", "current", "change"))
+    for name in sorted(set(current) | set(baseline)):
+        now, before = current.get(name), baseline.get(name)
+        if before == SKIPPED:
+            before = None
+        if now == SKIPPED:
+            print("%-18s %12s %12s %8s" % (name, before[1] if before else "-", SKIPPED, ""))
+            continue
+        if now is None:
+            print("%-18s %12s %12s %8s" % (name, before[1] if before else "-", "failed" if name in current else "missing", ""))
+            regressions += 1
+            continue
+        if before is None:
+            print("%-18s %12s %12d %8s  %s" % (name, "-", now[1], "new", now[2]))
+            continue
+        change = 100.0 * (now[1] - before[1]) / max(before[1], 1)
+        flag = "  SLOWER" if change > threshold else "  faster" if change < -threshold else ""
+        print("%-18s %12d %12d %+7.1f%%  %s%s" % (name, before[1], now[1], change, now[2], flag))
+        if change > threshold:
+            regressions += 1
+    return regressions
+
+
+def main():
+    args = sys.argv[1:]
+    threshold = 10.0
+    status = None
+    store = "--save" in args
+    args = [arg for arg in args if arg != "--save"]
+    if "--threshold" in args:
+        at = args.index("--threshold")
+        threshold = float(args[at + 1])
+        del args[at:at + 2]
+    if "--status" in args:
+        at = args.index("--status")
+        status = int(args[at + 1])
+        del args[at:at + 2]
+    if len(args) != 2:
+        sys.exit("usage: %s [--save] [--threshold percent] [--status qemu_status] bench.log baseline" % sys.argv[0])
+
+    problem = describe_status(status)
+    current = parse(open(args[0], errors="replace")) if os.path.exists(args[0]) else None
+    if current is None:
+        if problem:
+            print(problem)
+        sys.exit("no complete benchmark run in %s" % args[0])
+    if store:
+        save(current, args[1])
+        failures(current)
+        if problem:
+            print(problem)
+        print("saved %d results to %s" % (len([r for r in current.values() if r and r != SKIPPED]), args[1]))
+        return
+    if not os.path.exists(args[1]):
+        for name, result in sorted(current.items()):
+            print("%-18s %s" % (name, SKIPPED if result == SKIPPED else "%d %s" % (result[1], result[2]) if result else "failed"))
+        print("no baseline in %s yet, make bench-baseline records one" % args[1])
+        regressions = 0
+    else:
+        baseline = parse(open(args[1], errors="replace")) or {}
+        regressions = compare(current, baseline, threshold)
+    if problem:
+        print(problem)
+    if regressions:
+        sys.exit("%d benchmark(s) slower than the baseline by more than %g%% or failing" % (regressions, threshold))
+    if problem:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Symbolizes the output of the kernel's profdump command and prints a flat
+profile, or folded stacks for flamegraph.pl and speedscope.
+
+    make qemu > serial.log        # then profstart, ..., profdump
+    scripts/profile.py kernel.elf serial.log
+    scripts/profile.py --folded kernel.map serial.log > kernel.folded
+
+Symbols come from kernel.elf, the kernel linked with its symbol table, or
+from the linker map kernel.map. The map only lists global symbols, a
+static function shows up as the global one before it. Samples taken in
+ring 3 are counted as [user].
+"""
+import bisect
+import re
+import struct
+import sys
+
+USER = "[user]"
+
+
+def elf_symbols(data):
+    """(address, name) of the functions and labels in an ELF32 symbol table"""
+    shoff, = struct.unpack_from("<I", data, 0x20)
+    shentsize, shnum = struct.unpack_from("<HH", data, 0x2E)
+    sections = [struct.unpack_from("<IIIIIIIIII", data, shoff + i * shentsize) for i in range(shnum)]
+    symbols = []
+    for _, kind, _, _, offset, size, link, _, _, entsize in sections:
+        if kind != 2:                   # SHT_SYMTAB
+            continue
+        strings = sections[link][4]
+        for at in range(offset, offset + size, entsize or 16):
+            name, value, _, info, _, index = struct.unpack_from("<IIIBBH", data, at)
+            if info & 0xF not in (0, 2) or index == 0 or index >= 0xFF00 or value == 0:
+                continue                # only untyped labels and functions that are defined
+            end = data.index(b"\0", strings + name)
+            label = data[strings + name:end].decode(errors="replace")
+            if label and not label.startswith("."):
+                symbols.append((value, label))
+    return symbols
+
+
+MAP_SYMBOL = re.compile(r"^\s+0x([0-9a-fA-F]+)\s+([A-Za-z_.$][\w.$]*)\s*$")
+
+
+def map_symbols(text):
+    """(address, name) of the symbols a GNU ld map lists"""
+    symbols = []
+    for line in text.splitlines():
+        match = MAP_SYMBOL.match(line)
+        if match and int(match.group(1), 16):
+            symbols.append((int(match.group(1), 16), match.group(2)))
+    return symbols
+
+
+class Symbolizer:
+    def __init__(self, path):
+        data = open(path, "rb").read()
+        if data[:4] == b"\x7fELF":
+            symbols = elf_symbols(data)
+        else:
+            symbols = map_symbols(data.decode(errors="replace"))
+        if not symbols:
+            sys.exit("no symbols in %s" % path)
+        symbols.sort()
+        self.addresses = [address for address, _ in symbols]
+        self.names = [name for _, name in symbols]
+
+    def __call__(self, address):
+        i = bisect.bisect_right(self.addresses, address) - 1
+        if i < 0:
+            return "0x%x" % address
+        return self.names[i]
+
+
+def parse(lines):
+    """The last dump in the log: (hz, per cpu (samples, dropped), stacks),
+    a stack being (cpu, count, user, addresses innermost first)"""
+    dump = None
+    result = None
+    for line in lines:
+        fields = line.split()
+        if fields[:2] == ["profile", "begin"]:
+            dump = (int(fields[2]), {}, [])
+        elif fields[:2] == ["profile", "end"] and dump is not None:
+            result, dump = dump, None
+        elif dump is None or len(fields) < 4:
+            continue
+        elif fields[0] == "S":
+            dump[1][int(fields[1])] = (int(fields[2]), int(fields[3]))
+        elif fields[0] == "P" and len(fields) >= 5:
+            dump[2].append((int(fields[1]), int(fields[2]), fields[3] == "u",
+                            [int(pc, 16) for pc in fields[4:]]))
+    return result
+
+
+def frames(symbolize, user, addresses):
+    """function names of a stack, outermost first"""
+    if user:
+        return [USER]
+    # a return address points after the call, which may be the last
+    # instruction of the caller. the eip itself is exact
+    names = [symbolize(address - 1) for address in reversed(addresses[1:])]
+    names.append(symbolize(addresses[0]))
+    return names
+
+
+def flat(hz, cpus, stacks, symbolize):
+    total = sum(count for _, count, _, _ in stacks)
+    own, inclusive = {}, {}
+    for _, count, user, addresses in stacks:
+        names = frames(symbolize, user, addresses)
+        own[names[-1]] = own.get(names[-1], 0) + count
+        for name in set(names):
+            inclusive[name] = inclusive.get(name, 0) + count
+
+    for cpu in sorted(cpus):
+        samples, dropped = cpus[cpu]
+        print("cpu %d: %d samples, %d dropped" % (cpu, samples, dropped))
+    print("%d samples at %d hz, %.2f s of cpu time\n" % (total, hz, total / max(hz, 1)))
+    print("%7s %7s %7s  %s" % ("self", "self%", "total%", "function"))
+    for name, count in sorted(own.items(), key=lambda item: -item[1]):
+        print("%7d %6.2f%% %6.2f%%  %s" % (count, 100.0 * count / total, 100.0 * inclusive[name] / total, name))
+
+
+def folded(stacks, symbolize):
+    merged = {}
+    for _, count, user, addresses in stacks:
+        key = ";".join(frames(symbolize, user, addresses))
+        merged[key] = merged.get(key, 0) + count
+    for key, count in sorted(merged.items()):
+        print("%s %d" % (key, count))
+
+
+def main():
+    args = sys.argv[1:]
+    fold = "--folded" in args
+    args = [arg for arg in args if arg != "--folded"]
+    if len(args) not in (1, 2):
+        sys.exit("usage: %s [--folded] kernel.elf|kernel.map [serial log]" % sys.argv[0])
+    symbolize = Symbolizer(args[0])
+    source = open(args[1], errors="replace") if len(args) == 2 else sys.stdin
+    dump = parse(source)
+    if dump is None or not dump[2]:
+        sys.exit("no profile dump in the input")
+    hz, cpus, stacks = dump
+    if fold:
+        folded(stacks, symbolize)
+    else:
+        flat(hz, cpus, stacks, symbolize)
+
+
+if __name__ == "__main__":
+    main()
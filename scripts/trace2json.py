@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Turns the output of the kernel's tracedump command into the Chrome trace
+event format, which chrome://tracing and https://ui.perfetto.dev load.
+
+    make qemu > serial.log        # then tracestart, ..., tracedump
+    scripts/trace2json.py serial.log > trace.json
+
+Every cpu is a track with interrupt, exception and syscall slices; the
+threads the scheduler ran are another track per cpu, and disk requests
+are async slices from submit to completion. Event ids match kernel/trace.h.
+"""
+import json
+import sys
+
+IRQ_ENTRY, IRQ_EXIT = 1, 2
+FAULT_ENTRY, FAULT_EXIT = 3, 4
+SWITCH = 5
+BLOCK_SUBMIT, BLOCK_DONE = 6, 7
+BCACHE_MISS = 8
+SYSCALL_ENTRY, SYSCALL_EXIT = 9, 10
+
+IRQ_BASE = 32           # PIC IRQs 0-15 are vectors 32-47
+MSI_BASE = 0x30         # MSI vectors from kernel/apic.h
+
+KERNEL_PID = 0
+THREADS_PID = 1
+
+
+def vector_name(vector):
+    if IRQ_BASE <= vector < IRQ_BASE + 16:
+        return "irq %d" % (vector - IRQ_BASE)
+    if vector >= MSI_BASE:
+        return "msi %d" % (vector - MSI_BASE)
+    return "vector %d" % vector
+
+
+def parse(lines):
+    """Yields (tsc_per_us, events) for every dump in the log, events being
+    (cpu, timestamp, id, payload) sorted by time"""
+    events = None
+    tsc_per_us = 1
+    for line in lines:
+        fields = line.split()
+        if fields[:2] == ["trace", "begin"]:
+            tsc_per_us = max(int(fields[2]), 1)
+            events = []
+        elif fields[:2] == ["trace", "end"] and events is not None:
+            events.sort(key=lambda e: e[1])
+            yield tsc_per_us, events
+            events = None
+        elif events is not None and len(fields) == 5 and fields[0] == "T":
+            events.append((int(fields[1]), int(fields[2], 16), int(fields[3]), int(fields[4], 16)))
+
+
+def convert(tsc_per_us, events):
+    out = []
+    if not events:
+        return out
+    start = events[0][1]
+    running = {}        # cpu -> (thread id, since)
+    cpus = set()
+
+    def us(timestamp):
+        return (timestamp - start) / tsc_per_us
+
+    for cpu, timestamp, event, payload in events:
+        cpus.add(cpu)
+        base = {"pid": KERNEL_PID, "tid": cpu, "ts": us(timestamp)}
+        if event == IRQ_ENTRY:
+            out.append(dict(base, ph="B", cat="irq", name=vector_name(payload)))
+        elif event == IRQ_EXIT:
+            out.append(dict(base, ph="E", cat="irq", name=vector_name(payload)))
+        elif event == FAULT_ENTRY:
+            out.append(dict(base, ph="B", cat="fault", name="exception %d" % payload))
+        elif event == FAULT_EXIT:
+            out.append(dict(base, ph="E", cat="fault", name="exception %d" % payload))
+        elif event == SYSCALL_ENTRY:
+            out.append(dict(base, ph="B", cat="syscall", name="syscall %d" % payload))
+        elif event == SYSCALL_EXIT:
+            out.append(dict(base, ph="E", cat="syscall", name="syscall", args={"result": payload}))
+        elif event == SWITCH:
+            previous, following = payload >> 16, payload & 0xFFFF
+            if cpu in running:
+                thread, since = running[cpu]
+                out.append({"pid": THREADS_PID, "tid": cpu, "ph": "X", "cat": "sched",
+                            "name": "thread %d" % thread, "ts": us(since), "dur": us(timestamp) - us(since)})
+            else:
+                out.append({"pid": THREADS_PID, "tid": cpu, "ph": "X", "cat": "sched",
+                            "name": "thread %d" % previous, "ts": 0, "dur": us(timestamp)})
+            running[cpu] = (following, timestamp)
+        elif event == BLOCK_SUBMIT:
+            out.append(dict(base, ph="b", cat="block", name="request", id=payload, args={"sector": payload}))
+        elif event == BLOCK_DONE:
+            out.append(dict(base, ph="e", cat="block", name="request", id=payload))
+        elif event == BCACHE_MISS:
+            out.append(dict(base, ph="i", s="t", cat="bcache", name="miss", args={"block": payload}))
+
+    end = events[-1][1]
+    for cpu, (thread, since) in running.items():
+        out.append({"pid": THREADS_PID, "tid": cpu, "ph": "X", "cat": "sched",
+                    "name": "thread %d" % thread, "ts": us(since), "dur": us(end) - us(since)})
+    out.append({"pid": KERNEL_PID, "ph": "M", "name": "process_name", "args": {"name": "kernel"}})
+    out.append({"pid": THREADS_PID, "ph": "M", "name": "process_name", "args": {"name": "threads"}})
+    for cpu in sorted(cpus):
+        for pid in (KERNEL_PID, THREADS_PID):
+            out.append({"pid": pid, "tid": cpu, "ph": "M", "name": "thread_name", "args": {"name": "cpu %d" % cpu}})
+    return out
+
+
+def main():
+    if len(sys.argv) > 2:
+        sys.exit("usage: %s [serial log]" % sys.argv[0])
+    source = open(sys.argv[1], errors="replace") if len(sys.argv) == 2 else sys.stdin
+    dumps = list(parse(source))
+    if not dumps:
+        sys.exit("no trace dump in the input")
+    # the last dump, earlier ones are from earlier runs of tracedump
+    json.dump({"traceEvents": convert(*dumps[-1]), "displayTimeUnit": "ns"}, sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,572 @@
+// -Dprintf=kernel_printf is for the kernel's printf(string, col, row), not libc's
+#undef printf
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#define printf kernel_printf
+#include "../drivers/vesa_vbe/vbe.h"
+#include "../drivers/vesa_vbe/bmp.h"
+#include "../drivers/screen.h"
+#include "../gui/window.h"
+#include "../gui/cursor.h"
+#include "../kernel/memory.h"
+#include "../tools/utils.h"
+
+/* Framebuffer simulator. The graphics code of the kernel, built for the
+*  host against a vbe_mode_info_struture filled in here and a linear
+*  framebuffer in ordinary memory, renders a fixed list of scenes. After
+*  every frame the simulator
+*    - counts the bytes the drawing code stored to the LFB (LFB_WRITTEN)
+*      and the bytes that actually changed,
+*    - times it,
+*    - hashes the visible pixels, which -g compares and -u records in a
+*      golden file, one line per mode, scene and frame,
+*    - and with -o writes it out as a PPM.
+*  The text console scene draws into a simulated VGA text buffer at
+*  0xB8000, rendered with a PSF1 font given with -f.
+*
+*    make sim/fbsim
+*    sim/fbsim -m 800x600x32 -o frames
+*    sim/fbsim -m 640x480x16 -g sim/golden.txt */
+
+uint32_t lfb_bytes_written;
+
+static struct vbe_mode_info_struture mode;
+static uint8_t *lfb;
+static uint8_t *previous;               // the LFB after the last frame
+static uint32_t lfb_size;
+static int pixel_bytes;
+static char mode_name[32];
+
+static const char *out_dir;
+static const char *font_path = "fonts/zap-ext-vga16.psf";
+
+// golden hashes, read from the file given with -g or -u
+#define MAX_GOLDEN 256
+static struct {
+    char key[96];
+    unsigned long long hash;
+    int seen;
+} golden[MAX_GOLDEN];
+static int golden_count;
+static int golden_mismatches;
+static int updating;
+
+// per scene totals
+static const char *scene;
+static int frame_number;
+static unsigned long long scene_ns, scene_written, scene_changed;
+
+/* --- the simulated hardware --- */
+
+static int mode_init(int width, int height, int bpp) {
+    memset(&mode, 0, sizeof(mode));
+    mode.width = width;
+    mode.height = height;
+    mode.bpp = bpp;
+    mode.pitch = width * ((bpp + 7) / 8);
+    mode.memory_model = 6;              // direct colour
+    if(bpp == 16) {
+        mode.red_mask = 5;
+        mode.red_position = 11;
+        mode.green_mask = 6;
+        mode.green_position = 5;
+        mode.blue_mask = 5;
+        mode.blue_position = 0;
+    } else if(bpp == 24 || bpp == 32) {
+        mode.red_mask = 8;
+        mode.red_position = 16;
+        mode.green_mask = 8;
+        mode.green_position = 8;
+        mode.blue_mask = 8;
+        mode.blue_position = 0;
+    } else {
+        return 0;
+    }
+    pixel_bytes = (bpp + 7) / 8;
+    lfb_size = mode.pitch * height;
+    lfb = (uint8_t*)(unsigned long)frame_alloc_contiguous(PAGE_ALIGN_UP(lfb_size) / PAGE_SIZE);
+    previous = malloc(lfb_size);
+    if(lfb == 0 || previous == 0)
+        return 0;
+    memset(previous, 0, lfb_size);
+    mode.framebuffer = (uint32_t)(unsigned long)lfb;
+    vbe_mode = &mode;
+    snprintf(mode_name, sizeof(mode_name), "%dx%dx%d", width, height, bpp);
+    return 1;
+}
+
+// the VGA text buffer screen.c writes to, at its real address
+static int text_init() {
+    void *p = mmap((void*)VIDEO_MEMORY, PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    return p == (void*)VIDEO_MEMORY;
+}
+
+/* --- frames --- */
+
+static unsigned long long now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static unsigned long long fnv64(unsigned long long hash, const uint8_t *data, uint32_t length) {
+    for(uint32_t i = 0; i < length; i++)
+        hash = (hash ^ data[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+static unsigned long long lfb_hash() {
+    unsigned long long hash = 0xCBF29CE484222325ull;
+    for(int y = 0; y < mode.height; y++)
+        hash = fnv64(hash, lfb + y * mode.pitch, mode.width * pixel_bytes);
+    return hash;
+}
+
+// 0xRRGGBB of the pixel at p, whatever the mode's layout
+static uint32_t lfb_rgb(const uint8_t *p) {
+    uint32_t pixel = pixel_bytes == 2 ? p[0] | p[1] << 8 : p[0] | p[1] << 8 | p[2] << 16;
+    uint32_t r = (pixel >> mode.red_position) & ((1 << mode.red_mask) - 1);
+    uint32_t g = (pixel >> mode.green_position) & ((1 << mode.green_mask) - 1);
+    uint32_t b = (pixel >> mode.blue_position) & ((1 << mode.blue_mask) - 1);
+
+    r = r << (8 - mode.red_mask) | r >> (2 * mode.red_mask - 8);
+    g = g << (8 - mode.green_mask) | g >> (2 * mode.green_mask - 8);
+    b = b << (8 - mode.blue_mask) | b >> (2 * mode.blue_mask - 8);
+    return r << 16 | g << 8 | b;
+}
+
+static FILE *ppm_open(int width, int height) {
+    char path[256];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s-%s-%02d.ppm", out_dir, mode_name, scene, frame_number);
+    f = fopen(path, "wb");
+    if(f == 0) {
+        perror(path);
+        exit(2);
+    }
+    fprintf(f, "P6\n%d %d\n255\n", width, height);
+    return f;
+}
+
+static void lfb_dump() {
+    FILE *f = ppm_open(mode.width, mode.height);
+
+    for(int y = 0; y < mode.height; y++)
+        for(int x = 0; x < mode.width; x++) {
+            uint32_t rgb = lfb_rgb(lfb + y * mode.pitch + x * pixel_bytes);
+            fputc(rgb >> 16, f);
+            fputc(rgb >> 8, f);
+            fputc(rgb, f);
+        }
+    fclose(f);
+}
+
+static void golden_check(unsigned long long hash) {
+    char key[96];
+    int i;
+
+    snprintf(key, sizeof(key), "%s %s %d", mode_name, scene, frame_number);
+    for(i = 0; i < golden_count && strcmp(golden[i].key, key) != 0; i++);
+    if(i == golden_count) {
+        if(!updating) {
+            if(golden_count > 0)
+                fprintf(stderr, "%s: not in the golden file\n", key);
+            return;
+        }
+        if(golden_count == MAX_GOLDEN)
+            return;
+        snprintf(golden[golden_count++].key, sizeof(golden[i].key), "%s", key);
+    }
+    golden[i].seen = 1;
+    if(updating) {
+        golden[i].hash = hash;
+    } else if(golden[i].hash != hash) {
+        fprintf(stderr, "%s: %016llx, golden %016llx\n", key, hash, golden[i].hash);
+        golden_mismatches++;
+    }
+}
+
+// the end of a frame drawn since start
+static void frame_done(unsigned long long start) {
+    unsigned long long elapsed = now_ns() - start;
+    uint32_t changed = 0;
+
+    for(uint32_t i = 0; i < lfb_size; i++)
+        changed += lfb[i] != previous[i];
+    memcpy(previous, lfb, lfb_size);
+
+    scene_ns += elapsed;
+    scene_written += lfb_bytes_written;
+    scene_changed += changed;
+    golden_check(lfb_hash());
+    if(out_dir)
+        lfb_dump();
+    frame_number++;
+    lfb_bytes_written = 0;
+}
+
+static void scene_begin(const char *name) {
+    scene = name;
+    frame_number = 0;
+    scene_ns = scene_written = scene_changed = 0;
+    lfb_bytes_written = 0;
+}
+
+static void scene_end() {
+    int frames = frame_number ? frame_number : 1;
+
+    fprintf(stdout, "%-12s %-8s %4d frames %10.1f us %10llu written %10llu changed per frame\n",
+            mode_name, scene, frame_number, scene_ns / 1000.0 / frames,
+            scene_written / frames, scene_changed / frames);
+}
+
+/* --- scenes --- */
+
+static const uint32_t colors[] = { 0xC0C0C0, 0x808000, 0x008080, 0xE0E0E0 };
+#define WINDOWS 4
+
+static int windows_open(struct WINDOW **w) {
+    for(int i = 0; i < WINDOWS; i++) {
+        w[i] = window_create(40 + i * 60, 40 + i * 40, 240, 180, colors[i]);
+        if(w[i] == 0)
+            return 0;
+    }
+    return 1;
+}
+
+static void windows_close(struct WINDOW **w) {
+    for(int i = 0; i < WINDOWS; i++)
+        window_destroy(w[i]);
+    compositor_flush();
+}
+
+// the empty desktop, then the windows appearing
+static void scene_desktop() {
+    struct WINDOW *w[WINDOWS];
+    unsigned long long start;
+
+    scene_begin("desktop");
+    start = now_ns();
+    compositor_init();
+    compositor_flush();
+    frame_done(start);
+
+    start = now_ns();
+    if(!windows_open(w))
+        return;
+    compositor_flush();
+    frame_done(start);
+    windows_close(w);
+    scene_end();
+}
+
+// the top window dragged across the others, as gui_benchmark does
+static void scene_drag() {
+    struct WINDOW *w[WINDOWS];
+    unsigned long long start;
+
+    compositor_init();
+    if(!windows_open(w))
+        return;
+    compositor_flush();
+    memcpy(previous, lfb, lfb_size);
+
+    scene_begin("drag");
+    for(int i = 0; i < 16; i++) {
+        start = now_ns();
+        window_move(w[WINDOWS - 1], 220 + i * 12, 160 + i * 6);
+        compositor_flush();
+        frame_done(start);
+    }
+    for(int i = 0; i < WINDOWS; i++) {
+        start = now_ns();
+        window_raise(w[i]);
+        compositor_flush();
+        frame_done(start);
+    }
+    scene_end();
+    windows_close(w);
+}
+
+// the software cursor moving over a window and the desktop
+static void scene_cursor() {
+    struct WINDOW *w[WINDOWS];
+    unsigned long long start;
+
+    compositor_init();
+    if(!windows_open(w))
+        return;
+    compositor_flush();
+    memcpy(previous, lfb, lfb_size);
+
+    scene_begin("cursor");
+    start = now_ns();
+    cursor_show(10, 10);
+    frame_done(start);
+    for(int i = 1; i < 24; i++) {
+        start = now_ns();
+        cursor_move(10 + i * 17, 10 + i * 11);
+        frame_done(start);
+    }
+    start = now_ns();
+    cursor_hide();
+    frame_done(start);
+    scene_end();
+    windows_close(w);
+}
+
+// an in memory BMP of depth bpp with a gradient, palettes get a colour ramp
+static uint8_t *bmp_build(int width, int height, int bpp, uint32_t *size) {
+    uint32_t colors = bpp <= 8 ? 1u << bpp : 0;
+    uint32_t stride = ((width * bpp + 31) / 32) * 4;
+    uint32_t offset = sizeof(struct bmp_header) + 40 + colors * 4;
+    uint8_t *image = calloc(1, offset + stride * height + 16);
+    struct bmp_header *file = (struct bmp_header*)image;
+    struct dib_header *dib = (struct dib_header*)(image + sizeof(struct bmp_header));
+
+    *size = offset + stride * height;
+    file->type = BMP_MAGIC;
+    file->size = *size;
+    file->offset = offset;
+    dib->headerSize = 40;
+    dib->width = width;
+    dib->height = height;
+    dib->color_planes = 1;
+    dib->colorDepth = bpp;
+    dib->compression = BI_RGB;
+    dib->color_num = colors;
+    for(uint32_t i = 0; i < colors; i++) {
+        uint8_t *entry = image + sizeof(struct bmp_header) + 40 + i * 4;
+        entry[0] = i * 255 / (colors - 1);
+        entry[1] = 255 - entry[0];
+        entry[2] = (i * 97) & 0xFF;
+    }
+    for(int y = 0; y < height; y++) {
+        uint8_t *row = image + offset + y * stride;
+        for(int x = 0; x < width; x++) {
+            if(bpp >= 24) {
+                uint8_t *p = row + x * (bpp / 8);
+                p[0] = x * 255 / width;
+                p[1] = y * 255 / height;
+                p[2] = (x ^ y) & 0xFF;
+            } else {
+                int index = ((x / 8) + (y / 8)) & (colors - 1);
+                int shift = 8 - bpp * (x % (8 / bpp) + 1);
+                row[x * bpp / 8] |= index << shift;
+            }
+        }
+    }
+    return image;
+}
+
+// pictures of every depth bmp_draw knows, one frame each, partly off screen at the end
+static void scene_bmp() {
+    static const int depths[] = { 1, 4, 8, 24, 32 };
+    unsigned long long start;
+    uint32_t size;
+
+    compositor_init();
+    compositor_flush();
+    memcpy(previous, lfb, lfb_size);
+
+    scene_begin("bmp");
+    for(int i = 0; i < 5; i++) {
+        uint8_t *image = bmp_build(200, 150, depths[i], &size);
+        start = now_ns();
+        bmp_draw(image, size, 20 + i * 90, 20 + i * 60);
+        frame_done(start);
+        free(image);
+    }
+    {
+        uint8_t *image = bmp_build(320, 240, 24, &size);
+        start = now_ns();
+        bmp_draw(image, size, mode.width - 160, mode.height - 120);
+        frame_done(start);
+        free(image);
+    }
+    scene_end();
+}
+
+/* --- the text console --- */
+
+static const uint32_t vga_palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF,
+};
+
+/* 8x16 glyphs of a PSF1 font, 0 if it can't be read. A font with a
+*  unicode table must have an entry for every glyph, which also catches a
+*  file that went through a text conversion */
+static uint8_t *font_load() {
+    static uint8_t font[32768];
+    FILE *f = fopen(font_path, "rb");
+    size_t got, glyphs, ends = 0;
+
+    if(f == 0)
+        return 0;
+    got = fread(font, 1, sizeof(font), f);
+    fclose(f);
+    if(got < 4 || font[0] != 0x36 || font[1] != 0x04 || font[3] != 16)
+        return 0;
+    glyphs = font[2] & 1 ? 512 : 256;
+    if(got < 4 + glyphs * 16)
+        return 0;
+    if(font[2] & 2) {
+        for(size_t i = 4 + glyphs * 16; i + 1 < got; i += 2)
+            ends += font[i] == 0xFF && font[i + 1] == 0xFF;
+        if(ends < glyphs)
+            return 0;
+    }
+    return font + 4;
+}
+
+// one row of a glyph, a filled box stands in for every character without a font
+static int glyph_row(uint8_t *glyphs, uint8_t c, int row) {
+    if(glyphs)
+        return glyphs[c * 16 + row];
+    return c != ' ' && c != 0 && row >= 3 && row < 13 ? 0x7E : 0;
+}
+
+static void text_dump(uint8_t *glyphs) {
+    const uint8_t *cells = (const uint8_t*)VIDEO_MEMORY;
+    FILE *f = ppm_open(MAX_COLS * 8, MAX_ROWS * 16);
+
+    for(int y = 0; y < MAX_ROWS * 16; y++)
+        for(int x = 0; x < MAX_COLS * 8; x++) {
+            const uint8_t *cell = cells + ((y / 16) * MAX_COLS + x / 8) * 2;
+            int on = glyph_row(glyphs, cell[0], y % 16) & (0x80 >> (x % 8));
+            uint32_t rgb = vga_palette[on ? cell[1] & 15 : cell[1] >> 4 & 7];
+            fputc(rgb >> 16, f);
+            fputc(rgb >> 8, f);
+            fputc(rgb, f);
+        }
+    fclose(f);
+}
+
+static void console_print(const char *text) {
+    for(; *text; text++)
+        print_char(*text, -1, -1, 0);
+}
+
+static void text_frame_done(uint8_t *glyphs) {
+    golden_check(fnv64(0xCBF29CE484222325ull, (const uint8_t*)VIDEO_MEMORY, MAX_ROWS * MAX_COLS * 2));
+    if(out_dir)
+        text_dump(glyphs);
+    frame_number++;
+}
+
+// clearing, printing and scrolling the 80x25 console
+static void scene_console() {
+    uint8_t *glyphs = font_load();
+    unsigned long long start;
+    char line[64];
+
+    if(!text_init()) {
+        fprintf(stderr, "console: can't map the text buffer at 0x%x\n", VIDEO_MEMORY);
+        return;
+    }
+    if(glyphs == 0 && out_dir)
+        fprintf(stderr, "console: no usable PSF1 font in %s, characters drawn as boxes\n", font_path);
+    scene_begin("console");
+    start = now_ns();
+    clear_screen();
+    console_print("[ ETHIOPIC 32 BIT OPERATING SYSTEM ]\n");
+    scene_ns += now_ns() - start;
+    text_frame_done(glyphs);
+
+    start = now_ns();
+    for(int i = 0; i < 40; i++) {
+        snprintf(line, sizeof(line), "line %d of the scroll test\n", i);
+        console_print(line);
+    }
+    scene_ns += now_ns() - start;
+    text_frame_done(glyphs);
+    scene_end();
+}
+
+/* --- golden file --- */
+
+static void golden_read(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[160];
+
+    if(f == 0)
+        return;
+    while(golden_count < MAX_GOLDEN && fgets(line, sizeof(line), f)) {
+        char mode_key[32], scene_key[32];
+        int frame;
+        unsigned long long hash;
+        if(sscanf(line, "%31s %31s %d %llx", mode_key, scene_key, &frame, &hash) != 4)
+            continue;
+        snprintf(golden[golden_count].key, sizeof(golden[0].key), "%s %s %d", mode_key, scene_key, frame);
+        golden[golden_count++].hash = hash;
+    }
+    fclose(f);
+}
+
+static void golden_write(const char *path) {
+    FILE *f = fopen(path, "w");
+
+    if(f == 0) {
+        perror(path);
+        exit(2);
+    }
+    for(int i = 0; i < golden_count; i++)
+        fprintf(f, "%s %016llx\n", golden[i].key, golden[i].hash);
+    fclose(f);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-m WIDTHxHEIGHTxBPP] [-o dir] [-g golden | -u golden] [-f font.psf]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int width = 800, height = 600, bpp = 32;
+    const char *golden_path = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(i + 1 == argc)
+            usage(argv[0]);
+        if(strcmp(argv[i], "-m") == 0) {
+            if(sscanf(argv[++i], "%dx%dx%d", &width, &height, &bpp) != 3)
+                usage(argv[0]);
+        } else if(strcmp(argv[i], "-o") == 0) {
+            out_dir = argv[++i];
+        } else if(strcmp(argv[i], "-g") == 0 || strcmp(argv[i], "-u") == 0) {
+            updating = argv[i][1] == 'u';
+            golden_path = argv[++i];
+        } else if(strcmp(argv[i], "-f") == 0) {
+            font_path = argv[++i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if(width <= 0 || height <= 0 || !mode_init(width, height, bpp)) {
+        fprintf(stderr, "can't simulate a %dx%dx%d mode\n", width, height, bpp);
+        return 2;
+    }
+    if(golden_path)
+        golden_read(golden_path);
+
+    scene_desktop();
+    scene_drag();
+    scene_cursor();
+    scene_bmp();
+    scene_console();
+
+    if(updating) {
+        golden_write(golden_path);
+        return 0;
+    }
+    if(golden_mismatches) {
+        fprintf(stderr, "%d frames differ from %s\n", golden_mismatches, golden_path);
+        return 1;
+    }
+    return 0;
+}
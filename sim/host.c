@@ -0,0 +1,115 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "../kernel/memory.h"
+#include "../kernel/low_level.h"
+#include "../kernel/printk.h"
+#include "../fs/vfs.h"
+
+/* Host stand-ins for the kernel services the graphics code calls, so
+*  drivers/screen.c, drivers/vesa_vbe and gui/ link into sim/fbsim as
+*  they are. Memory the kernel would get from the frame allocator comes
+*  from mmap below 4 GB, the code keeps addresses in 32 bit integers. */
+
+uint32_t frame_alloc_contiguous(uint32_t count) {
+    void *p = mmap(0, count * PAGE_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    return p == MAP_FAILED ? 0 : (uint32_t)(unsigned long)p;
+}
+
+void frame_free_contiguous(uint32_t start, uint32_t count) {
+    munmap((void*)(unsigned long)start, count * PAGE_SIZE);
+}
+
+unsigned long long rdtsc() {
+    unsigned int low, high;
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return ((unsigned long long)high << 32) | low;
+}
+
+// there is nothing to interrupt the simulator
+unsigned int interrupts_save() {
+    return 0;
+}
+
+void interrupts_restore(unsigned int flags) {
+}
+
+/* The VGA CRT controller, as far as screen.c uses it: the index
+*  register at 0x3D4 and the cursor location registers 14 and 15 */
+static unsigned char crtc_index;
+static unsigned char crtc[32];
+
+unsigned char port_byte_in(unsigned short port) {
+    if(port == 0x3D5)
+        return crtc[crtc_index & 31];
+    return 0xFF;
+}
+
+void port_byte_out(unsigned short port, unsigned char data) {
+    if(port == 0x3D4)
+        crtc_index = data;
+    else if(port == 0x3D5)
+        crtc[crtc_index & 31] = data;
+}
+
+// the text console copies everything to COM1
+void serial_puts(const char *string) {
+}
+
+void printk(const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void printk_level(int level, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+/* bmp_draw_file opens pictures through the VFS, here they are host
+*  files read into memory whole */
+#define HOST_FILES  8
+
+static struct {
+    uint8_t *data;
+    uint32_t size;
+} files[HOST_FILES];
+
+int vfs_open(char *path) {
+    FILE *f = fopen(path, "rb");
+    long size;
+
+    if(f == 0)
+        return -1;
+    for(int fd = 0; fd < HOST_FILES; fd++) {
+        if(files[fd].data)
+            continue;
+        fseek(f, 0, SEEK_END);
+        size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        files[fd].data = malloc(size ? size : 1);
+        files[fd].size = fread(files[fd].data, 1, size, f);
+        fclose(f);
+        return fd;
+    }
+    fclose(f);
+    return -1;
+}
+
+// the kernel's mapping outlives the descriptor, so does this one
+const uint8_t *vfs_mmap(int fd, uint32_t *size) {
+    *size = files[fd].size;
+    return files[fd].data;
+}
+
+void vfs_close(int fd) {
+    files[fd].data = 0;
+}
@@ -1,7 +1,24 @@
 #include "terminal.h"
 #include "../include/types.h"
+#include "../include/system.h"
+#include "../drivers/screen.h"
+#include "../kernel/sched.h"
+#include "../kernel/workpool.h"
+#include "../kernel/process.h"
+#include "../drivers/vesa_vbe/bmp.h"
+#include "../gui/window.h"
+#include "../kernel/pci.h"
+#include "../drivers/block.h"
+#include "../fs/bcache.h"
+#include "../fs/fat.h"
+#include "../drivers/serial.h"
+#include "../kernel/printk.h"
+#include "../kernel/trace.h"
+#include "../kernel/profile.h"
+#include "../kernel/bench.h"
+#include "../net/net.h"
 
-unsigned char *command;
+unsigned char command[COMMAND_LENGTH];
 int i = 0;
 
 void terminal_cursor() {
@@ -18,7 +35,45 @@ void terminal_init() {
     terminal_cursor();
 }
 
+/* matches "<name>" and "<name> <number>". returns the number, fallback
+*  without one, or -1 if command is something else */
+static int terminal_number_command(unsigned char *command, char *name, int fallback) {
+    int n, value = 0;
+    for(n = 0; name[n] != '\0'; n++)
+        if(command[n] != name[n])
+            return -1;
+    if(command[n] == '\0')
+        return fallback;
+    if(command[n] != ' ' || command[n + 1] == '\0')
+        return -1;
+    for(n++; command[n] != '\0'; n++) {
+        if(command[n] < '0' || command[n] > '9')
+            return -1;
+        value = value * 10 + command[n] - '0';
+    }
+    return value;
+}
+
+// runs bin/<name> from the initrd and waits for it to exit
+int terminal_run_program(unsigned char *name) {
+    char path[COMMAND_LENGTH + 4] = "bin/";
+    struct process *p;
+    int n;
+    for(n = 0; name[n] != '\0'; n++)
+        path[n + 4] = name[n];
+    path[n + 4] = '\0';
+    p = process_spawn(path);
+    if(p == 0)
+        return 0;
+    process_wait(p);
+    return 1;
+}
+
 void terminal_accept_command(unsigned char newline) {
+    char line[32];
+    int rate;
+    if(i >= COMMAND_LENGTH - 1 && newline != '\n' && newline != '\b')
+        return;
     command[i] = newline;
     if(newline != '\b')
         print_char(command[i], -1, -1, 0);
@@ -26,6 +81,8 @@ void terminal_accept_command(unsigned char newline) {
         i = i - 2;          // if the backspace is pressed decrement the value of i
 
     i++;
+    if(i < 0)
+        i = 0;
     if(newline == '\n') {
         command[i-1] = '\0';
         // compare the strings
@@ -39,7 +96,59 @@ void terminal_accept_command(unsigned char newline) {
             restart();
         } else if(string_compare(command, "halt") > 0) {
             halt();
-        } else {
+        } else if(string_compare(command, "schedbench") > 0) {
+            sched_benchmark();
+        } else if(string_compare(command, "smpbench") > 0) {
+            pool_benchmark();
+        } else if(string_compare(command, "bmpbench") > 0) {
+            bmp_benchmark();
+        } else if(string_compare(command, "guibench") > 0) {
+            gui_benchmark();
+        } else if(string_compare(command, "lspci") > 0) {
+            pci_list();
+        } else if(string_compare(command, "blkbench") > 0) {
+            block_benchmark();
+        } else if(string_compare(command, "cachebench") > 0) {
+            bcache_benchmark();
+        } else if(string_compare(command, "fatbench") > 0) {
+            fat_benchmark();
+        } else if(string_compare(command, "serialbench") > 0) {
+            serial_benchmark();
+        } else if(string_compare(command, "logbench") > 0) {
+            printk_benchmark();
+        } else if(string_compare(command, "tracestart") > 0) {
+            if(trace_start() < 0)
+                printf("not enough memory for the trace buffers\n", -1, -1);
+        } else if(string_compare(command, "tracestop") > 0) {
+            trace_stop();
+        } else if(string_compare(command, "tracedump") > 0) {
+            trace_dump();
+        } else if(string_compare(command, "tracebench") > 0) {
+            trace_benchmark();
+        } else if(string_compare(command, "irqbench") > 0) {
+            irq_benchmark();
+        } else if((rate = terminal_number_command(command, "profstart", PROFILE_HZ)) >= 0) {
+            rate = profile_start(rate);
+            if(rate < 0) {
+                printf("not enough memory for the profile tables\n", -1, -1);
+            } else {
+                snprintk(line, sizeof(line), "sampling at %d hz\n", rate);
+                printf(line, -1, -1);
+            }
+        } else if(string_compare(command, "bench") > 0) {
+            bench_run_all();
+        } else if(string_compare(command, "profstop") > 0) {
+            profile_stop();
+        } else if(string_compare(command, "profdump") > 0) {
+            profile_dump();
+        } else if(string_compare(command, "netinfo") > 0) {
+            net_info();
+        } else if(string_compare(command, "netlog") > 0) {
+            if(net_log_start() < 0)
+                printf("no network device\n", -1, -1);
+        } else if(string_compare(command, "netbench") > 0) {
+            net_benchmark();
+        } else if(!terminal_run_program(command)) {
             printf("Command not found\n", -1, -1);
         }
         i = 0;                     
@@ -54,6 +163,27 @@ void help() {
     printf("shutdown - to shutdown the computer\n", -1, -1);
     printf("restart - restart the computer\n", -1, -1);
     printf("halt - to halt this computer\n", -1, -1);
+    printf("schedbench - measure the context switch cost\n", -1, -1);
+    printf("smpbench - framebuffer blit on one cpu and on all cpus\n", -1, -1);
+    printf("bmpbench - decode and blit pic.bmp from the initrd\n", -1, -1);
+    printf("guibench - window move repaint against a full screen repaint\n", -1, -1);
+    printf("lspci - list the PCI devices found at boot\n", -1, -1);
+    printf("blkbench - sequential reads from the first disk at several queue depths\n", -1, -1);
+    printf("cachebench - cold, read-ahead and cached reads through the block cache\n", -1, -1);
+    printf("fatbench - path lookups and file reads on the FAT disk, cold and cached\n", -1, -1);
+    printf("serialbench - queued against polled writes to COM1 and the drain rate\n", -1, -1);
+    printf("logbench - printk into the log ring against printing straight to the consoles\n", -1, -1);
+    printf("tracestart, tracestop - record interrupts, switches and disk I/O per cpu\n", -1, -1);
+    printf("tracedump - stop tracing and send the events out on COM1, see scripts/trace2json.py\n", -1, -1);
+    printf("irqbench - cycles from an interrupt to its handler and back\n", -1, -1);
+    printf("tracebench - cost of a tracepoint while tracing is off and on\n", -1, -1);
+    printf("bench - the benchmark suite of make bench, results on the screen and COM1\n", -1, -1);
+    printf("profstart [hz], profstop - sample where every cpu spends its time\n", -1, -1);
+    printf("profdump - stop sampling and send the profile out on COM1, see scripts/profile.py\n", -1, -1);
+    printf("netinfo - address and packet counts of the network device\n", -1, -1);
+    printf("netlog - send the log and bench results to UDP port 5140 of the host too\n", -1, -1);
+    printf("netbench - UDP send rate with and without copying the payload\n", -1, -1);
+    printf("<program> - run bin/<program> from the initrd, e.g. sysbench\n", -1, -1);
     printf("\n", -1, -1);
 }
 
@@ -1,8 +1,11 @@
 #ifndef __TERMINAL_H_
 #define __TERMINAL_H_
 
+#define COMMAND_LENGTH 64
+
 void terminal_init();
 void terminal_accept_command(unsigned char newline);
+int terminal_run_program(unsigned char *name);
 void help();
 void shutdown();
 void restart();
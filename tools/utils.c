@@ -14,14 +14,14 @@ int handling_scrolling(int cursor_offset) {
         return cursor_offset;
     }
 
-    // suffle the rows back one
-    for(int i = 0; i < 25; i++) {
-        memory_copy(get_screen_offset(0, i) + VIDEO_MEMORY, get_screen_offset(0, i-1) + VIDEO_MEMORY, MAX_COLS*2);
+    // suffle the rows back one, row 0 falls off the top
+    for(int i = 1; i < MAX_ROWS; i++) {
+        memory_copy((char*)(uintptr_t)(get_screen_offset(0, i) + VIDEO_MEMORY), (char*)(uintptr_t)(get_screen_offset(0, i-1) + VIDEO_MEMORY), MAX_COLS*2);
     }
 
     // get the last line address using the offset and videomemory.
     // blank the last line
-    char *last_line = get_screen_offset(0, MAX_ROWS-1) + VIDEO_MEMORY;
+    char *last_line = (char*)(uintptr_t)(get_screen_offset(0, MAX_ROWS-1) + VIDEO_MEMORY);
     for(int i = 0; i < MAX_COLS*2; i++) {
         last_line[i] = 0;
     }
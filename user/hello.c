@@ -0,0 +1,8 @@
+#include "lib/ulib.h"
+
+int main() {
+    print("hello from ring 3, pid ");
+    print_number(getpid());
+    print("\n");
+    return 0;
+}
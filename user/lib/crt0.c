@@ -0,0 +1,15 @@
+#include "syscall.h"
+#include "ulib.h"
+#include <cpuid.h>
+
+int use_sysenter;
+
+int main();
+
+void _start() {
+    unsigned int eax, ebx, ecx, edx;
+
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        use_sysenter = (edx & (1 << 11)) != 0;
+    exit(main());
+}
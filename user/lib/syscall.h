@@ -0,0 +1,42 @@
+#ifndef _USER_SYSCALL_H_
+#define _USER_SYSCALL_H_
+
+/* kernel/syscall.h has the ABI: eax = number, ebx, esi, edi = arguments */
+#define SYS_EXIT        0
+#define SYS_WRITE       1
+#define SYS_YIELD       2
+#define SYS_SLEEP       3
+#define SYS_GETPID      4
+
+static inline int syscall_int80(int number, int arg1, int arg2, int arg3) {
+    int result;
+    __asm__ __volatile__("int $0x80"
+                         : "=a"(result)
+                         : "a"(number), "b"(arg1), "S"(arg2), "D"(arg3)
+                         : "memory");
+    return result;
+}
+
+// sysenter returns to the address in edx with the stack pointer from ecx
+static inline int syscall_sysenter(int number, int arg1, int arg2, int arg3) {
+    int result;
+    __asm__ __volatile__("mov %%esp, %%ecx\n\t"
+                         "lea 1f, %%edx\n\t"
+                         "sysenter\n"
+                         "1:"
+                         : "=a"(result)
+                         : "a"(number), "b"(arg1), "S"(arg2), "D"(arg3)
+                         : "ecx", "edx", "memory");
+    return result;
+}
+
+// set by crt0 from cpuid, every wrapper in ulib.c goes through this
+extern int use_sysenter;
+
+static inline int syscall(int number, int arg1, int arg2, int arg3) {
+    if(use_sysenter)
+        return syscall_sysenter(number, arg1, arg2, arg3);
+    return syscall_int80(number, arg1, arg2, arg3);
+}
+
+#endif
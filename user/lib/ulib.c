@@ -0,0 +1,41 @@
+#include "ulib.h"
+#include "syscall.h"
+
+void exit(int code) {
+    syscall(SYS_EXIT, code, 0, 0);
+    for(;;);
+}
+
+int write(char *buffer, int length) {
+    return syscall(SYS_WRITE, (int)buffer, length, 0);
+}
+
+void print(char *text) {
+    int length = 0;
+    while(text[length] != '\0')
+        length++;
+    write(text, length);
+}
+
+void print_number(unsigned int value) {
+    char digits[11];
+    int i = sizeof(digits);
+
+    do {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while(value != 0);
+    write(digits + i, sizeof(digits) - i);
+}
+
+void yield() {
+    syscall(SYS_YIELD, 0, 0, 0);
+}
+
+void sleep(int ticks) {
+    syscall(SYS_SLEEP, ticks, 0, 0);
+}
+
+int getpid() {
+    return syscall(SYS_GETPID, 0, 0, 0);
+}
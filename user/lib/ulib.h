@@ -0,0 +1,12 @@
+#ifndef _ULIB_H_
+#define _ULIB_H_
+
+void exit(int code);
+int write(char *buffer, int length);
+void print(char *text);
+void print_number(unsigned int value);
+void yield();
+void sleep(int ticks);
+int getpid();
+
+#endif
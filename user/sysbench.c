@@ -0,0 +1,34 @@
+/* sysenter against int 0x80 round trip cost, both calling getpid */
+#include "lib/ulib.h"
+#include "lib/syscall.h"
+
+#define BENCH_CALLS 10000
+
+static inline unsigned long long rdtsc() {
+    unsigned long long value;
+    __asm__ __volatile__("rdtsc" : "=A"(value));
+    return value;
+}
+
+int main() {
+    unsigned long long start;
+    int i;
+
+    if(use_sysenter) {
+        start = rdtsc();
+        for(i = 0; i < BENCH_CALLS; i++)
+            syscall_sysenter(SYS_GETPID, 0, 0, 0);
+        print("sysenter round trip: ");
+        // 32 bit division, programs are not linked against libgcc either
+        print_number((unsigned int)(rdtsc() - start) / BENCH_CALLS);
+        print(" cycles\n");
+    }
+
+    start = rdtsc();
+    for(i = 0; i < BENCH_CALLS; i++)
+        syscall_int80(SYS_GETPID, 0, 0, 0);
+    print("int 0x80 round trip: ");
+    print_number((unsigned int)(rdtsc() - start) / BENCH_CALLS);
+    print(" cycles\n");
+    return 0;
+}